@@ -119,6 +119,7 @@ testScripts = [
     'blockchain.py',
     'disablewallet.py',
     'sendheaders.py', # NOTE: needs dash_hash to pass
+    'compactblocks.py',
     'keypool.py',
     'prioritise_transaction.py',
     'invalidblockrequest.py', # NOTE: needs dash_hash to pass
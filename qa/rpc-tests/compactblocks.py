@@ -0,0 +1,57 @@
+#!/usr/bin/env python2
+# Copyright (c) 2014-2017 The Dash Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay: blocks are reconstructed from the mempool,
+# and missing transactions are fetched with getblocktxn.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = []
+        # Node0 mines, node1 relays transactions, node2 only ever sees blocks
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(2, self.options.tmpdir, ["-debug=cmpctblock", "-blocksonly"]))
+        connect_nodes(self.nodes[1], 0)
+        connect_nodes(self.nodes[2], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def get_counter(self, node, name):
+        return node.getperfstats()["counters"][name]
+
+    def run_test(self):
+        # Leave initial block download behind, so blocks are fetched directly
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        address = self.nodes[1].getnewaddress()
+        for i in range(5):
+            for j in range(5):
+                self.nodes[0].sendtoaddress(address, 1)
+            sync_mempools(self.nodes[0:2])
+            self.nodes[0].generate(1)
+            sync_blocks(self.nodes)
+
+        # Node1 had all transactions in its mempool
+        assert_greater_than(self.get_counter(self.nodes[1], "cmpctblock_reconstructed"), 0)
+        assert_equal(self.get_counter(self.nodes[1], "cmpctblock_blocktxn"), 0)
+        assert_equal(self.nodes[1].getrawmempool(), [])
+
+        # Node2 had to ask for them
+        assert_greater_than(self.get_counter(self.nodes[2], "cmpctblock_blocktxn"), 0)
+
+        for node in self.nodes:
+            assert_equal(self.get_counter(node, "cmpctblock_failed"), 0)
+            assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -4,6 +4,8 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "util.h"
@@ -11,9 +13,11 @@
 int
 main(int argc, char** argv)
 {
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
 
     benchmark::BenchRunner::RunAll();
 
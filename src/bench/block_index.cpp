@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "random.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+// Header-heavy operations on a synthetic 1M header chain: looking up entries by hash,
+// GetAncestor and walking back a few blocks as GetMedianTimePast does.
+static const int NUM_HEADERS = 1000000;
+static const int OPS_PER_ITERATION = 1000;
+
+struct CheapHasher
+{
+    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+};
+
+// The block index as it was: an unordered_map node and a new'd entry per header,
+// created in hash order as LoadBlockIndexGuts read them
+class CLegacyBlockIndex
+{
+private:
+    boost::unordered_map<uint256, CBlockIndex*, CheapHasher> map;
+public:
+    static const bool fHeightOrder = false;
+    ~CLegacyBlockIndex()
+    {
+        for (boost::unordered_map<uint256, CBlockIndex*, CheapHasher>::iterator it = map.begin(); it != map.end(); it++)
+            delete it->second;
+    }
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->phashBlock = &map.insert(std::make_pair(hash, pindex)).first->first;
+        return pindex;
+    }
+    CBlockIndex* Find(const uint256& hash) const { return map.find(hash)->second; }
+};
+
+// CBlockIndexMap and CBlockIndexArena, created in height order
+class CArenaBlockIndex
+{
+private:
+    CBlockIndexMap map;
+    CBlockIndexArena arena;
+public:
+    static const bool fHeightOrder = true;
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        CBlockIndex* pindex = arena.Create();
+        pindex->phashBlock = &map.insert(std::make_pair(hash, pindex)).first->first;
+        return pindex;
+    }
+    CBlockIndex* Find(const uint256& hash) const { return map.find(hash)->second; }
+};
+
+template <typename Index>
+static void BlockIndexOperations(benchmark::State& state)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> vHashes(NUM_HEADERS);
+    for (int i = 0; i < NUM_HEADERS; i++)
+        vHashes[i] = GetRandHash();
+
+    // (hash, height) in the order the entries get created
+    std::vector<std::pair<uint256, int> > vOrder(NUM_HEADERS);
+    for (int i = 0; i < NUM_HEADERS; i++)
+        vOrder[i] = std::make_pair(vHashes[i], i);
+    if (!Index::fHeightOrder)
+        std::sort(vOrder.begin(), vOrder.end());
+
+    Index index;
+    std::vector<CBlockIndex*> vChain(NUM_HEADERS);
+    for (int i = 0; i < NUM_HEADERS; i++)
+        vChain[vOrder[i].second] = index.Insert(vOrder[i].first);
+    for (int i = 0; i < NUM_HEADERS; i++) {
+        vChain[i]->pprev = i > 0 ? vChain[i - 1] : NULL;
+        vChain[i]->nHeight = i;
+        vChain[i]->nTime = i;
+        vChain[i]->BuildSkip();
+    }
+
+    int64_t nSum = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < OPS_PER_ITERATION; i++) {
+            const CBlockIndex* pindex = index.Find(vHashes[insecure_rand() % NUM_HEADERS]);
+            pindex = pindex->GetAncestor(insecure_rand() % (pindex->nHeight + 1));
+            nSum += pindex->GetMedianTimePast();
+        }
+    }
+    assert(nSum >= 0);
+}
+
+static void BlockIndexLegacy(benchmark::State& state)
+{
+    BlockIndexOperations<CLegacyBlockIndex>(state);
+}
+
+static void BlockIndexArena(benchmark::State& state)
+{
+    BlockIndexOperations<CArenaBlockIndex>(state);
+}
+
+BENCHMARK(BlockIndexLegacy);
+BENCHMARK(BlockIndexArena);
@@ -0,0 +1,99 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "random.h"
+
+#include <vector>
+
+// An IBD-like workload on the coins cache: every block adds the outputs of
+// its transactions and spends older ones, and every few blocks the cache is
+// flushed and starts over.
+static const int NUM_BLOCKS = 40;
+static const int TXS_PER_BLOCK = 1000;
+static const int SPENDS_PER_BLOCK = 800;
+static const int BLOCKS_PER_FLUSH = 10;
+
+static std::vector<uint256> MakeTxids()
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> vTxids(NUM_BLOCKS * TXS_PER_BLOCK);
+    for (size_t i = 0; i < vTxids.size(); i++)
+        vTxids[i] = GetRandHash();
+    return vTxids;
+}
+
+static CCoins MakeCoins(int nHeight)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = nHeight;
+    coins.vout.resize(2);
+    coins.vout[0].nValue = 1;
+    coins.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coins.vout[1].nValue = 2;
+    coins.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    return coins;
+}
+
+// The bare map with the given allocator, entries are added and erased like in ConnectBlock
+template <typename Map>
+static void CoinsMapBlocks(benchmark::State& state)
+{
+    std::vector<uint256> vTxids = MakeTxids();
+    CCoins coins = MakeCoins(1);
+
+    while (state.KeepRunning()) {
+        Map map;
+        for (int nBlock = 0; nBlock < NUM_BLOCKS; nBlock++) {
+            for (int i = 0; i < TXS_PER_BLOCK; i++) {
+                CCoinsCacheEntry& entry = map[vTxids[nBlock * TXS_PER_BLOCK + i]];
+                entry.coins = coins;
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            }
+            for (int i = 0; i < SPENDS_PER_BLOCK && nBlock > 0; i++)
+                map.erase(vTxids[(nBlock - 1) * TXS_PER_BLOCK + i]);
+            if (nBlock % BLOCKS_PER_FLUSH == BLOCKS_PER_FLUSH - 1)
+                Map().swap(map);
+        }
+    }
+}
+
+static void CoinsMapBlocksStdAllocator(benchmark::State& state)
+{
+    CoinsMapBlocks<boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> >(state);
+}
+
+static void CoinsMapBlocksPoolAllocator(benchmark::State& state)
+{
+    CoinsMapBlocks<CCoinsMap>(state);
+}
+
+// The same workload through CCoinsViewCache
+static void CoinsCacheBlocks(benchmark::State& state)
+{
+    std::vector<uint256> vTxids = MakeTxids();
+    CCoins coins = MakeCoins(1);
+    CCoinsView base;
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&base);
+        for (int nBlock = 0; nBlock < NUM_BLOCKS; nBlock++) {
+            for (int i = 0; i < TXS_PER_BLOCK; i++)
+                *cache.ModifyNewCoins(vTxids[nBlock * TXS_PER_BLOCK + i]) = coins;
+            for (int i = 0; i < SPENDS_PER_BLOCK && nBlock > 0; i++) {
+                CCoinsModifier modifier = cache.ModifyCoins(vTxids[(nBlock - 1) * TXS_PER_BLOCK + i]);
+                modifier->Spend(0);
+                modifier->Spend(1);
+            }
+            if (nBlock % BLOCKS_PER_FLUSH == BLOCKS_PER_FLUSH - 1)
+                cache.Flush();
+        }
+    }
+}
+
+BENCHMARK(CoinsMapBlocksStdAllocator);
+BENCHMARK(CoinsMapBlocksPoolAllocator);
+BENCHMARK(CoinsCacheBlocks);
@@ -0,0 +1,107 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "policy/policy.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+// Script verification of a batch of relayed transactions, as AcceptToMemoryPool
+// does it inline and as PreverifyTransactions does it on the transaction script
+// check threads. Every iteration verifies NUM_TXS transactions, so the rate is
+// NUM_TXS / average txs/sec.
+static const int NUM_TXS = 100;
+static const int NUM_INPUTS = 2;
+
+static void MakeTransactions(CCoinsViewCache& view, std::vector<CTransaction>& vtx)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction funding;
+    funding.vin.resize(1);
+    funding.vout.resize(NUM_TXS * NUM_INPUTS);
+    BOOST_FOREACH(CTxOut& txout, funding.vout) {
+        txout.nValue = COIN;
+        txout.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+    CTransaction fundingTx(funding);
+    {
+        CCoinsModifier coins = view.ModifyNewCoins(fundingTx.GetHash());
+        *coins = CCoins(fundingTx, 1);
+    }
+
+    for (int i = 0; i < NUM_TXS; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(NUM_INPUTS);
+        for (int j = 0; j < NUM_INPUTS; j++)
+            mtx.vin[j].prevout = COutPoint(fundingTx.GetHash(), i * NUM_INPUTS + j);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = NUM_INPUTS * COIN - 1000;
+        mtx.vout[0].scriptPubKey = funding.vout[0].scriptPubKey;
+        for (int j = 0; j < NUM_INPUTS; j++)
+            assert(SignSignature(keystore, fundingTx, mtx, j));
+        vtx.push_back(mtx);
+    }
+}
+
+static void MempoolScriptsInline(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    // Don't let the signature cache short-cut repeated iterations
+    mapArgs["-maxsigcachesize"] = "0";
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTransaction> vtx;
+    MakeTransactions(view, vtx);
+
+    while (state.KeepRunning()) {
+        BOOST_FOREACH(const CTransaction& tx, vtx) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                CScriptCheck check(*view.AccessCoins(tx.vin[i].prevout.hash), tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true);
+                assert(check());
+            }
+        }
+    }
+    mapArgs.erase("-maxsigcachesize");
+}
+
+static void MempoolScriptsPreverify(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    mapArgs["-maxsigcachesize"] = "0";
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTransaction> vtx;
+    MakeTransactions(view, vtx);
+
+    // nThreads - 1 workers, the calling thread takes part in the checks as well
+    int nThreads = std::max(2, (int)boost::thread::hardware_concurrency());
+    nScriptCheckThreads = nThreads;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads - 1; i++)
+        threadGroup.create_thread(&ThreadTxScriptCheck);
+
+    while (state.KeepRunning()) {
+        PreverifyTransactionScripts(vtx, view);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nScriptCheckThreads = 0;
+    mapArgs.erase("-maxsigcachesize");
+}
+
+BENCHMARK(MempoolScriptsInline);
+BENCHMARK(MempoolScriptsPreverify);
@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/merkle.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+
+#include <vector>
+
+// The merkle root of a large block, and the double SHA256 of 64 byte inputs it
+// is made of, batched (SHA256D64) against one CHash256 per input as before
+static const int NUM_LEAVES = 9001;
+static const int NUM_INPUTS = 1024;
+
+static std::vector<uint256> MakeLeaves()
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> vLeaves(NUM_LEAVES);
+    for (size_t i = 0; i < vLeaves.size(); i++)
+        vLeaves[i] = GetRandHash();
+    return vLeaves;
+}
+
+static void MerkleRoot(benchmark::State& state)
+{
+    std::vector<uint256> vLeaves = MakeLeaves();
+
+    while (state.KeepRunning()) {
+        bool fMutated = false;
+        uint256 root = ComputeMerkleRoot(vLeaves, &fMutated);
+        assert(!root.IsNull() && !fMutated);
+    }
+}
+
+static void MerkleRootScalar(benchmark::State& state)
+{
+    std::vector<uint256> vLeaves = MakeLeaves();
+
+    while (state.KeepRunning()) {
+        std::vector<uint256> vLevel(vLeaves);
+        while (vLevel.size() > 1) {
+            if (vLevel.size() & 1)
+                vLevel.push_back(vLevel.back());
+            for (size_t i = 0; i < vLevel.size() / 2; i++)
+                vLevel[i] = Hash(vLevel[2 * i].begin(), vLevel[2 * i].end(), vLevel[2 * i + 1].begin(), vLevel[2 * i + 1].end());
+            vLevel.resize(vLevel.size() / 2);
+        }
+        assert(!vLevel[0].IsNull());
+    }
+}
+
+static void SHA256D64Batch(benchmark::State& state)
+{
+    std::vector<unsigned char> vIn(64 * NUM_INPUTS, 0x5a), vOut(32 * NUM_INPUTS);
+
+    while (state.KeepRunning())
+        SHA256D64(&vOut[0], &vIn[0], NUM_INPUTS);
+}
+
+static void SHA256D64Scalar(benchmark::State& state)
+{
+    std::vector<unsigned char> vIn(64 * NUM_INPUTS, 0x5a), vOut(32 * NUM_INPUTS);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < NUM_INPUTS; i++)
+            CHash256().Write(&vIn[64 * i], 64).Finalize(&vOut[32 * i]);
+    }
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleRootScalar);
+BENCHMARK(SHA256D64Batch);
+BENCHMARK(SHA256D64Scalar);
@@ -0,0 +1,71 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "darksend.h"
+#include "random.h"
+#include "wallet/wallet.h"
+
+#include <boost/foreach.hpp>
+
+// Synthetic mixing wallet: NUM_SOURCES denominated outputs with no wallet
+// ancestry, followed by NUM_MIXING_TXES transactions each spending
+// NUM_MIX_INPUTS random unspent denominated outputs into as many new ones.
+static const int NUM_SOURCES = 1000;
+static const int NUM_MIXING_TXES = 100000;
+static const int NUM_MIX_INPUTS = 3;
+
+static void PrivateSendRounds(benchmark::State& state)
+{
+    darkSendPool.InitDenominations();
+    seed_insecure_rand(true);
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<COutPoint> vecUnspent;
+    std::vector<COutPoint> vecOutpoints;
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i; // make txids unique
+        tx.vout.push_back(CTxOut(vecPrivateSendDenominations[i % vecPrivateSendDenominations.size()], scriptPubKey));
+        CWalletTx wtx(&wallet, tx);
+        wallet.AddToWallet(wtx, true, NULL);
+        vecUnspent.push_back(COutPoint(wtx.GetHash(), 0));
+    }
+
+    for (int i = 0; i < NUM_MIXING_TXES; i++) {
+        CMutableTransaction tx;
+        CAmount nDenom = vecPrivateSendDenominations[i % vecPrivateSendDenominations.size()];
+        std::vector<size_t> vecSpent;
+        for (int j = 0; j < NUM_MIX_INPUTS; j++) {
+            size_t nIndex = insecure_rand() % vecUnspent.size();
+            tx.vin.push_back(CTxIn(vecUnspent[nIndex]));
+            vecSpent.push_back(nIndex);
+            tx.vout.push_back(CTxOut(nDenom, scriptPubKey));
+        }
+        CWalletTx wtx(&wallet, tx);
+        wallet.AddToWallet(wtx, true, NULL);
+        for (int j = 0; j < NUM_MIX_INPUTS; j++) {
+            vecUnspent[vecSpent[j]] = COutPoint(wtx.GetHash(), j);
+            vecOutpoints.push_back(COutPoint(wtx.GetHash(), j));
+        }
+    }
+
+    while (state.KeepRunning()) {
+        // drop everything memoized during the previous round
+        wallet.MarkDirty();
+        int nTotalRounds = 0;
+        BOOST_FOREACH(const COutPoint& outpoint, vecOutpoints)
+            nTotalRounds += wallet.GetRealOutpointPrivateSendRounds(outpoint);
+        assert(nTotalRounds > 0);
+    }
+}
+
+BENCHMARK(PrivateSendRounds);
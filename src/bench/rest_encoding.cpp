@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "base58.h"
+#include "random.h"
+#include "restformat.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "utilstrencodings.h"
+#include "version.h"
+
+#include <univalue.h>
+
+#include <boost/foreach.hpp>
+
+// Encoding and decoding the unspent outputs of one address, as
+// getaddressutxos (JSON) and /rest/address/utxos (binary) return them
+static const int NUM_UTXOS = 100000;
+
+static std::vector<CRESTAddressUtxo> MakeUtxos(CKeyID& keyID)
+{
+    seed_insecure_rand(true);
+    uint256 hash = GetRandHash();
+    keyID = CKeyID(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20)));
+    CScript script = GetScriptForDestination(keyID);
+
+    std::vector<CRESTAddressUtxo> vUtxos(NUM_UTXOS);
+    BOOST_FOREACH(CRESTAddressUtxo& utxo, vUtxos) {
+        utxo.txid = GetRandHash();
+        utxo.nIndex = insecure_rand() % 4;
+        utxo.nHeight = insecure_rand() % 1000000;
+        utxo.nValue = insecure_rand();
+        utxo.script = script;
+    }
+    return vUtxos;
+}
+
+static void AddressUtxosJSON(benchmark::State& state)
+{
+    CKeyID keyID;
+    std::vector<CRESTAddressUtxo> vUtxos = MakeUtxos(keyID);
+
+    while (state.KeepRunning()) {
+        UniValue result(UniValue::VARR);
+        BOOST_FOREACH(const CRESTAddressUtxo& utxo, vUtxos) {
+            UniValue output(UniValue::VOBJ);
+            output.push_back(Pair("address", CBitcoinAddress(keyID).ToString()));
+            output.push_back(Pair("txid", utxo.txid.GetHex()));
+            output.push_back(Pair("outputIndex", (int)utxo.nIndex));
+            output.push_back(Pair("script", HexStr(utxo.script.begin(), utxo.script.end())));
+            output.push_back(Pair("satoshis", utxo.nValue));
+            output.push_back(Pair("height", utxo.nHeight));
+            result.push_back(output);
+        }
+        std::string strJSON = result.write();
+
+        UniValue parsed;
+        parsed.read(strJSON);
+        std::vector<CRESTAddressUtxo> vDecoded(parsed.size());
+        for (size_t i = 0; i < parsed.size(); i++) {
+            const UniValue& output = parsed[i];
+            vDecoded[i].txid = uint256S(output["txid"].get_str());
+            vDecoded[i].nIndex = output["outputIndex"].get_int();
+            std::vector<unsigned char> vchScript = ParseHex(output["script"].get_str());
+            vDecoded[i].script = CScript(vchScript.begin(), vchScript.end());
+            vDecoded[i].nValue = output["satoshis"].get_int64();
+            vDecoded[i].nHeight = output["height"].get_int();
+        }
+        assert(vDecoded.size() == vUtxos.size());
+    }
+}
+
+static void AddressUtxosBinary(benchmark::State& state)
+{
+    CKeyID keyID;
+    std::vector<CRESTAddressUtxo> vUtxos = MakeUtxos(keyID);
+
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << vUtxos;
+        std::string strBinary = ss.str();
+
+        CDataStream ssDecode(strBinary.data(), strBinary.data() + strBinary.size(), SER_NETWORK, PROTOCOL_VERSION);
+        std::vector<CRESTAddressUtxo> vDecoded;
+        ssDecode >> vDecoded;
+        assert(vDecoded.size() == vUtxos.size());
+    }
+}
+
+BENCHMARK(AddressUtxosJSON);
+BENCHMARK(AddressUtxosBinary);
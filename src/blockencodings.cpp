@@ -0,0 +1,159 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/unordered_map.hpp>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
+        nNonce(GetRand(std::numeric_limits<uint64_t>::max())),
+        vShortTxIDs(block.vtx.size() - 1), vPrefilledTxn(1), header(block)
+{
+    FillShortTxIDSelector();
+    // The coinbase is never in the mempool, so always send it along
+    vPrefilledTxn[0].nIndex = 0;
+    vPrefilledTxn[0].tx = block.vtx[0];
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        vShortTxIDs[i - 1] = GetShortID(block.vtx[i].GetHash());
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nNonce;
+    uint256 hashSelector;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hashSelector.begin());
+    nShortTxIDKey0 = ReadLE64(hashSelector.begin());
+    nShortTxIDKey1 = ReadLE64(hashSelector.begin() + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(nShortTxIDKey0, nShortTxIDKey1, txhash) & 0xffffffffffffULL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool, const std::vector<CTransaction>& vExtraTxn)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.vShortTxIDs.empty() && cmpctblock.vPrefilledTxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE / ::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION))
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && vTxn.empty());
+    header = cmpctblock.header;
+    vTxn.resize(cmpctblock.BlockTxCount());
+    vTxAvailable.resize(cmpctblock.BlockTxCount());
+
+    int32_t nLastPrefilledIndex = -1;
+    for (size_t i = 0; i < cmpctblock.vPrefilledTxn.size(); i++) {
+        const PrefilledTransaction& prefilled = cmpctblock.vPrefilledTxn[i];
+        if (prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        nLastPrefilledIndex += prefilled.nIndex + 1;
+        if (nLastPrefilledIndex > std::numeric_limits<uint16_t>::max())
+            return READ_STATUS_INVALID;
+        // Every transaction needs either a prefilled entry or a short ID
+        if ((uint32_t)nLastPrefilledIndex > cmpctblock.vShortTxIDs.size() + i)
+            return READ_STATUS_INVALID;
+        vTxn[nLastPrefilledIndex] = prefilled.tx;
+        vTxAvailable[nLastPrefilledIndex] = true;
+    }
+    nPrefilled = cmpctblock.vPrefilledTxn.size();
+
+    // Short IDs of an honest peer are uniformly distributed, so a crowded bucket is treated as a
+    // failure rather than letting a peer make the lookups below quadratic.
+    boost::unordered_map<uint64_t, uint16_t> mapShortTxIDs(cmpctblock.vShortTxIDs.size());
+    uint16_t nIndexOffset = 0;
+    for (size_t i = 0; i < cmpctblock.vShortTxIDs.size(); i++) {
+        while (vTxAvailable[i + nIndexOffset])
+            nIndexOffset++;
+        mapShortTxIDs[cmpctblock.vShortTxIDs[i]] = i + nIndexOffset;
+        if (mapShortTxIDs.bucket_size(mapShortTxIDs.bucket(cmpctblock.vShortTxIDs[i])) > 12)
+            return READ_STATUS_FAILED;
+    }
+    if (mapShortTxIDs.size() != cmpctblock.vShortTxIDs.size())
+        return READ_STATUS_FAILED; // Short ID collision within the block
+
+    // Two candidates matching the same short ID leave the slot empty, so it is requested
+    std::vector<bool> vMatched(vTxn.size());
+    {
+        LOCK(pool.cs);
+        for (CTxMemPool::indexed_transaction_set::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+            boost::unordered_map<uint64_t, uint16_t>::const_iterator itID = mapShortTxIDs.find(cmpctblock.GetShortID(it->GetTx().GetHash()));
+            if (itID == mapShortTxIDs.end())
+                continue;
+            if (!vMatched[itID->second]) {
+                vTxn[itID->second] = it->GetTx();
+                vTxAvailable[itID->second] = true;
+                vMatched[itID->second] = true;
+                nMempool++;
+            } else if (vTxAvailable[itID->second]) {
+                vTxAvailable[itID->second] = false;
+                nMempool--;
+            }
+            if (nMempool == mapShortTxIDs.size())
+                break;
+        }
+    }
+    for (size_t i = 0; i < vExtraTxn.size() && nMempool + nExtra < mapShortTxIDs.size(); i++) {
+        boost::unordered_map<uint64_t, uint16_t>::const_iterator itID = mapShortTxIDs.find(cmpctblock.GetShortID(vExtraTxn[i].GetHash()));
+        if (itID == mapShortTxIDs.end() || vMatched[itID->second])
+            continue;
+        vTxn[itID->second] = vExtraTxn[i];
+        vTxAvailable[itID->second] = true;
+        vMatched[itID->second] = true;
+        nExtra++;
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), ::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t nIndex) const
+{
+    assert(!header.IsNull());
+    assert(nIndex < vTxAvailable.size());
+    return vTxAvailable[nIndex];
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vMissingTxn) const
+{
+    assert(!header.IsNull());
+    block = header;
+    block.vtx.resize(vTxn.size());
+
+    size_t nMissing = 0;
+    for (size_t i = 0; i < vTxn.size(); i++) {
+        if (vTxAvailable[i]) {
+            block.vtx[i] = vTxn[i];
+        } else {
+            if (vMissingTxn.size() <= nMissing)
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vMissingTxn[nMissing++];
+        }
+    }
+    if (vMissingTxn.size() != nMissing)
+        return READ_STATUS_INVALID;
+
+    // A mismatching merkle root most likely means a short ID matched the wrong transaction,
+    // which says nothing about the peer; the caller falls back to fetching the full block.
+    bool fMutated;
+    if (BlockMerkleRoot(block, &fMutated) != block.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool, %lu txn from InstantSend lock requests and %lu txn requested\n", block.GetHash().ToString(), nPrefilled, nMempool, nExtra, vMissingTxn.size());
+
+    return READ_STATUS_OK;
+}
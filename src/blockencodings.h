@@ -0,0 +1,199 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+class CTxMemPool;
+
+/** A getblocktxn message: the indexes of the transactions of a compact block the sender is missing */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> vIndexes;
+
+    // Reading and writing differ, so this cannot use ADD_SERIALIZE_METHODS
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        s << blockhash;
+        // Indexes are sent as differences to the previous index plus one
+        WriteCompactSize(s, vIndexes.size());
+        for (size_t i = 0; i < vIndexes.size(); i++)
+            WriteCompactSize(s, vIndexes[i] - (i == 0 ? 0 : vIndexes[i - 1] + 1));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        s >> blockhash;
+        uint64_t nCount = ReadCompactSize(s);
+        vIndexes.clear();
+        uint64_t nOffset = 0;
+        while (vIndexes.size() < nCount) {
+            uint64_t nIndex = ReadCompactSize(s) + nOffset;
+            if (nIndex > std::numeric_limits<uint16_t>::max())
+                throw std::ios_base::failure("getblocktxn index overflowed 16 bits");
+            vIndexes.push_back(nIndex);
+            nOffset = nIndex + 1;
+        }
+    }
+};
+
+/** A blocktxn message: the transactions asked for by a getblocktxn message, in the same order */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> vtx;
+
+    BlockTransactions() {}
+    BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), vtx(req.vIndexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        READWRITE(vtx);
+    }
+};
+
+/** A transaction sent in full with a compact block. nIndex is the difference to the previous one's index plus one. */
+struct PrefilledTransaction
+{
+    uint16_t nIndex;
+    CTransaction tx;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        WriteCompactSize(s, nIndex);
+        s << tx;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        uint64_t nIndex64 = ReadCompactSize(s);
+        if (nIndex64 > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("prefilled transaction index overflowed 16 bits");
+        nIndex = nIndex64;
+        s >> tx;
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //!< Invalid object, peer is sending bogus data
+    READ_STATUS_FAILED,  //!< Failed to process object, e.g. a short ID collision
+};
+
+/**
+ * A cmpctblock message: a block header with the coinbase and 6 byte short IDs of the other
+ * transactions, salted per message so collisions cannot be arranged in advance (BIP152).
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t nShortTxIDKey0, nShortTxIDKey1;
+    uint64_t nNonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+
+protected:
+    std::vector<uint64_t> vShortTxIDs;
+    std::vector<PrefilledTransaction> vPrefilledTxn;
+
+public:
+    CBlockHeader header;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return vShortTxIDs.size() + vPrefilledTxn.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        s << header << nNonce;
+        WriteCompactSize(s, vShortTxIDs.size());
+        for (size_t i = 0; i < vShortTxIDs.size(); i++) {
+            uint32_t nLsb = vShortTxIDs[i] & 0xffffffff;
+            uint16_t nMsb = (vShortTxIDs[i] >> 32) & 0xffff;
+            s << nLsb << nMsb;
+        }
+        s << vPrefilledTxn;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        s >> header >> nNonce;
+        uint64_t nCount = ReadCompactSize(s);
+        vShortTxIDs.clear();
+        while (vShortTxIDs.size() < nCount) {
+            uint32_t nLsb = 0;
+            uint16_t nMsb = 0;
+            s >> nLsb >> nMsb;
+            vShortTxIDs.push_back((uint64_t(nMsb) << 32) | uint64_t(nLsb));
+        }
+        s >> vPrefilledTxn;
+        FillShortTxIDSelector();
+    }
+};
+
+/**
+ * A block being reconstructed from a compact block. InitData() fills in the prefilled transactions
+ * and those found in the mempool or among extra candidates (e.g. InstantSend lock requests),
+ * FillBlock() completes it with the transactions the peer sent in response to getblocktxn.
+ */
+class PartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> vTxn;
+    std::vector<bool> vTxAvailable;
+    CBlockHeader header;
+
+public:
+    size_t nPrefilled, nMempool, nExtra;
+
+    PartiallyDownloadedBlock() : nPrefilled(0), nMempool(0), nExtra(0) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool, const std::vector<CTransaction>& vExtraTxn);
+    bool IsTxAvailable(size_t nIndex) const;
+    size_t GetTxCount() const { return vTxn.size(); }
+    /** Build the block, READ_STATUS_FAILED means its merkle root did not match and it should be fetched in full */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vMissingTxn) const;
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
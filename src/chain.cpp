@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "memusage.h"
+
+#include <new>
 
 using namespace std;
 
@@ -111,3 +114,103 @@ void CBlockIndex::BuildSkip()
     if (pprev)
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
+
+/**
+ * CBlockIndexArena implementation
+ */
+CBlockIndex* CBlockIndexArena::Create(const CBlockIndex& indexIn) {
+    if (nSize % CHUNK_SIZE == 0)
+        vChunks.push_back(static_cast<CBlockIndex*>(::operator new(sizeof(CBlockIndex) * CHUNK_SIZE)));
+    CBlockIndex* pindex = new (vChunks.back() + nSize % CHUNK_SIZE) CBlockIndex(indexIn);
+    nSize++;
+    return pindex;
+}
+
+void CBlockIndexArena::Clear() {
+    for (size_t i = 0; i < nSize; i++)
+        vChunks[i / CHUNK_SIZE][i % CHUNK_SIZE].~CBlockIndex();
+    for (size_t i = 0; i < vChunks.size(); i++)
+        ::operator delete(vChunks[i]);
+    vChunks.clear();
+    nSize = 0;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const {
+    return vChunks.size() * memusage::MallocUsage(sizeof(CBlockIndex) * CHUNK_SIZE) + memusage::DynamicUsage(vChunks);
+}
+
+/**
+ * CBlockIndexMap implementation
+ */
+static const uint64_t BLOCK_MAP_TAG_MASK = 0xffffffff00000000ULL;
+static const size_t BLOCK_MAP_MIN_SLOTS = 64;
+
+size_t CBlockIndexMap::Find(const uint256& hash) const {
+    if (vSlots.empty())
+        return nSize;
+    uint64_t nHash = hash.GetCheapHash();
+    for (size_t i = nHash & nMask; vSlots[i] != 0; i = (i + 1) & nMask) {
+        if ((vSlots[i] & BLOCK_MAP_TAG_MASK) == (nHash & BLOCK_MAP_TAG_MASK)) {
+            size_t nPos = (vSlots[i] & ~BLOCK_MAP_TAG_MASK) - 1;
+            if (Entry(nPos).first == hash)
+                return nPos;
+        }
+    }
+    return nSize;
+}
+
+void CBlockIndexMap::Rehash(size_t nSlots) {
+    vSlots.assign(nSlots, 0);
+    nMask = nSlots - 1;
+    for (size_t nPos = 0; nPos < nSize; nPos++) {
+        uint64_t nHash = Entry(nPos).first.GetCheapHash();
+        size_t i = nHash & nMask;
+        while (vSlots[i] != 0)
+            i = (i + 1) & nMask;
+        vSlots[i] = (nHash & BLOCK_MAP_TAG_MASK) | (nPos + 1);
+    }
+}
+
+std::pair<CBlockIndexMap::iterator, bool> CBlockIndexMap::insert(const value_type& value) {
+    size_t nPos = Find(value.first);
+    if (nPos != nSize)
+        return std::make_pair(iterator(this, nPos), false);
+
+    // Keep the table at most half full, so probe sequences stay short
+    if ((nSize + 1) * 2 > vSlots.size())
+        Rehash(std::max(BLOCK_MAP_MIN_SLOTS, vSlots.size() * 2));
+    if (nSize % CHUNK_SIZE == 0)
+        vChunks.push_back(static_cast<value_type*>(::operator new(sizeof(value_type) * CHUNK_SIZE)));
+    new (&Entry(nSize)) value_type(value);
+
+    uint64_t nHash = value.first.GetCheapHash();
+    size_t i = nHash & nMask;
+    while (vSlots[i] != 0)
+        i = (i + 1) & nMask;
+    vSlots[i] = (nHash & BLOCK_MAP_TAG_MASK) | (nSize + 1);
+    return std::make_pair(iterator(this, nSize++), true);
+}
+
+void CBlockIndexMap::reserve(size_t nEntries) {
+    size_t nSlots = BLOCK_MAP_MIN_SLOTS;
+    while (nSlots < nEntries * 2)
+        nSlots *= 2;
+    if (nSlots > vSlots.size())
+        Rehash(nSlots);
+    vChunks.reserve((nEntries + CHUNK_SIZE - 1) / CHUNK_SIZE);
+}
+
+void CBlockIndexMap::clear() {
+    for (size_t nPos = 0; nPos < nSize; nPos++)
+        Entry(nPos).~value_type();
+    for (size_t i = 0; i < vChunks.size(); i++)
+        ::operator delete(vChunks[i]);
+    vChunks.clear();
+    std::vector<uint64_t>().swap(vSlots);
+    nSize = 0;
+    nMask = 0;
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const {
+    return vChunks.size() * memusage::MallocUsage(sizeof(value_type) * CHUNK_SIZE) + memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vSlots);
+}
@@ -12,6 +12,8 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <iterator>
+#include <utility>
 #include <vector>
 
 struct CDiskBlockPos
@@ -100,7 +102,10 @@ enum BlockStatus {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    // The fields walking the block tree reads (GetAncestor, LastCommonAncestor, chain work
+    // comparisons) come first and take 64 bytes, so they share a cache line or two.
+
+    //! pointer to the hash of the block, if any. Memory is owned by mapBlockIndex
     const uint256* phashBlock;
 
     //! pointer to the index of the predecessor of this block
@@ -112,6 +117,12 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -121,9 +132,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -133,9 +141,6 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
-
     //! block header
     int nVersion;
     uint256 hashMerkleRoot;
@@ -351,6 +356,125 @@ public:
     }
 };
 
+/**
+ * Storage for the CBlockIndex entries of the block tree, in chunks of many entries instead of
+ * an allocation each. Entries keep their address until Clear() releases them all at once.
+ */
+class CBlockIndexArena
+{
+public:
+    static const size_t CHUNK_SIZE = 4096;
+
+private:
+    std::vector<CBlockIndex*> vChunks;
+    size_t nSize;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nSize(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    //! Create an entry initialized to indexIn
+    CBlockIndex* Create(const CBlockIndex& indexIn = CBlockIndex());
+
+    //! Destroy all entries
+    void Clear();
+
+    size_t size() const { return nSize; }
+    size_t DynamicMemoryUsage() const;
+};
+
+/**
+ * Map from block hash to block index entry, with open addressing. The entries are stored in
+ * insertion order in chunks, so their keys (which CBlockIndex::phashBlock points to) keep their
+ * address, and the table of slots only holds a position and part of the hash per entry, which
+ * keeps lookups within one or two cache lines. Entries can not be erased.
+ *
+ * The interface follows the std::map subset the block index uses. Iteration is in insertion
+ * order; as with unordered maps, inserting may invalidate iterators (but not references).
+ */
+class CBlockIndexMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+
+    template <typename Value>
+    class iterator_base : public std::iterator<std::forward_iterator_tag, Value>
+    {
+    private:
+        const CBlockIndexMap* pmap;
+        size_t nPos;
+
+        friend class CBlockIndexMap;
+        template <typename OtherValue> friend class iterator_base;
+
+        iterator_base(const CBlockIndexMap* pmapIn, size_t nPosIn) : pmap(pmapIn), nPos(nPosIn) {}
+
+    public:
+        iterator_base() : pmap(NULL), nPos(0) {}
+        template <typename OtherValue>
+        iterator_base(const iterator_base<OtherValue>& other) : pmap(other.pmap), nPos(other.nPos) {}
+
+        Value& operator*() const { return pmap->Entry(nPos); }
+        Value* operator->() const { return &pmap->Entry(nPos); }
+        iterator_base& operator++() { nPos++; return *this; }
+        iterator_base operator++(int) { iterator_base ret = *this; nPos++; return ret; }
+        template <typename OtherValue>
+        bool operator==(const iterator_base<OtherValue>& other) const { return nPos == other.nPos; }
+        template <typename OtherValue>
+        bool operator!=(const iterator_base<OtherValue>& other) const { return nPos != other.nPos; }
+    };
+    typedef iterator_base<value_type> iterator;
+    typedef iterator_base<const value_type> const_iterator;
+
+    static const size_t CHUNK_SIZE = 4096;
+
+private:
+    //! Entries, CHUNK_SIZE per chunk
+    std::vector<value_type*> vChunks;
+    size_t nSize;
+    //! Slots of the table, 0 if empty, else the upper 32 bits of the hash and the position of the entry plus one
+    std::vector<uint64_t> vSlots;
+    size_t nMask;
+
+    CBlockIndexMap(const CBlockIndexMap&);
+    CBlockIndexMap& operator=(const CBlockIndexMap&);
+
+    value_type& Entry(size_t nPos) const { return vChunks[nPos / CHUNK_SIZE][nPos % CHUNK_SIZE]; }
+    //! Position of the entry of hash, or nSize if there is none
+    size_t Find(const uint256& hash) const;
+    void Rehash(size_t nSlots);
+
+public:
+    CBlockIndexMap() : nSize(0), nMask(0) {}
+    ~CBlockIndexMap() { clear(); }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, nSize); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, nSize); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const uint256& hash) { return iterator(this, Find(hash)); }
+    const_iterator find(const uint256& hash) const { return const_iterator(this, Find(hash)); }
+    size_t count(const uint256& hash) const { return Find(hash) != nSize ? 1 : 0; }
+
+    std::pair<iterator, bool> insert(const value_type& value);
+    CBlockIndex*& operator[](const uint256& hash) { return insert(value_type(hash, NULL)).first->second; }
+
+    //! Make room for nEntries without growing the table
+    void reserve(size_t nEntries);
+    void clear();
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,16 @@ public:
     CSHA256& Reset();
 };
 
+/** Select the fastest SHA256 implementation this CPU supports (SHA extensions,
+ *  AVX2 or SSE4.1) and return its name. Must be called before any other threads
+ *  are started, until then the portable implementation is used.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute the double SHA256 of blocks consecutive 64 byte inputs (e.g. pairs of
+ *  hashes in a merkle tree) into blocks * 32 bytes at out. Several inputs are
+ *  hashed at once where the CPU allows it. out may be the same as in.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,141 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 8-way double SHA256 of 64 byte inputs using AVX2, for the levels of the
+// merkle tree (see SHA256D64). Compiled for any x86 target, the functions carry
+// their own target attribute and are only called after runtime detection.
+
+#if (defined(__x86_64__) || defined(__amd64__) || defined(__i386__)) && defined(__GNUC__)
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256_avx2
+{
+namespace
+{
+#define SHA256_AVX2 __attribute__((target("avx2")))
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+typedef __m256i vec;
+
+SHA256_AVX2 inline vec K(uint32_t x) { return _mm256_set1_epi32(x); }
+SHA256_AVX2 inline vec Add(vec x, vec y) { return _mm256_add_epi32(x, y); }
+SHA256_AVX2 inline vec Xor(vec x, vec y) { return _mm256_xor_si256(x, y); }
+SHA256_AVX2 inline vec Or(vec x, vec y) { return _mm256_or_si256(x, y); }
+SHA256_AVX2 inline vec And(vec x, vec y) { return _mm256_and_si256(x, y); }
+SHA256_AVX2 inline vec Rot(vec x, int n) { return Or(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+SHA256_AVX2 inline vec Shr(vec x, int n) { return _mm256_srli_epi32(x, n); }
+
+SHA256_AVX2 inline vec Ch(vec x, vec y, vec z) { return Xor(z, And(x, Xor(y, z))); }
+SHA256_AVX2 inline vec Maj(vec x, vec y, vec z) { return Or(And(x, y), And(z, Or(x, y))); }
+SHA256_AVX2 inline vec Sigma0(vec x) { return Xor(Xor(Rot(x, 2), Rot(x, 13)), Rot(x, 22)); }
+SHA256_AVX2 inline vec Sigma1(vec x) { return Xor(Xor(Rot(x, 6), Rot(x, 11)), Rot(x, 25)); }
+SHA256_AVX2 inline vec sigma0(vec x) { return Xor(Xor(Rot(x, 7), Rot(x, 18)), Shr(x, 3)); }
+SHA256_AVX2 inline vec sigma1(vec x) { return Xor(Xor(Rot(x, 17), Rot(x, 19)), Shr(x, 10)); }
+
+SHA256_AVX2 inline void Initialize(vec* s)
+{
+    s[0] = K(0x6a09e667ul);
+    s[1] = K(0xbb67ae85ul);
+    s[2] = K(0x3c6ef372ul);
+    s[3] = K(0xa54ff53aul);
+    s[4] = K(0x510e527ful);
+    s[5] = K(0x9b05688cul);
+    s[6] = K(0x1f83d9abul);
+    s[7] = K(0x5be0cd19ul);
+}
+
+/** One SHA-256 transformation of 8 chunks at once, w holds their message words. */
+SHA256_AVX2 void Transform(vec* s, vec* w)
+{
+    vec a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16)
+            w[i & 15] = Add(Add(w[i & 15], sigma0(w[(i + 1) & 15])), Add(w[(i + 9) & 15], sigma1(w[(i + 14) & 15])));
+        vec t1 = Add(Add(Add(h, Sigma1(e)), Add(Ch(e, f, g), K(K256[i]))), w[i & 15]);
+        vec t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** The big endian word at offset of each of the 8 consecutive 64 byte inputs. */
+SHA256_AVX2 inline vec Read(const unsigned char* in, int offset)
+{
+    vec ret = _mm256_setr_epi32(
+        ReadLE32(in + 0 + offset), ReadLE32(in + 64 + offset), ReadLE32(in + 128 + offset), ReadLE32(in + 192 + offset),
+        ReadLE32(in + 256 + offset), ReadLE32(in + 320 + offset), ReadLE32(in + 384 + offset), ReadLE32(in + 448 + offset));
+    return _mm256_shuffle_epi8(ret, _mm256_set_epi32(0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul, 0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul));
+}
+
+SHA256_AVX2 inline void Write(unsigned char* out, int offset, vec v)
+{
+    uint32_t words[8];
+    _mm256_storeu_si256((vec*)words, v);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 32 * i + offset, words[i]);
+}
+
+} // namespace
+
+SHA256_AVX2 void TransformD64_8way(unsigned char* out, const unsigned char* in)
+{
+    vec s[8], w[16];
+
+    // The 64 byte inputs
+    Initialize(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read(in, 4 * i);
+    Transform(s, w);
+
+    // Their padding
+    w[0] = K(0x80000000ul);
+    for (int i = 1; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(0x200);
+    Transform(s, w);
+
+    // The second SHA256 over the 32 byte hashes
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(0x100);
+    Initialize(s);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+        Write(out, 4 * i, s[i]);
+}
+
+} // namespace sha256_avx2
+
+#endif
@@ -259,11 +259,51 @@ public:
         return new CDBIterator(pdb->NewIterator(iteroptions), &obfuscate_key);
     }
 
+    /**
+     * Take a consistent view of the database, which later writes do not change, for reads
+     * that take long. Must be released with ReleaseSnapshot().
+     */
+    const leveldb::Snapshot* GetSnapshot() const
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot) const
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
+    /**
+     * Iterate over the database as it was when snapshot was taken.
+     */
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot) const
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(pdb->NewIterator(options), &obfuscate_key);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
 
+    /**
+     * Compact the range of keys from key_begin to key_end, to reclaim the space of erased entries.
+     */
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKeyBegin(SER_DISK, CLIENT_VERSION), ssKeyEnd(SER_DISK, CLIENT_VERSION);
+        ssKeyBegin.reserve(ssKeyBegin.GetSerializeSize(key_begin));
+        ssKeyEnd.reserve(ssKeyEnd.GetSerializeSize(key_end));
+        ssKeyBegin << key_begin;
+        ssKeyEnd << key_end;
+        leveldb::Slice slKeyBegin(&ssKeyBegin[0], ssKeyBegin.size());
+        leveldb::Slice slKeyEnd(&ssKeyEnd[0], ssKeyEnd.size());
+        pdb->CompactRange(&slKeyBegin, &slKeyEnd);
+    }
+
     /**
      * Accessor for obfuscate_key.
      */
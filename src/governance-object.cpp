@@ -662,7 +662,7 @@ bool CGovernanceObject::GetCurrentMNVotes(const CTxIn& mnCollateralOutpoint, vot
 void CGovernanceObject::Relay()
 {
     CInv inv(MSG_GOVERNANCE_OBJECT, GetHash());
-    RelayInv(inv, PROTOCOL_VERSION);
+    RelayInv(inv, CPreparedMessage::Make(NetMsgType::MNGOVERNANCEOBJECT, *this), PROTOCOL_VERSION);
 }
 
 void CGovernanceObject::UpdateSentinelVariables()
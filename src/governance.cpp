@@ -12,6 +12,7 @@
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "netfulfilledman.h"
+#include "perfstats.h"
 #include "util.h"
 
 CGovernanceManager governance;
@@ -267,13 +268,16 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
             return;
         }
 
+        CPerfTimer timer(perfGovernanceVote);
         CGovernanceException exception;
         if(ProcessVote(pfrom, vote, exception)) {
+            perfGovernanceVotesAccepted.Increment();
             LogPrint("gobject", "MNGOVERNANCEOBJECTVOTE -- %s new\n", strHash);
             masternodeSync.AddedGovernanceItem();
             vote.Relay();
         }
         else {
+            perfGovernanceVotesRejected.Increment();
             LogPrint("gobject", "MNGOVERNANCEOBJECTVOTE -- Rejected vote, error = %s\n", exception.what());
             if((exception.GetNodePenalty() != 0) && masternodeSync.IsSynced()) {
                 Misbehaving(pfrom->GetId(), exception.GetNodePenalty());
@@ -20,6 +20,9 @@
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** Requests with larger bodies are never considered cheap, so the event thread doesn't parse them */
+static const size_t MAX_CHEAP_RPC_BODY = 4096;
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wellet.
  */
@@ -140,6 +143,36 @@ static bool RPCAuthorized(const std::string& strAuth)
     return multiUserAuthorized(strUserPass);
 }
 
+/** Execute a single request through the streaming variant of its method,
+ * writing the reply while the result is being produced.
+ * Returns false if there is no streaming variant or it declined the request.
+ */
+static bool JSONStreamReply(HTTPRequest* req, const JSONRequest& jreq)
+{
+    HTTPJSONStreamWriter writer(req, HTTP_OK);
+    writer.BeginObject();
+    writer.Key("result");
+    try {
+        if (!tableRPC.executeStream(jreq.strMethod, jreq.params, writer)) {
+            writer.Discard();
+            return false;
+        }
+    } catch (...) {
+        // Nothing sent yet, leave it to the regular error reply
+        if (!writer.HasFlushed())
+            throw;
+        // Too late to report the error, cut the reply short (see ~HTTPRequest)
+        LogPrintf("%s: %s failed halfway through the reply\n", __func__, jreq.strMethod);
+        return true;
+    }
+    writer.KeyValue("error", NullUniValue);
+    writer.KeyValue("id", jreq.id);
+    writer.EndObject();
+    writer.Raw("\n");
+    writer.Finish();
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -180,6 +213,9 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            if (JSONStreamReply(req, jreq))
+                return true;
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -203,6 +239,24 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Send single calls of cheap commands to their own queue, everything else
+ * (batches, unknown methods, malformed requests) to the regular RPC queue.
+ */
+static HTTPWorkClass HTTPReq_JSONRPC_Class(HTTPRequest* req)
+{
+    std::string strBody;
+    if (!req->PeekBody(strBody, MAX_CHEAP_RPC_BODY))
+        return HTTP_WORK_RPC;
+    UniValue valRequest;
+    if (!valRequest.read(strBody) || !valRequest.isObject())
+        return HTTP_WORK_RPC;
+    const UniValue& valMethod = find_value(valRequest.get_obj(), "method");
+    if (!valMethod.isStr())
+        return HTTP_WORK_RPC;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return (pcmd && pcmd->okCheap) ? HTTP_WORK_RPC_CHEAP : HTTP_WORK_RPC;
+}
+
 static bool InitRPCAuthentication()
 {
     if (mapArgs["-rpcpassword"] == "")
@@ -227,7 +281,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPC_Class);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
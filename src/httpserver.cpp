@@ -11,6 +11,7 @@
 #include "rpcprotocol.h" // For HTTP status codes
 #include "sync.h"
 #include "ui_interface.h"
+#include "utilstrencodings.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +27,7 @@
 #include <event2/buffer.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
+#include <event2/listener.h>
 
 #ifdef EVENT__HAVE_NETINET_IN_H
 #include <netinet/in.h>
@@ -72,10 +74,16 @@ private:
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    /** Queued items with the time they were enqueued */
+    std::deque<std::pair<WorkItem*, int64_t> > queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    size_t peakDepth;
+    uint64_t numProcessed;
+    uint64_t numRejected;
+    int64_t waitTotal;
+    int64_t waitMax;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -98,7 +106,12 @@ private:
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 peakDepth(0),
+                                 numProcessed(0),
+                                 numRejected(0),
+                                 waitTotal(0),
+                                 waitMax(0)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -107,7 +120,7 @@ public:
     ~WorkQueue()
     {
         while (!queue.empty()) {
-            delete queue.front();
+            delete queue.front().first;
             queue.pop_front();
         }
     }
@@ -116,9 +129,11 @@ public:
     {
         boost::unique_lock<boost::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            numRejected++;
             return false;
         }
-        queue.push_back(item);
+        queue.push_back(std::make_pair(item, GetTimeMicros()));
+        peakDepth = std::max(peakDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -134,8 +149,12 @@ public:
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
+                i = queue.front().first;
+                int64_t wait = GetTimeMicros() - queue.front().second;
                 queue.pop_front();
+                numProcessed++;
+                waitTotal += wait;
+                waitMax = std::max(waitMax, wait);
             }
             (*i)();
             delete i;
@@ -163,34 +182,72 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Fill in the counters of the queue */
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nThreads = numThreads;
+        stats.nMaxDepth = maxDepth;
+        stats.nDepth = queue.size();
+        stats.nPeakDepth = peakDepth;
+        stats.nProcessed = numProcessed;
+        stats.nRejected = numRejected;
+        stats.nWaitTotal = waitTotal;
+        stats.nWaitMax = waitMax;
+    }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPWorkClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPWorkClassifier classifier;
+};
+
+/** libevent event loop with its own HTTP server and listening sockets */
+struct HTTPEventLoop
+{
+    struct event_base* base;
+    struct evhttp* http;
+    //! Bound listening sockets
+    std::vector<evhttp_bound_socket *> boundSockets;
+    boost::thread thread;
+
+    HTTPEventLoop() : base(0), http(0) {}
+};
+
+/** Work queues, in the order of HTTPWorkClass */
+static const struct {
+    HTTPWorkClass workClass;
+    const char* name;
+    const char* threadName;
+    const char* threadsArg;
+    int defaultThreads;
+    const char* depthArg;
+} workQueueParams[] = {
+    {HTTP_WORK_RPC, "rpc", "dash-httpworker", "-rpcthreads", DEFAULT_HTTP_THREADS, "-rpcworkqueue"},
+    {HTTP_WORK_RPC_CHEAP, "rpccheap", "dash-httpcheap", "-rpccheapthreads", DEFAULT_HTTP_CHEAP_THREADS, "-rpccheapworkqueue"},
+    {HTTP_WORK_REST, "rest", "dash-httprest", "-restthreads", DEFAULT_HTTP_REST_THREADS, "-restworkqueue"},
 };
 
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base* eventBase = 0;
-//! HTTP server
-struct evhttp* eventHTTP = 0;
+//! Event loops accepting and serving connections, the first one also runs
+//! the events and timers of submodules (see EventBase())
+static std::vector<HTTPEventLoop*> eventLoops;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queues for handling longer requests off the event loop threads
+static WorkQueue<HTTPClosure>* workQueues[ARRAYLEN(workQueueParams)] = {};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -289,6 +346,8 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkClass workClass = i->classifier ? i->classifier(hreq.get()) : HTTP_WORK_RPC;
+        WorkQueue<HTTPClosure>* workQueue = workQueues[workClass];
         std::auto_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
         if (workQueue->Enqueue(item.get()))
@@ -317,8 +376,38 @@ static void ThreadHTTP(struct event_base* base, struct evhttp* http)
     LogPrint("http", "Exited http event loop\n");
 }
 
+#ifdef LEV_OPT_REUSEABLE_PORT
+/** Like evhttp_bind_socket_with_handle, but with SO_REUSEPORT so that every
+ * event loop can listen on the same address and the kernel spreads incoming
+ * connections over them.
+ */
+static evhttp_bound_socket* HTTPBindReusePort(HTTPEventLoop* loop, const std::string& host, uint16_t port)
+{
+    struct evutil_addrinfo hints, *ai = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = EVUTIL_AI_PASSIVE | EVUTIL_AI_ADDRCONFIG;
+    std::string strPort = strprintf("%d", port);
+    if (evutil_getaddrinfo(host.empty() ? NULL : host.c_str(), strPort.c_str(), &hints, &ai) != 0 || !ai)
+        return NULL;
+
+    struct evconnlistener* listener = evconnlistener_new_bind(loop->base, NULL, NULL,
+        LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_CLOSE_ON_FREE,
+        -1, ai->ai_addr, ai->ai_addrlen);
+    evutil_freeaddrinfo(ai);
+    if (!listener)
+        return NULL;
+
+    evhttp_bound_socket* bind_handle = evhttp_bind_listener(loop->http, listener);
+    if (!bind_handle)
+        evconnlistener_free(listener);
+    return bind_handle;
+}
+#endif
+
 /** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+static bool HTTPBindAddresses(HTTPEventLoop* loop, bool fReusePort)
 {
     int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -346,23 +435,42 @@ static bool HTTPBindAddresses(struct evhttp* http)
     // Bind addresses
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint("http", "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
+        evhttp_bound_socket *bind_handle = NULL;
+#ifdef LEV_OPT_REUSEABLE_PORT
+        if (fReusePort)
+            bind_handle = HTTPBindReusePort(loop, i->first, i->second);
+        else
+#endif
+            bind_handle = evhttp_bind_socket_with_handle(loop->http, i->first.empty() ? NULL : i->first.c_str(), i->second);
         if (bind_handle) {
-            boundSockets.push_back(bind_handle);
+            loop->boundSockets.push_back(bind_handle);
         } else {
             LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
         }
     }
-    return !boundSockets.empty();
+    return !loop->boundSockets.empty();
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue, const char* threadName)
 {
-    RenameThread("dash-httpworker");
+    RenameThread(threadName);
     queue->Run();
 }
 
+/** Free the HTTP servers and event bases of all event loops */
+static void FreeEventLoops()
+{
+    BOOST_FOREACH(HTTPEventLoop* loop, eventLoops) {
+        if (loop->http)
+            evhttp_free(loop->http);
+        if (loop->base)
+            event_base_free(loop->base);
+        delete loop;
+    }
+    eventLoops.clear();
+}
+
 /** libevent event log callback */
 static void libevent_log_cb(int severity, const char *msg)
 {
@@ -378,9 +486,6 @@ static void libevent_log_cb(int severity, const char *msg)
 
 bool InitHTTPServer()
 {
-    struct evhttp* http = 0;
-    struct event_base* base = 0;
-
     if (!InitHTTPAllowList())
         return false;
 
@@ -407,85 +512,105 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base) {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
+    int nEventThreads = std::max((int)GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1);
+#ifndef LEV_OPT_REUSEABLE_PORT
+    if (nEventThreads > 1) {
+        LogPrintf("HTTP: libevent has no SO_REUSEPORT support, using a single event thread\n");
+        nEventThreads = 1;
     }
+#endif
 
-    /* Create a new evhttp object to handle requests. */
-    http = evhttp_new(base); // XXX RAII
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        event_base_free(base);
-        return false;
-    }
+    for (int i = 0; i < nEventThreads; i++) {
+        HTTPEventLoop* loop = new HTTPEventLoop();
+        eventLoops.push_back(loop);
+
+        loop->base = event_base_new(); // XXX RAII
+        if (!loop->base) {
+            LogPrintf("Couldn't create an event_base: exiting\n");
+            FreeEventLoops();
+            return false;
+        }
 
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, NULL);
+        /* Create a new evhttp object to handle requests. */
+        loop->http = evhttp_new(loop->base); // XXX RAII
+        if (!loop->http) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            FreeEventLoops();
+            return false;
+        }
 
-    if (!HTTPBindAddresses(http)) {
-        LogPrintf("Unable to bind any endpoint for RPC server\n");
-        evhttp_free(http);
-        event_base_free(base);
-        return false;
+        evhttp_set_timeout(loop->http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(loop->http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(loop->http, MAX_SIZE);
+        evhttp_set_gencb(loop->http, http_request_cb, NULL);
+
+        if (!HTTPBindAddresses(loop, nEventThreads > 1)) {
+            LogPrintf("Unable to bind any endpoint for RPC server\n");
+            FreeEventLoops();
+            return false;
+        }
     }
 
     LogPrint("http", "Initialized HTTP server\n");
-    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
-
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBase = base;
-    eventHTTP = http;
+    for (unsigned int i = 0; i < ARRAYLEN(workQueueParams); i++) {
+        assert(workQueueParams[i].workClass == (HTTPWorkClass)i);
+        int workQueueDepth = std::max((long)GetArg(workQueueParams[i].depthArg, DEFAULT_HTTP_WORKQUEUE), 1L);
+        LogPrintf("HTTP: creating %s work queue of depth %d\n", workQueueParams[i].name, workQueueDepth);
+        workQueues[i] = new WorkQueue<HTTPClosure>(workQueueDepth);
+    }
     return true;
 }
 
-boost::thread threadHTTP;
-
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
-
-    for (int i = 0; i < rpcThreads; i++)
-        boost::thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    LogPrintf("HTTP: starting %d event threads\n", eventLoops.size());
+    BOOST_FOREACH(HTTPEventLoop* loop, eventLoops)
+        loop->thread = boost::thread(boost::bind(&ThreadHTTP, loop->base, loop->http));
+
+    for (unsigned int i = 0; i < ARRAYLEN(workQueueParams); i++) {
+        int threads = std::max((long)GetArg(workQueueParams[i].threadsArg, workQueueParams[i].defaultThreads), 1L);
+        LogPrintf("HTTP: starting %d %s worker threads\n", threads, workQueueParams[i].name);
+        for (int j = 0; j < threads; j++)
+            boost::thread(boost::bind(&HTTPWorkQueueRun, workQueues[i], workQueueParams[i].threadName));
+    }
     return true;
 }
 
 void InterruptHTTPServer()
 {
     LogPrint("http", "Interrupting HTTP server\n");
-    if (eventHTTP) {
+    BOOST_FOREACH(HTTPEventLoop* loop, eventLoops) {
         // Unlisten sockets
-        BOOST_FOREACH (evhttp_bound_socket *socket, boundSockets) {
-            evhttp_del_accept_socket(eventHTTP, socket);
+        BOOST_FOREACH (evhttp_bound_socket *socket, loop->boundSockets) {
+            evhttp_del_accept_socket(loop->http, socket);
         }
+        loop->boundSockets.clear();
         // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+        evhttp_set_gencb(loop->http, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (unsigned int i = 0; i < ARRAYLEN(workQueues); i++)
+        if (workQueues[i])
+            workQueues[i]->Interrupt();
 }
 
 void StopHTTPServer()
 {
     LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue) {
-        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
+    for (unsigned int i = 0; i < ARRAYLEN(workQueues); i++) {
+        if (!workQueues[i])
+            continue;
+        LogPrint("http", "Waiting for HTTP %s worker threads to exit\n", workQueueParams[i].name);
 #ifndef WIN32
         // ToDo: Disabling WaitExit() for Windows platforms is an ugly workaround for the wallet not
-        // closing during a repair-restart. It doesn't hurt, though, because threadHTTP.timed_join
+        // closing during a repair-restart. It doesn't hurt, though, because the event thread join
         // below takes care of this and sends a loopbreak.
-        workQueue->WaitExit();
+        workQueues[i]->WaitExit();
 #endif        
-        delete workQueue;
+        delete workQueues[i];
+        workQueues[i] = 0;
     }
-    if (eventBase) {
+    BOOST_FOREACH(HTTPEventLoop* loop, eventLoops) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
         // Give event loop a few seconds to exit (to send back last RPC responses), then break it
         // Before this was solved with event_base_loopexit, but that didn't work as expected in
@@ -494,30 +619,37 @@ void StopHTTPServer()
         // could be used again (if desirable).
         // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
 #if BOOST_VERSION >= 105000
-        if (!threadHTTP.try_join_for(boost::chrono::milliseconds(2000))) {
+        if (!loop->thread.try_join_for(boost::chrono::milliseconds(2000))) {
 #else
-        if (!threadHTTP.timed_join(boost::posix_time::milliseconds(2000))) {
+        if (!loop->thread.timed_join(boost::posix_time::milliseconds(2000))) {
 #endif
 
             LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBase);
-            threadHTTP.join();
+            event_base_loopbreak(loop->base);
+            loop->thread.join();
         }
     }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
-    }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = 0;
-    }
+    FreeEventLoops();
     LogPrint("http", "Stopped HTTP server\n");
 }
 
 struct event_base* EventBase()
 {
-    return eventBase;
+    return eventLoops.empty() ? 0 : eventLoops[0]->base;
+}
+
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkQueueStats> vStats;
+    for (unsigned int i = 0; i < ARRAYLEN(workQueues); i++) {
+        if (!workQueues[i])
+            continue;
+        HTTPWorkQueueStats stats;
+        stats.name = workQueueParams[i].name;
+        workQueues[i]->GetStats(stats);
+        vStats.push_back(stats);
+    }
+    return vStats;
 }
 
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
@@ -547,12 +679,21 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       base(EventBase()),
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
+    evhttp_connection* con = evhttp_request_get_connection(req);
+    if (con)
+        base = evhttp_connection_get_base(con);
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStarted && !replySent) {
+        // Streaming handler bailed out halfway, terminate what was sent
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -591,6 +732,18 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+bool HTTPRequest::PeekBody(std::string& strBody, size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    size_t size = buf ? evbuffer_get_length(buf) : 0;
+    if (size > nMaxSize)
+        return false;
+    strBody.resize(size);
+    if (size > 0)
+        evbuffer_copyout(buf, &strBody[0], size);
+    return true;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -605,18 +758,84 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStarted && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
-    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+    HTTPEvent* ev = new HTTPEvent(base, true,
         boost::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
     replySent = true;
     req = 0; // transferred back to main thread
 }
 
+static void http_reply_chunk(struct evhttp_request* req, struct evbuffer* evb)
+{
+    evhttp_send_reply_chunk(req, evb);
+    evbuffer_free(evb);
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    HTTPEvent* ev = new HTTPEvent(base, true,
+        boost::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+    ev->trigger(0);
+    replyStarted = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && replyStarted && req);
+    // The request's own output buffer belongs to the main thread once the
+    // reply was started, hand every chunk over in a buffer of its own.
+    // Events are processed in the order they were triggered.
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(base, true,
+        boost::bind(http_reply_chunk, req, evb));
+    ev->trigger(0);
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(!replySent && replyStarted && req);
+    HTTPEvent* ev = new HTTPEvent(base, true,
+        boost::bind(evhttp_send_reply_end, req));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+HTTPJSONStreamWriter::HTTPJSONStreamWriter(HTTPRequest* req, int nStatus) :
+    req(req),
+    nStatus(nStatus)
+{
+}
+
+void HTTPJSONStreamWriter::WriteChunk(const std::string& strChunk)
+{
+    if (!HasFlushed()) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(nStatus);
+    }
+    req->WriteReplyChunk(strChunk);
+}
+
+void HTTPJSONStreamWriter::Finish()
+{
+    if (HasFlushed()) {
+        Flush();
+        req->WriteReplyEnd();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(nStatus, GetBuffer());
+        Discard();
+    }
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -657,10 +876,11 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPWorkClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -5,7 +5,10 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include "jsonwriter.h"
+
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -13,6 +16,9 @@
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_CHEAP_THREADS=1;
+static const int DEFAULT_HTTP_REST_THREADS=2;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
@@ -34,13 +40,25 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Classes of requests. Each class has its own work queue and worker threads,
+ * so a burst of slow requests of one class can't starve the others.
+ */
+enum HTTPWorkClass {
+    HTTP_WORK_RPC,       //!< JSON-RPC calls (-rpcthreads, -rpcworkqueue)
+    HTTP_WORK_RPC_CHEAP, //!< JSON-RPC calls known to return quickly (-rpccheapthreads, -rpccheapworkqueue)
+    HTTP_WORK_REST,      //!< REST requests (-restthreads, -restworkqueue)
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the work class of a request, called on the event thread before dispatching */
+typedef boost::function<HTTPWorkClass(HTTPRequest* req)> HTTPWorkClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier requests go to the HTTP_WORK_RPC queue.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPWorkClassifier &classifier = HTTPWorkClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -49,6 +67,23 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Counters of one work queue */
+struct HTTPWorkQueueStats
+{
+    std::string name;
+    int nThreads;
+    size_t nMaxDepth;
+    size_t nDepth;
+    size_t nPeakDepth;
+    uint64_t nProcessed;
+    uint64_t nRejected;
+    int64_t nWaitTotal; //!< time spent queued by processed requests, in microseconds
+    int64_t nWaitMax;
+};
+
+/** Return the counters of all work queues */
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats();
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -56,7 +91,10 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    //! event loop of the connection, replies must be sent from there
+    struct event_base* base;
     bool replySent;
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -96,6 +134,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy the request body without consuming it.
+     * Returns false if the body is larger than nMaxSize.
+     */
+    bool PeekBody(std::string& strBody, size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -112,6 +156,47 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply.
+     * nStatus is the HTTP status code to send. Headers must be written before.
+     *
+     * @note Use this instead of WriteReply for replies that are produced
+     * piecewise. Follow up with any number of WriteReplyChunk calls and
+     * finish with WriteReplyEnd.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send the next piece of a chunked reply started with WriteReplyStart.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply. Like WriteReply, this gives the request back to
+     * the main thread; do not call any other HTTPRequest methods afterwards.
+     */
+    void WriteReplyEnd();
+};
+
+/** CJSONStreamWriter sending its output as the reply to a HTTP request.
+ * Small documents that fit in a single flush go out as a regular reply,
+ * larger ones switch to a chunked reply on the first flush.
+ */
+class HTTPJSONStreamWriter : public CJSONStreamWriter
+{
+private:
+    HTTPRequest* req;
+    int nStatus;
+
+public:
+    HTTPJSONStreamWriter(HTTPRequest* req, int nStatus);
+
+    /** Send remaining output and complete the reply */
+    void Finish();
+
+protected:
+    void WriteChunk(const std::string& strChunk);
 };
 
 /** Event handler closure.
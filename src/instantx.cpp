@@ -10,6 +10,7 @@
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "net.h"
+#include "perfstats.h"
 #include "protocol.h"
 #include "spork.h"
 #include "sync.h"
@@ -414,6 +415,7 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
         LogPrint("instantsend", "CInstantSend::TryToFinalizeLockCandidate -- Transaction Lock is ready to complete, txid=%s\n", txHash.ToString());
         if(ResolveConflicts(txLockCandidate, Params().GetConsensus().nInstantSendKeepLock)) {
             LockTransactionInputs(txLockCandidate);
+            perfInstantSendLock.Record(GetTimeMicros() - txLockCandidate.nTimeCreatedMicros);
             UpdateLockedTransaction(txLockCandidate);
         }
     }
@@ -680,6 +682,18 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
     return true;
 }
 
+void CInstantSend::GetAcceptedLockRequests(std::vector<CTransaction>& vtxRet)
+{
+    LOCK(cs_instantsend);
+
+    vtxRet.reserve(vtxRet.size() + mapLockRequestAccepted.size());
+    std::map<uint256, CTxLockRequest>::iterator it = mapLockRequestAccepted.begin();
+    while(it != mapLockRequestAccepted.end()) {
+        vtxRet.push_back(it->second);
+        ++it;
+    }
+}
+
 bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet)
 {
     LOCK(cs_instantsend);
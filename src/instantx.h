@@ -86,6 +86,8 @@ public:
     void RejectLockRequest(const CTxLockRequest& txLockRequest);
     bool HasTxLockRequest(const uint256& txHash);
     bool GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLockRequestRet);
+    // all accepted lock requests, candidates for compact block reconstruction
+    void GetAcceptedLockRequests(std::vector<CTransaction>& vtxRet);
 
     bool GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet);
 
@@ -225,11 +227,13 @@ public:
     CTxLockCandidate(const CTxLockRequest& txLockRequestIn) :
         nConfirmedHeight(-1),
         txLockRequest(txLockRequestIn),
-        mapOutPointLocks()
+        mapOutPointLocks(),
+        nTimeCreatedMicros(GetTimeMicros())
         {}
 
     CTxLockRequest txLockRequest;
     std::map<COutPoint, COutPointLock> mapOutPointLocks;
+    int64_t nTimeCreatedMicros; // when the lock request was accepted, for the lock latency stats
 
     uint256 GetHash() const { return txLockRequest.GetHash(); }
 
@@ -0,0 +1,105 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include <assert.h>
+
+#include <univalue.h>
+
+CJSONStreamWriter::CJSONStreamWriter(size_t nFlushThresholdIn) :
+    nFlushThreshold(nFlushThresholdIn),
+    fFlushed(false),
+    fAfterKey(false)
+{
+    strBuffer.reserve(nFlushThreshold + 1024);
+}
+
+void CJSONStreamWriter::Separator()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vFirst.empty())
+        return;
+    if (!vFirst.back())
+        strBuffer += ',';
+    vFirst.back() = false;
+}
+
+void CJSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() >= nFlushThreshold)
+        Flush();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separator();
+    strBuffer += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += '}';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separator();
+    strBuffer += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += ']';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Key(const std::string& strKey)
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    Separator();
+    // UniValue takes care of quoting and escaping
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& val)
+{
+    Separator();
+    strBuffer += val.write();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Raw(const std::string& str)
+{
+    strBuffer += str;
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    WriteChunk(strBuffer);
+    strBuffer.clear();
+    fFlushed = true;
+}
+
+void CJSONStreamWriter::Discard()
+{
+    strBuffer.clear();
+    vFirst.clear();
+    fAfterKey = false;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Flush the buffered output once it grows past this many bytes */
+static const size_t DEFAULT_JSON_STREAM_FLUSH = 64 * 1024;
+
+/**
+ * Incremental JSON emitter.
+ *
+ * Lets large responses be produced element by element instead of building
+ * the whole UniValue tree and serializing it into one string. Output is
+ * buffered and handed to WriteChunk() whenever the buffer exceeds the flush
+ * threshold; subclasses decide where the chunks go.
+ *
+ * The produced text is identical to UniValue::write() (without indentation)
+ * of the equivalent tree.
+ */
+class CJSONStreamWriter
+{
+public:
+    CJSONStreamWriter(size_t nFlushThresholdIn = DEFAULT_JSON_STREAM_FLUSH);
+    virtual ~CJSONStreamWriter() {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write an object key, the next value written belongs to it */
+    void Key(const std::string& strKey);
+    /** Write a complete value (as an array element or after Key()) */
+    void Value(const UniValue& val);
+    void KeyValue(const std::string& strKey, const UniValue& val) { Key(strKey); Value(val); }
+    /** Append raw text outside of the JSON structure (e.g. a trailing newline) */
+    void Raw(const std::string& str);
+
+    /** Pass everything buffered so far on to WriteChunk() */
+    void Flush();
+    /** Whether any output has been passed on to WriteChunk() yet */
+    bool HasFlushed() const { return fFlushed; }
+    /** Drop buffered output and nesting state. Only meaningful before the first flush. */
+    void Discard();
+
+protected:
+    /** Output sink, called with non-empty chunks in order */
+    virtual void WriteChunk(const std::string& strChunk) = 0;
+
+    const std::string& GetBuffer() const { return strBuffer; }
+
+private:
+    std::string strBuffer;
+    size_t nFlushThreshold;
+    bool fFlushed;
+    bool fAfterKey;
+    // one entry per open object/array: true until its first element is written
+    std::vector<bool> vFirst;
+
+    void Separator();
+    void MaybeFlush();
+};
+
+/** CJSONStreamWriter collecting everything into a string */
+class CJSONStringWriter : public CJSONStreamWriter
+{
+public:
+    CJSONStringWriter(size_t nFlushThresholdIn = DEFAULT_JSON_STREAM_FLUSH) : CJSONStreamWriter(nFlushThresholdIn) {}
+
+    /** Flush and return everything written so far */
+    const std::string& str() { Flush(); return strOut; }
+
+protected:
+    void WriteChunk(const std::string& strChunk) { strOut += strChunk; }
+
+private:
+    std::string strOut;
+};
+
+#endif // BITCOIN_JSONWRITER_H
@@ -9,6 +9,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -19,6 +20,7 @@
 #include "init.h"
 #include "merkleblock.h"
 #include "net.h"
+#include "perfstats.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/block.h"
@@ -67,6 +69,7 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CBlockIndexArena arenaBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
@@ -208,6 +211,8 @@ namespace {
         uint256 hash;
         CBlockIndex* pindex;     //!< Optional.
         bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
+        int64_t nTimeRequested;  //!< When the block was requested (in microseconds).
+        boost::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, set while reconstructing a compact block.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -277,6 +282,19 @@ struct CNodeState {
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
+    //! Requested blocks this peer delivered, and their total size.
+    int64_t nBlocksDownloaded;
+    int64_t nBlockBytesDownloaded;
+    //! Moving averages of the block download rate (in bytes per second) and of the time from requesting
+    //! a block to receiving it (in microseconds), or 0 before the first block arrived.
+    int64_t nDownloadRate;
+    int64_t nDownloadLatency;
+    //! Blocks requested from another peer instead because this one was stalling the download window.
+    int nBlocksReassigned;
+    //! Whether this peer can give us compact blocks (it sent "sendcmpct").
+    bool fProvidesHeaderAndIDs;
+    //! Whether this peer wants new blocks announced with a "cmpctblock" message.
+    bool fPreferHeaderAndIDs;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -293,6 +311,17 @@ struct CNodeState {
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
+        nBlocksDownloaded = 0;
+        nBlockBytesDownloaded = 0;
+        nDownloadRate = 0;
+        nDownloadLatency = 0;
+        nBlocksReassigned = 0;
+        fProvidesHeaderAndIDs = false;
+        fPreferHeaderAndIDs = false;
+    }
+
+    int GetBlocksInFlightLimit() const {
+        return GetBlocksInTransitLimit(nDownloadRate, nBlocksDownloaded ? nBlockBytesDownloaded / nBlocksDownloaded : 0);
     }
 };
 
@@ -391,7 +420,7 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, pindex != NULL};
+    QueuedBlock newentry = {hash, pindex, pindex != NULL, GetTimeMicros()};
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
@@ -405,6 +434,26 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+/** Update the download measurements of a peer that delivered a block of nSize bytes, if it was requested from it. */
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, unsigned int nSize) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    int64_t nNow = GetTimeMicros();
+    int64_t nLatency = std::max<int64_t>(nNow - itInFlight->second.second->nTimeRequested, 0);
+    state->nBlocksDownloaded++;
+    state->nBlockBytesDownloaded += nSize;
+    state->nDownloadLatency = state->nDownloadLatency ? (state->nDownloadLatency * 7 + nLatency) / 8 : nLatency;
+    if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
+        // Peers deliver blocks in the order they were requested, so the time since the previous block
+        // arrived (or since this one was requested, if later) is what the peer needed to transfer it.
+        int64_t nRate = (int64_t)nSize * 1000000 / std::max<int64_t>(nNow - state->nDownloadingSince, 1000);
+        state->nDownloadRate = state->nDownloadRate ? (state->nDownloadRate * 7 + nRate) / 8 : std::max<int64_t>(nRate, 1);
+    }
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -474,8 +523,9 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+ *  at most count entries. If nothing can be fetched because the download window is full, nodeStaller
+ *  and pindexStalled are set to the peer and the first in-flight block the window is waiting for. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex*& pindexStalled) {
     if (count == 0)
         return;
 
@@ -511,6 +561,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex *pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -542,6 +593,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -552,6 +604,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -571,9 +624,23 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksInFlightLimit = state->GetBlocksInFlightLimit();
+    stats.nBlocksDownloaded = state->nBlocksDownloaded;
+    stats.nBlockBytesDownloaded = state->nBlockBytesDownloaded;
+    stats.nDownloadRate = state->nDownloadRate;
+    stats.nDownloadLatency = state->nDownloadLatency;
+    stats.nBlocksReassigned = state->nBlocksReassigned;
     return true;
 }
 
+int GetBlocksInTransitLimit(int64_t nBytesPerSecond, int64_t nBlockSize)
+{
+    if (nBytesPerSecond <= 0 || nBlockSize <= 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nBlocks = nBytesPerSecond * BLOCK_DOWNLOAD_TARGET_TIME / nBlockSize;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(nBlocks, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -608,6 +675,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewWriteBehind *pcoinsWriter = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -695,6 +763,26 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
     return nEvicted;
 }
 
+/** Orphans spending outputs of hash, directly or through other orphans, in the order they are reached */
+std::vector<CTransaction> static GetOrphanDescendants(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<CTransaction> vOrphans;
+    std::vector<uint256> vQueue(1, hash);
+    set<uint256> setSeen;
+    for (unsigned int i = 0; i < vQueue.size(); i++) {
+        map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vQueue[i]);
+        if (itByPrev == mapOrphanTransactionsByPrev.end())
+            continue;
+        BOOST_FOREACH(const uint256& orphanHash, itByPrev->second) {
+            if (!setSeen.insert(orphanHash).second)
+                continue;
+            vOrphans.push_back(mapOrphanTransactions[orphanHash].tx);
+            vQueue.push_back(orphanHash);
+        }
+    }
+    return vOrphans;
+}
+
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
     if (tx.nLockTime == 0)
@@ -1529,7 +1617,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
 {
     std::vector<uint256> vHashTxToUncache;
+    int64_t nTimeStart = GetTimeMicros();
     bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, vHashTxToUncache, fDryRun);
+    if (!fDryRun) {
+        perfMempoolAccept.Record(GetTimeMicros() - nTimeStart);
+        if (res)
+            perfMempoolAccepted.Increment();
+        else
+            perfMempoolRejected.Increment();
+    }
     if (!res || fDryRun) {
         if(!res) LogPrint("mempool", "%s: %s %s\n", __func__, tx.GetHash().ToString(), state.GetRejectReason());
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
@@ -1538,6 +1634,146 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+/**
+ * Script check run ahead of AcceptToMemoryPool only to fill the signature cache.
+ * Failures are left for AcceptToMemoryPool to find and report.
+ */
+class CScriptPrecheck
+{
+private:
+    CScriptCheck check;
+
+public:
+    CScriptPrecheck() {}
+    CScriptPrecheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn) :
+        check(txFromIn, txToIn, nInIn, STANDARD_SCRIPT_VERIFY_FLAGS, true) {}
+
+    bool operator()() { check(); return true; }
+
+    void swap(CScriptPrecheck& other) { check.swap(other.check); }
+};
+
+/** Separate from scriptcheckqueue so that mempool admission never waits for ConnectBlock, nor the other way round */
+static CCheckQueue<CScriptPrecheck> txscriptcheckqueue(128);
+/** Only one CCheckQueueControl may use txscriptcheckqueue at a time */
+static CCriticalSection cs_txscriptcheckqueue;
+
+void ThreadTxScriptCheck() {
+    RenameThread("dash-txscriptch");
+    txscriptcheckqueue.Thread();
+}
+
+void PreverifyTransactionScripts(const std::vector<CTransaction>& vtx, const CCoinsViewCache& view)
+{
+    std::vector<CScriptPrecheck> vChecks;
+    BOOST_FOREACH(const CTransaction& tx, vtx) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const COutPoint& prevout = tx.vin[i].prevout;
+            const CCoins* coins = view.AccessCoins(prevout.hash);
+            if (!coins || !coins->IsAvailable(prevout.n))
+                continue;
+            CScriptPrecheck check(*coins, tx, i);
+            vChecks.push_back(CScriptPrecheck());
+            check.swap(vChecks.back());
+        }
+    }
+    if (vChecks.empty())
+        return;
+
+    if (!nScriptCheckThreads) {
+        BOOST_FOREACH(CScriptPrecheck& check, vChecks)
+            check();
+        return;
+    }
+    LOCK(cs_txscriptcheckqueue);
+    CCheckQueueControl<CScriptPrecheck> control(&txscriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+void PreverifyTransactions(CTxMemPool& pool, const std::vector<CTransaction>& vtx)
+{
+    // Context-free checks first, they don't need any lock
+    std::vector<const CTransaction*> vCandidates;
+    BOOST_FOREACH(const CTransaction& tx, vtx) {
+        CValidationState stateDummy;
+        std::string reason;
+        if (tx.IsCoinBase() || !CheckTransaction(tx, stateDummy))
+            continue;
+        if (fRequireStandard && !IsStandardTx(tx, reason))
+            continue;
+        vCandidates.push_back(&tx);
+    }
+    if (vCandidates.empty())
+        return;
+
+    // Copy the spent outputs into a private view, then verify without holding any lock.
+    // Transactions AcceptToMemoryPool would turn down before checking their scripts are
+    // skipped, so that relaying them costs us no more than it did before.
+    std::vector<CTransaction> vtxVerify;
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        std::vector<uint256> vHashTxToUncache;
+        BOOST_FOREACH(const CTransaction* ptx, vCandidates) {
+            const CTransaction& tx = *ptx;
+            const uint256& hash = tx.GetHash();
+            if (pool.exists(hash) || view.HaveCoins(hash))
+                continue;
+
+            view.SetBackend(viewMemPool);
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
+                    vHashTxToUncache.push_back(txin.prevout.hash);
+                view.AccessCoins(txin.prevout.hash);
+            }
+            view.SetBackend(viewDummy);
+
+            if (!view.HaveInputs(tx))
+                continue;
+            if (fRequireStandard && !AreInputsStandard(tx, view))
+                continue;
+            unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            if (view.GetValueIn(tx) - tx.GetValueOut() < ::minRelayTxFee.GetFee(nSize))
+                continue;
+
+            // later transactions of the batch may spend this one
+            CCoinsModifier coins = view.ModifyNewCoins(hash);
+            *coins = CCoins(tx, MEMPOOL_HEIGHT);
+            vtxVerify.push_back(tx);
+        }
+        // Like AcceptToMemoryPool, don't let transactions that may never make it into the mempool fill the coins cache
+        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+            pcoinsTip->Uncache(hashTx);
+    }
+
+    PreverifyTransactionScripts(vtxVerify, view);
+}
+
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransaction>& vtx,
+                                     std::vector<CValidationState>& vState, std::vector<bool>& vAccepted,
+                                     std::vector<bool>& vMissingInputs, bool fLimitFree, bool fRejectAbsurdFee)
+{
+    PreverifyTransactions(pool, vtx);
+
+    vState.assign(vtx.size(), CValidationState());
+    vAccepted.assign(vtx.size(), false);
+    vMissingInputs.assign(vtx.size(), false);
+
+    unsigned int nAccepted = 0;
+    LOCK(cs_main);
+    for (unsigned int i = 0; i < vtx.size(); i++) {
+        bool fMissingInputs = false;
+        vAccepted[i] = AcceptToMemoryPool(pool, vState[i], vtx[i], fLimitFree, &fMissingInputs, false, fRejectAbsurdFee);
+        vMissingInputs[i] = fMissingInputs;
+        if (vAccepted[i])
+            nAccepted++;
+    }
+    return nAccepted;
+}
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes)
 {
     if (!fTimestampIndex)
@@ -1564,24 +1800,26 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     const CAddressIndexKey *pkeyAfter, size_t nMaxEntries)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end, pkeyAfter, nMaxEntries))
         return error("unable to get txids for address");
 
     return true;
 }
 
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pkeyAfter, size_t nMaxEntries)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, pkeyAfter, nMaxEntries))
         return error("unable to get txids for address");
 
     return true;
@@ -2569,6 +2807,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    perfConnectBlockCheck.Record(nTime1 - nTimeStart);
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2632,6 +2871,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    perfConnectBlockForks.Record(nTime2 - nTime1);
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
@@ -2777,6 +3017,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    perfConnectBlockConnect.Record(nTime3 - nTime2);
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
 
     // DASH : MODIFIED TO CHECK MASTERNODE PAYMENTS AND SUPERBLOCKS
@@ -2803,6 +3044,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
+    perfConnectBlockVerify.Record(nTime4 - nTime2);
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
     if (fJustCheck)
@@ -2853,6 +3095,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    perfConnectBlockIndex.Record(nTime5 - nTime4);
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
 
     // Watch for changes to the previous coinbase transaction.
@@ -2861,6 +3104,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
+    perfConnectBlockCallbacks.Record(nTime6 - nTime5);
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
 
     return true;
@@ -2910,7 +3154,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
-    size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+    // Entries still being written in the background count against the cache limit too
+    size_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pcoinsWriter->DynamicMemoryUsage();
     // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
     // The cache is over the limit, we have to write now.
@@ -2960,9 +3205,17 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // Flush the chainstate (which may refer to block index entries). The modified entries are
+        // written in the background while validation goes on, unless the caller needs them on disk.
+        int64_t nSyncStart = GetTimeMicros();
+        if (!pcoinsTip->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        if (mode == FLUSH_STATE_ALWAYS && !pcoinsWriter->Wait())
             return AbortNode(state, "Failed to write to coin database");
+        // Keep the cache warm, but leave it room to grow until the next flush
+        size_t nEvicted = pcoinsTip->Trim(nCoinCacheUsage / 100 * COINS_CACHE_RETAIN_PERCENT);
+        LogPrint("coindb", "%s: handed chainstate to the writer in %.2fms, %u cached transactions evicted, cache %.1fMiB\n", __func__,
+            (GetTimeMicros() - nSyncStart) * 0.001, (unsigned int)nEvicted, pcoinsTip->DynamicMemoryUsage() * (1.0 / (1<<20)));
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -3117,6 +3370,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    perfConnectTipLoad.Record(nTime2 - nTime1);
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
@@ -3130,15 +3384,18 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         }
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
+        perfConnectTipConnect.Record(nTime3 - nTime2);
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
+    perfConnectTipFlush.Record(nTime4 - nTime3);
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
+    perfConnectTipChainState.Record(nTime5 - nTime4);
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
@@ -3156,6 +3413,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    perfConnectTipPostProcess.Record(nTime6 - nTime5);
+    perfConnectTipTotal.Record(nTime6 - nTime1);
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
     return true;
@@ -3506,17 +3765,16 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256* phash = NULL)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = arenaBlockIndex.Create(CBlockIndex(block));
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3689,7 +3947,44 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
+/**
+ * DASH : check the transactions of a block against completed transaction locks. Apart from
+ * this, CheckBlock is context free and can run on any thread; this part may take cs_main.
+ */
+static bool CheckBlockTransactionLocks(const CBlock& block, CValidationState& state)
+{
+    if(sporkManager.IsSporkActive(SPORK_3_INSTANTSEND_BLOCK_FILTERING)) {
+        // We should never accept block which conflicts with completed transaction lock,
+        // that's why this is in CheckBlock unlike coinbase payee/amount.
+        // Require other nodes to comply, send them some data in case they are missing it.
+        BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+            // skip coinbase, it has no inputs
+            if (tx.IsCoinBase()) continue;
+            // LOOK FOR TRANSACTION LOCK IN OUR MAP OF OUTPOINTS
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                uint256 hashLocked;
+                if(instantsend.GetLockedOutPointTxHash(txin.prevout, hashLocked) && hashLocked != tx.GetHash()) {
+                    // Every node which relayed this block to us must invalidate it
+                    // but they probably need more data.
+                    // Relay corresponding transaction lock request and all its votes
+                    // to let other nodes complete the lock.
+                    instantsend.Relay(hashLocked);
+                    LOCK(cs_main);
+                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                    return state.DoS(0, error("CheckBlock(DASH): transaction %s conflicts with transaction lock %s",
+                                                tx.GetHash().ToString(), hashLocked.ToString()),
+                                     REJECT_INVALID, "conflict-tx-lock");
+                }
+            }
+        }
+    } else {
+        LogPrintf("CheckBlock(DASH): spork is off, skipping transaction locking checks\n");
+    }
+
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckTxLocks)
 {
     // These are checks that are independent of context.
 
@@ -3737,35 +4032,8 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
 
     // DASH : CHECK TRANSACTIONS FOR INSTANTSEND
-
-    if(sporkManager.IsSporkActive(SPORK_3_INSTANTSEND_BLOCK_FILTERING)) {
-        // We should never accept block which conflicts with completed transaction lock,
-        // that's why this is in CheckBlock unlike coinbase payee/amount.
-        // Require other nodes to comply, send them some data in case they are missing it.
-        BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-            // skip coinbase, it has no inputs
-            if (tx.IsCoinBase()) continue;
-            // LOOK FOR TRANSACTION LOCK IN OUR MAP OF OUTPOINTS
-            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
-                uint256 hashLocked;
-                if(instantsend.GetLockedOutPointTxHash(txin.prevout, hashLocked) && hashLocked != tx.GetHash()) {
-                    // Every node which relayed this block to us must invalidate it
-                    // but they probably need more data.
-                    // Relay corresponding transaction lock request and all its votes
-                    // to let other nodes complete the lock.
-                    instantsend.Relay(hashLocked);
-                    LOCK(cs_main);
-                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                    return state.DoS(0, error("CheckBlock(DASH): transaction %s conflicts with transaction lock %s",
-                                                tx.GetHash().ToString(), hashLocked.ToString()),
-                                     REJECT_INVALID, "conflict-tx-lock");
-                }
-            }
-        }
-    } else {
-        LogPrintf("CheckBlock(DASH): spork is off, skipping transaction locking checks\n");
-    }
-
+    if (fCheckTxLocks && !CheckBlockTransactionLocks(block, state))
+        return false;
     // END DASH
 
     // Check transactions
@@ -3784,7 +4052,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock(): out-of-bounds SigOpCount"),
                          REJECT_INVALID, "bad-blk-sigops");
 
-    if (fCheckPOW && fCheckMerkleRoot)
+    if (fCheckPOW && fCheckMerkleRoot && fCheckTxLocks)
         block.fChecked = true;
 
     return true;
@@ -3883,11 +4151,12 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/** phash, if given, is the hash of the header with its proof of work checked by the caller already */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, const uint256* phash=NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
 
@@ -3904,7 +4173,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, phash == NULL))
             return false;
 
         // Get prev block index
@@ -3924,7 +4193,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return false;
     }
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, phash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -4231,9 +4500,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
+    CBlockIndex* pindexNew = arenaBlockIndex.Create();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4372,6 +4639,169 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100);
 }
 
+static CCriticalSection cs_verifyProgress;
+static CVerifyDBProgress verifyProgress;
+
+double CVerifyDBProgress::GetProgress() const
+{
+    int nTotal = nCheckLevel >= 4 ? nBlocks * 2 : nBlocks;
+    if (nTotal == 0)
+        return fRunning ? 0.0 : 1.0;
+    return std::min(1.0, (double)(nChecked + nReconnected) / nTotal);
+}
+
+int64_t CVerifyDBProgress::GetRemainingTime() const
+{
+    double dProgress = GetProgress();
+    if (!fRunning || dProgress <= 0.0)
+        return -1;
+    return (int64_t)((GetTime() - nStartTime) * (1.0 - dProgress) / dProgress);
+}
+
+CVerifyDBProgress GetVerifyDBProgress()
+{
+    LOCK(cs_verifyProgress);
+    return verifyProgress;
+}
+
+namespace {
+
+/** Marks the block verification as done when going out of scope */
+struct CVerifyDBProgressScope
+{
+    CVerifyDBProgressScope(int nCheckLevel, int nBlocks)
+    {
+        LOCK(cs_verifyProgress);
+        verifyProgress = CVerifyDBProgress();
+        verifyProgress.fRunning = true;
+        verifyProgress.nCheckLevel = nCheckLevel;
+        verifyProgress.nBlocks = nBlocks;
+        verifyProgress.nStartTime = GetTime();
+    }
+
+    ~CVerifyDBProgressScope()
+    {
+        LOCK(cs_verifyProgress);
+        verifyProgress.fRunning = false;
+        verifyProgress.nEndTime = GetTime();
+    }
+};
+
+/**
+ * Runs the checks of VerifyDB up to level 2 (reading the block, CheckBlock and reading the
+ * undo data) from several threads, at most VERIFYDB_READAHEAD_BLOCKS ahead of the block the
+ * caller is at. The caller takes the blocks in order for the checks that depend on the chain
+ * state. The block index entries are only read, the caller holds cs_main meanwhile.
+ */
+class CVerifyDBReader
+{
+private:
+    struct CResult
+    {
+        boost::shared_ptr<CBlock> pblock;
+        std::string strError;
+        bool fDone;
+
+        CResult() : fDone(false) {}
+    };
+
+    const Consensus::Params& consensusParams;
+    const std::vector<CBlockIndex*>& vIndex;
+    int nCheckLevel;
+    std::vector<CResult> vResults;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nNext;
+    size_t nTaken;
+    bool fAbort;
+    boost::thread_group threads;
+
+    void Check(const CBlockIndex* pindex, CResult& result)
+    {
+        result.pblock.reset(new CBlock());
+        CValidationState state;
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(*result.pblock, pindex, consensusParams)) {
+            result.strError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
+        // check level 1: verify block validity, apart from the transaction locks which may need cs_main
+        if (nCheckLevel >= 1 && !CheckBlock(*result.pblock, state, true, true, false)) {
+            result.strError = strprintf("found bad block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
+        // check level 2: verify undo validity
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!pos.IsNull() && !UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash())) {
+                result.strError = strprintf("found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                return;
+            }
+        }
+    }
+
+    void ThreadCheck()
+    {
+        RenameThread("dash-verifydb");
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fAbort && nNext < vIndex.size() && nNext >= nTaken + VERIFYDB_READAHEAD_BLOCKS)
+                    cond.wait(lock);
+                if (fAbort || nNext == vIndex.size())
+                    return;
+                i = nNext++;
+            }
+            CResult result;
+            Check(vIndex[i], result);
+            if (!result.strError.empty())
+                result.pblock.reset();
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                vResults[i] = result;
+                vResults[i].fDone = true;
+                cond.notify_all();
+            }
+        }
+    }
+
+public:
+    CVerifyDBReader(const Consensus::Params& consensusParamsIn, const std::vector<CBlockIndex*>& vIndexIn, int nCheckLevelIn, int nThreads) :
+        consensusParams(consensusParamsIn), vIndex(vIndexIn), nCheckLevel(nCheckLevelIn), vResults(vIndexIn.size()), nNext(0), nTaken(0), fAbort(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CVerifyDBReader::ThreadCheck, this));
+    }
+
+    ~CVerifyDBReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fAbort = true;
+            cond.notify_all();
+        }
+        threads.join_all();
+    }
+
+    /** Wait for the checks of the i-th block, returns it or NULL with strError set if they failed */
+    boost::shared_ptr<CBlock> Take(size_t i, std::string& strError)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (!vResults[i].fDone)
+            cond.wait(lock);
+        boost::shared_ptr<CBlock> pblock;
+        pblock.swap(vResults[i].pblock);
+        strError = vResults[i].strError;
+        nTaken = i + 1;
+        cond.notify_all();
+        return pblock;
+    }
+};
+
+}
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -4385,47 +4815,50 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         nCheckDepth = chainActive.Height();
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    std::vector<CBlockIndex*> vIndex;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev && pindex->nHeight >= chainActive.Height()-nCheckDepth; pindex = pindex->pprev)
+        vIndex.push_back(pindex);
+    CVerifyDBProgressScope progress(nCheckLevel, vIndex.size());
+
     CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexState = chainActive.Tip();
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size();
+        // Levels 0-2 run ahead from other threads, level 3 disconnects the blocks here in order
+        CVerifyDBReader reader(chainparams.GetConsensus(), vIndex, nCheckLevel, std::max(1, std::min(GetNumCores(), MAX_VERIFYDB_THREADS)));
+        for (size_t i = 0; i < vIndex.size(); i++)
+        {
+            CBlockIndex* pindex = vIndex[i];
+            boost::this_thread::interruption_point();
+            uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+            std::string strError;
+            boost::shared_ptr<CBlock> pblock = reader.Take(i, strError);
+            if (!pblock)
+                return error("VerifyDB(): *** %s", strError);
+            const CBlock& block = *pblock;
+            if (nCheckLevel >= 1 && !CheckBlockTransactionLocks(block, state))
+                return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                bool fClean = true;
+                if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                pindexState = pindex->pprev;
+                if (!fClean) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else
+                    nGoodTransactions += block.vtx.size();
+            }
+            {
+                LOCK(cs_verifyProgress);
+                verifyProgress.nChecked++;
+            }
+            if (ShutdownRequested())
+                return true;
         }
-        if (ShutdownRequested())
-            return true;
     }
     if (pindexFailure)
         return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
@@ -4442,6 +4875,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             if (!ConnectBlock(block, state, pindex, coins))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            LOCK(cs_verifyProgress);
+            verifyProgress.nReconnected++;
         }
     }
 
@@ -4477,10 +4912,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    arenaBlockIndex.Clear();
     fHavePruned = false;
 }
 
@@ -4649,6 +5082,279 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+/** A block found by the -reindex scan, with the proof of work of its header checked */
+struct CReindexBlock
+{
+    CBlockHeader header;
+    uint256 hash;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Collect the headers of the blocks in block file nFile, skipping over the transactions.
+ * Like LoadExternalBlockFile, anything that is not a block is searched through for the
+ * next message start.
+ */
+static void ScanBlockFile(const CChainParams& chainparams, int nFile, std::vector<CReindexBlock>& vBlocks)
+{
+    FILE* file = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+    if (!file)
+        return; // This error is logged in OpenBlockFile
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+
+    const unsigned char* pchMessageStart = (const unsigned char*)chainparams.MessageStart();
+    const size_t nFrameSize = MESSAGE_START_SIZE + sizeof(unsigned int) + 80;
+    std::vector<unsigned char> vBuf(1 << 22);
+    uint64_t nBufStart = 0;
+    size_t nBufLen = 0;
+    uint64_t nPos = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (nPos < nBufStart || nPos + nFrameSize > nBufStart + nBufLen) {
+            if (fseek(file, nPos, SEEK_SET))
+                break;
+            nBufStart = nPos;
+            nBufLen = fread(&vBuf[0], 1, vBuf.size(), file);
+            if (nBufLen < nFrameSize)
+                break;
+        }
+        const unsigned char* pch = &vBuf[nPos - nBufStart];
+        if (memcmp(pch, pchMessageStart, MESSAGE_START_SIZE)) {
+            const unsigned char* pchNext = (const unsigned char*)memchr(pch + 1, pchMessageStart[0], nBufStart + nBufLen - nPos - 1);
+            nPos = pchNext ? nBufStart + (pchNext - &vBuf[0]) : nBufStart + nBufLen;
+            continue;
+        }
+        unsigned int nSize = ReadLE32(pch + MESSAGE_START_SIZE);
+        CReindexBlock block;
+        if (nSize >= 80 && nSize <= MAX_BLOCK_SIZE) {
+            CDataStream ss((const char*)pch + MESSAGE_START_SIZE + sizeof(unsigned int), (const char*)pch + nFrameSize, SER_DISK, CLIENT_VERSION);
+            ss >> block.header;
+            block.hash = block.header.GetHash();
+        }
+        if (block.hash.IsNull() || !CheckProofOfWork(block.hash, block.header.nBits, chainparams.GetConsensus())) {
+            nPos++;
+            continue;
+        }
+        block.pos = CDiskBlockPos(nFile, nPos + MESSAGE_START_SIZE + sizeof(unsigned int));
+        vBlocks.push_back(block);
+        nPos = block.pos.nPos + nSize;
+    }
+}
+
+struct CompareReindexHeight
+{
+    bool operator()(const std::pair<CBlockIndex*, CDiskBlockPos>& a, const std::pair<CBlockIndex*, CDiskBlockPos>& b) const
+    {
+        return a.first->nHeight < b.first->nHeight;
+    }
+};
+
+/** Hands out the block files to the scanning threads */
+struct CReindexScan
+{
+    boost::mutex cs;
+    int nNextFile;
+    int nFiles;
+    std::vector<std::vector<CReindexBlock> > vFiles;
+};
+
+static void ThreadScanBlockFiles(const CChainParams& chainparams, CReindexScan* pscan)
+{
+    while (true) {
+        int nFile;
+        {
+            boost::lock_guard<boost::mutex> lock(pscan->cs);
+            if (pscan->nNextFile >= pscan->nFiles)
+                return;
+            nFile = pscan->nNextFile++;
+        }
+        ScanBlockFile(chainparams, nFile, pscan->vFiles[nFile]);
+        LogPrint("reindex", "%s: %u blocks in blk%05u.dat\n", __func__, pscan->vFiles[nFile].size(), nFile);
+    }
+}
+
+/** Blocks read from disk ahead of the thread connecting them */
+struct CReindexPrefetch
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<boost::shared_ptr<CBlock> > queue;
+    bool fDone;
+};
+
+static void ThreadPrefetchBlocks(const CChainParams& chainparams, const std::vector<std::pair<CBlockIndex*, CDiskBlockPos> >* pvOrder, CReindexPrefetch* pprefetch)
+{
+    for (size_t i = 0; i < pvOrder->size(); i++) {
+        boost::shared_ptr<CBlock> pblock(new CBlock());
+        if (!ReadBlockFromDisk(*pblock, (*pvOrder)[i].second, chainparams.GetConsensus()))
+            pblock.reset(); // This error is logged in ReadBlockFromDisk
+        boost::unique_lock<boost::mutex> lock(pprefetch->cs);
+        while (pprefetch->queue.size() >= REINDEX_PREFETCH_BLOCKS && !pprefetch->fDone)
+            pprefetch->cond.wait(lock);
+        if (pprefetch->fDone)
+            return;
+        pprefetch->queue.push_back(pblock);
+        pprefetch->cond.notify_all();
+    }
+}
+
+bool ReindexBlockFiles(const CChainParams& chainparams)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Scan the block files in parallel, only reading and hashing the headers
+    CReindexScan scan;
+    scan.nNextFile = 0;
+    scan.nFiles = 0;
+    while (boost::filesystem::exists(GetBlockPosFilename(CDiskBlockPos(scan.nFiles, 0), "blk")))
+        scan.nFiles++;
+    scan.vFiles.resize(scan.nFiles);
+    int nThreads = std::max(1, std::min(std::min(GetNumCores(), MAX_REINDEX_SCAN_THREADS), scan.nFiles));
+    LogPrintf("Reindexing %d block files with %d threads...\n", scan.nFiles, nThreads);
+    {
+        boost::thread_group threadsScan;
+        for (int i = 0; i < nThreads; i++)
+            threadsScan.create_thread(boost::bind(&ThreadScanBlockFiles, boost::cref(chainparams), &scan));
+        try {
+            threadsScan.join_all();
+        } catch (const boost::thread_interrupted&) {
+            threadsScan.interrupt_all();
+            threadsScan.join_all();
+            throw;
+        }
+    }
+    int64_t nScanned = GetTimeMillis();
+
+    // Connect the genesis block first, the index is built on top of it
+    for (int nFile = 0; nFile < scan.nFiles && chainActive.Tip() == NULL; nFile++) {
+        BOOST_FOREACH(const CReindexBlock& block, scan.vFiles[nFile]) {
+            if (block.hash != chainparams.GetConsensus().hashGenesisBlock)
+                continue;
+            CBlock genesis;
+            CDiskBlockPos pos = block.pos;
+            CValidationState state;
+            if (ReadBlockFromDisk(genesis, pos, chainparams.GetConsensus()))
+                ProcessNewBlock(state, chainparams, NULL, &genesis, true, &pos);
+            break;
+        }
+    }
+    if (chainActive.Tip() == NULL) {
+        LogPrintf("%s: genesis block not found in the block files\n", __func__);
+        return false;
+    }
+
+    // Build the block index from the headers, in file order with the out of order ones
+    // connected as soon as their parent is known
+    std::map<CBlockIndex*, CDiskBlockPos> mapBlockPos;
+    {
+        std::multimap<uint256, const CReindexBlock*> mapUnknownParent;
+        for (int nFile = 0; nFile < scan.nFiles; nFile++) {
+            boost::this_thread::interruption_point();
+            LOCK(cs_main);
+            BOOST_FOREACH(const CReindexBlock& block, scan.vFiles[nFile]) {
+                if (block.hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.count(block.header.hashPrevBlock) == 0) {
+                    mapUnknownParent.insert(std::make_pair(block.header.hashPrevBlock, &block));
+                    continue;
+                }
+                std::deque<const CReindexBlock*> queue;
+                queue.push_back(&block);
+                while (!queue.empty()) {
+                    const CReindexBlock* pblock = queue.front();
+                    queue.pop_front();
+                    CValidationState state;
+                    CBlockIndex* pindex = NULL;
+                    if (!AcceptBlockHeader(pblock->header, state, chainparams, &pindex, &pblock->hash)) {
+                        LogPrint("reindex", "%s: header %s rejected: %s\n", __func__, pblock->hash.ToString(), FormatStateMessage(state));
+                        continue;
+                    }
+                    // a block stored twice is processed from where it was found first
+                    mapBlockPos.insert(std::make_pair(pindex, pblock->pos));
+                    std::pair<std::multimap<uint256, const CReindexBlock*>::iterator, std::multimap<uint256, const CReindexBlock*>::iterator> range = mapUnknownParent.equal_range(pblock->hash);
+                    for (std::multimap<uint256, const CReindexBlock*>::iterator it = range.first; it != range.second; it++)
+                        queue.push_back(it->second);
+                    mapUnknownParent.erase(range.first, range.second);
+                }
+            }
+        }
+        if (!mapUnknownParent.empty())
+            LogPrintf("%s: %u blocks without a known parent left out\n", __func__, mapUnknownParent.size());
+    }
+    std::vector<std::vector<CReindexBlock> >().swap(scan.vFiles);
+
+    // Connect the best header chain in height order first, the other branches after it
+    std::vector<std::pair<CBlockIndex*, CDiskBlockPos> > vOrder;
+    {
+        LOCK(cs_main);
+        std::vector<std::pair<CBlockIndex*, CDiskBlockPos> > vOther;
+        for (std::map<CBlockIndex*, CDiskBlockPos>::const_iterator it = mapBlockPos.begin(); it != mapBlockPos.end(); it++) {
+            CBlockIndex* pindex = it->first;
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                continue;
+            if (pindexBestHeader && pindexBestHeader->GetAncestor(pindex->nHeight) == pindex)
+                vOrder.push_back(*it);
+            else
+                vOther.push_back(*it);
+        }
+        std::sort(vOrder.begin(), vOrder.end(), CompareReindexHeight());
+        std::sort(vOther.begin(), vOther.end(), CompareReindexHeight());
+        vOrder.insert(vOrder.end(), vOther.begin(), vOther.end());
+    }
+    LogPrintf("Reindex: %u headers indexed in %dms, connecting %u blocks...\n", mapBlockPos.size(), GetTimeMillis() - nScanned, vOrder.size());
+
+    CReindexPrefetch prefetch;
+    prefetch.fDone = false;
+    boost::thread threadPrefetch(boost::bind(&ThreadPrefetchBlocks, boost::cref(chainparams), &vOrder, &prefetch));
+    int nLoaded = 0;
+    int nLastFile = -1;
+    try {
+        for (size_t i = 0; i < vOrder.size(); i++) {
+            boost::this_thread::interruption_point();
+            boost::shared_ptr<CBlock> pblock;
+            {
+                boost::unique_lock<boost::mutex> lock(prefetch.cs);
+                while (prefetch.queue.empty())
+                    prefetch.cond.wait(lock);
+                pblock = prefetch.queue.front();
+                prefetch.queue.pop_front();
+                prefetch.cond.notify_all();
+            }
+            if (!pblock)
+                continue;
+            CValidationState state;
+            CDiskBlockPos pos = vOrder[i].second;
+            if (ProcessNewBlock(state, chainparams, NULL, pblock.get(), true, &pos)) {
+                nLoaded++;
+                nLastFile = std::max(nLastFile, (int)pos.nFile);
+            }
+            if (state.IsError())
+                break;
+        }
+    } catch (...) {
+        {
+            boost::lock_guard<boost::mutex> lock(prefetch.cs);
+            prefetch.fDone = true;
+            prefetch.cond.notify_all();
+        }
+        threadPrefetch.join();
+        throw;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(prefetch.cs);
+        prefetch.fDone = true;
+        prefetch.cond.notify_all();
+    }
+    threadPrefetch.join();
+
+    {
+        // The blocks were connected out of file order, new ones go after the last file used
+        LOCK(cs_LastBlockFile);
+        if (nLastFile > nLastBlockFile)
+            nLastBlockFile = nLastFile;
+    }
+    LogPrintf("Reindexed %i blocks in %dms (scan %dms)\n", nLoaded, GetTimeMillis() - nStart, nScanned - nStart);
+    return nLoaded > 0;
+}
+
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4984,6 +5690,68 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** The tip as a block message, prepared for the first peer that asks for it (protected by cs_main) */
+static uint256 hashLastBlockMessage;
+static CPreparedMessage msgLastBlock;
+
+/** The tip as a cmpctblock message, shared by every peer it is announced or served to (protected by cs_main) */
+static uint256 hashLastCmpctBlockMessage;
+static CPreparedMessage msgLastCmpctBlock;
+
+/** Peers asked to announce new blocks with cmpctblock messages, most recently useful last (protected by cs_main) */
+static std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+// Requires cs_main.
+static CPreparedMessage GetCompactBlockMessage(CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (pindex->GetBlockHash() == hashLastCmpctBlockMessage)
+        return msgLastCmpctBlock;
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensusParams))
+        assert(!"cannot load block from disk");
+    CPreparedMessage msg = CPreparedMessage::Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block));
+    if (pindex == chainActive.Tip()) {
+        msgLastCmpctBlock = msg;
+        hashLastCmpctBlockMessage = pindex->GetBlockHash();
+    }
+    return msg;
+}
+
+// Requires cs_main.
+/** Ask a peer that just gave us a new tip to announce blocks with cmpctblock messages, in place of the one that did so least recently */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    if (!State(pfrom->GetId())->fProvidesHeaderAndIDs)
+        return;
+    std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin();
+    while (it != lNodesAnnouncingHeaderAndIDs.end()) {
+        if (*it == pfrom->GetId()) {
+            // Already announcing, just move it to the end
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+            return;
+        }
+        if (State(*it) == NULL)
+            it = lNodesAnnouncingHeaderAndIDs.erase(it); // disconnected
+        else
+            ++it;
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_ANNOUNCERS) {
+        NodeId nodeOldest = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeOldest) {
+                pnode->PushMessage(NetMsgType::SENDCMPCT, false, (uint64_t)1);
+                break;
+            }
+        }
+    }
+    LogPrint("cmpctblock", "Asking peer=%d to announce blocks with cmpctblock\n", pfrom->id);
+    pfrom->PushMessage(NetMsgType::SENDCMPCT, true, (uint64_t)1);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -5003,7 +5771,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -5038,31 +5806,44 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter)
+                    if (inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                        pfrom->PushPreparedMessage(GetCompactBlockMessage(mi->second, consensusParams));
+                    } else if ((inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK) && inv.hash == hashLastBlockMessage) {
+                        // Every peer asks for the new tip once it is announced, send them all the same message
+                        pfrom->PushPreparedMessage(msgLastBlock, SEND_PRIORITY_NORMAL);
+                    } else {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        if (inv.type != MSG_FILTERED_BLOCK && mi->second == chainActive.Tip()) {
+                            msgLastBlock = CPreparedMessage::Make(NetMsgType::BLOCK, block);
+                            hashLastBlockMessage = inv.hash;
+                            // Unlike historical blocks, the new tip is not bulk traffic
+                            pfrom->PushPreparedMessage(msgLastBlock, SEND_PRIORITY_NORMAL);
+                        } else if (inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK)
+                            // Compact blocks are only served near the tip
+                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        else // MSG_FILTERED_BLOCK)
                         {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter)
+                            {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
+                            }
+                            // else
+                                // no response
                         }
-                        // else
-                            // no response
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -5083,17 +5864,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // Send stream from relay memory
                 bool pushed = false;
                 {
-                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    CPreparedMessage msg;
                     {
                         LOCK(cs_mapRelay);
-                        map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                        if (mi != mapRelay.end()) {
-                            ss += (*mi).second;
-                            pushed = true;
-                        }
+                        map<CInv, CPreparedMessage>::iterator mi = mapRelay.find(inv);
+                        if (mi != mapRelay.end())
+                            msg = mi->second;
+                    }
+                    if (!msg.IsNull()) {
+                        pfrom->PushPreparedMessage(msg);
+                        pushed = true;
                     }
-                    if(pushed)
-                        pfrom->PushMessage(inv.GetCommand(), ss);
                 }
 
                 if (!pushed && inv.type == MSG_TX) {
@@ -5271,6 +6052,32 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/** Process a block pfrom sent us in full or reconstructed from a compact block, rejecting it to the peer if invalid */
+static void ProcessBlockFromPeer(CNode* pfrom, const CChainParams& chainparams, const CBlock& block, const std::string& strCommand)
+{
+    CValidationState state;
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    } else {
+        LOCK(cs_main);
+        if (chainActive.Tip()->GetBlockHash() == block.GetHash() && !IsInitialBlockDownload())
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -5453,6 +6260,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // nodes)
             pfrom->PushMessage(NetMsgType::SENDHEADERS);
         }
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION) {
+            // Tell our peer we can use compact blocks, but that new blocks should
+            // still be announced with headers until it proves to be a fast source
+            // of them (see MaybeSetPeerAsAnnouncingHeaderAndIDs)
+            pfrom->PushMessage(NetMsgType::SENDCMPCT, false, (uint64_t)1);
+        }
     }
 
 
@@ -5528,6 +6341,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
 
     else if (strCommand == NetMsgType::INV)
     {
@@ -5579,7 +6404,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (CanDirectFetch(chainparams.GetConsensus()) &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                        nodestate->nBlocksInFlight < nodestate->GetBlocksInFlightLimit()) {
                         vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
@@ -5795,6 +6620,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pmn->fAllowMixingTx = false;
         }
 
+        // Verify the scripts on the transaction script check threads before taking cs_main
+        // for good, AcceptToMemoryPool then finds the signatures in the signature cache
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+        if (!fAlreadyHave)
+            PreverifyTransactions(mempool, std::vector<CTransaction>(1, tx));
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -5824,7 +6659,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 tx.GetHash().ToString(),
                 mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this one
+            // Recursively process any orphan transactions that depended on this one,
+            // after verifying all their scripts in parallel
+            PreverifyTransactions(mempool, GetOrphanDescendants(inv.hash));
             set<NodeId> setMisbehaving;
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
@@ -5999,7 +6836,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             vector<CBlockIndex *> vToFetch;
             CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            int nBlocksInFlightLimit = nodestate->GetBlocksInFlightLimit();
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= (unsigned int)nBlocksInFlightLimit) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash())) {
                     // We don't have this block, and it's not yet in flight.
@@ -6019,7 +6857,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 BOOST_REVERSE_FOREACH(CBlockIndex *pindex, vToFetch) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nBlocksInFlightLimit) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -6033,6 +6871,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                             pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
                 }
                 if (vGetData.size() > 0) {
+                    if (nodestate->fProvidesHeaderAndIDs && vGetData.size() == 1 && mapBlocksInFlight.size() == 1 &&
+                            pindexLast->pprev->IsValid(BLOCK_VALID_CHAIN)) {
+                        // A single new block on top of our tip is what compact blocks are for
+                        vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                    }
                     pfrom->PushMessage(NetMsgType::GETDATA, vGetData);
                 }
             }
@@ -6044,31 +6887,211 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlock block;
+        unsigned int nSize = vRecv.size();
         vRecv >> block;
 
         CInv inv(MSG_BLOCK, block.GetHash());
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
+        {
+            LOCK(cs_main);
+            UpdateBlockDownloadStats(pfrom->GetId(), inv.hash, nSize);
+        }
+
         pfrom->AddInventoryKnown(inv);
 
-        CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-            pfrom->PushMessage(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+        ProcessBlockFromPeer(pfrom, chainparams, block, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, chainparams, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                    return true;
+                }
             }
+            assert(pindex);
+            UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindex->GetBlockHash());
+            bool fAlreadyInFlight = itInFlight != mapBlocksInFlight.end();
+
+            if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+                return true;
+
+            if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                    pindex->nTx != 0) { // We had this block at some point, but pruned it
+                if (fAlreadyInFlight) {
+                    // We requested this block for some reason, but our mempool will probably be useless
+                    // so we just grab the block via normal getdata
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                }
+                return true;
+            }
+
+            // Away from the tip our mempool is of little use. The header was accepted above,
+            // so unless we asked for this block already, parallel block fetch takes it from here.
+            if (!CanDirectFetch(chainparams.GetConsensus()) || pindex->nHeight > chainActive.Height() + 2) {
+                if (fAlreadyInFlight) {
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                }
+                return true;
+            }
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            list<QueuedBlock>::iterator itQueued;
+            if (fAlreadyInFlight) {
+                if (itInFlight->second.first != pfrom->GetId()) // Someone else is already sending it
+                    return true;
+                itQueued = itInFlight->second.second;
+                if (itQueued->partialBlock) {
+                    LogPrint("net", "Peer %d sent us compact block we were already syncing!\n", pfrom->id);
+                    return true;
+                }
+            } else {
+                if (nodestate->nBlocksInFlight >= nodestate->GetBlocksInFlightLimit())
+                    return true;
+                MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
+                itQueued = mapBlocksInFlight[pindex->GetBlockHash()].second;
+            }
+            itQueued->partialBlock.reset(new PartiallyDownloadedBlock());
+            PartiallyDownloadedBlock& partialBlock = *itQueued->partialBlock;
+
+            // Locked transactions were relayed ahead of the block, even those missing from our mempool
+            std::vector<CTransaction> vLockRequests;
+            instantsend.GetAcceptedLockRequests(vLockRequests);
+            ReadStatus status = partialBlock.InitData(cmpctblock, mempool, vLockRequests);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Duplicate short IDs, the block is in flight already, so just request it in full
+                perfCompactBlocksFailed.Increment();
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < partialBlock.GetTxCount(); i++) {
+                if (!partialBlock.IsTxAvailable(i))
+                    req.vIndexes.push_back(i);
+            }
+            if (!req.vIndexes.empty()) {
+                req.blockhash = pindex->GetBlockHash();
+                pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
+                return true;
+            }
+
+            if (partialBlock.FillBlock(block, std::vector<CTransaction>()) != READ_STATUS_OK) {
+                // A short ID matched the wrong transaction
+                perfCompactBlocksFailed.Increment();
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                return true;
+            }
+            perfCompactBlocksReconstructed.Increment();
         }
+        ProcessBlockFromPeer(pfrom, chainparams, block, strCommand);
+    }
 
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || !itInFlight->second.second->partialBlock ||
+                    itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = itInFlight->second.second->partialBlock->FillBlock(block, resp.vtx);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now
+                perfCompactBlocksFailed.Increment();
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                return true;
+            }
+            perfCompactBlocksTxnRequested.Increment();
+        }
+        ProcessBlockFromPeer(pfrom, chainparams, block, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // An older block is never needed for reconstruction. Answering with the full block
+            // makes the peer pay for the disk read with bandwidth, like any other block request.
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom, chainparams.GetConsensus());
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.vIndexes.size(); i++) {
+            if (req.vIndexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.vtx[i] = block.vtx[req.vIndexes[i]];
+        }
+        pfrom->PushMessage(NetMsgType::BLOCKTXN, resp);
     }
 
 
@@ -6380,35 +7403,15 @@ bool ProcessMessages(CNode* pfrom)
         // at this point, any failure means we can delete the current message
         it++;
 
-        // Scan for message start
-        if (memcmp(msg.hdr.pchMessageStart, chainparams.MessageStart(), MESSAGE_START_SIZE) != 0) {
-            LogPrintf("PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), pfrom->id);
-            fOk = false;
-            break;
-        }
-
-        // Read header
+        // The message start, header and checksum were verified as the message was received,
+        // see CNode::ReceiveMsgBytes
         CMessageHeader& hdr = msg.hdr;
-        if (!hdr.IsValid(chainparams.MessageStart()))
-        {
-            LogPrintf("PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d\n", SanitizeString(hdr.GetCommand()), pfrom->id);
-            continue;
-        }
         string strCommand = hdr.GetCommand();
 
         // Message size
         unsigned int nMessageSize = hdr.nMessageSize;
 
-        // Checksum
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = ReadLE32((unsigned char*)&hash);
-        if (nChecksum != hdr.nChecksum)
-        {
-            LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n", __func__,
-               SanitizeString(strCommand), nMessageSize, nChecksum, hdr.nChecksum);
-            continue;
-        }
 
         // Process message
         bool fRet = false;
@@ -6676,6 +7679,13 @@ bool SendMessages(CNode* pto)
                             pto->id, hashToAnnounce.ToString());
                     }
                 }
+            } else if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs && pBestIndex == chainActive.Tip()) {
+                // Only a single new tip is announced in full as a compact block, more than
+                // that means the peer is syncing and fetches blocks itself
+                LogPrint("net", "%s: sending cmpctblock %s to peer=%d\n", __func__,
+                        vHeaders.front().GetHash().ToString(), pto->id);
+                pto->PushPreparedMessage(GetCompactBlockMessage(pBestIndex, consensusParams));
+                state.pindexBestHeaderSent = pBestIndex;
             } else if (!vHeaders.empty()) {
                 if (vHeaders.size() > 1) {
                     LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
@@ -6775,10 +7785,12 @@ bool SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInFlightLimit = state.GetBlocksInFlightLimit();
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInFlightLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex *pindexStalled = NULL;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalled);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
@@ -6786,8 +7798,18 @@ bool SendMessages(CNode* pto)
                     pindex->nHeight, pto->id);
             }
             if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
-                    State(staller)->nStallingSince = nNow;
+                CNodeState *stateStaller = State(staller);
+                if (state.nDownloadRate > 0 && stateStaller->nDownloadRate > 0 &&
+                        state.nDownloadRate >= stateStaller->nDownloadRate * BLOCK_REREQUEST_SPEEDUP) {
+                    // The window is held back by a measurably slower peer: fetch the block it waits for from this
+                    // one instead. Whichever copy arrives first is used, the other one is already known.
+                    vGetData.push_back(CInv(MSG_BLOCK, pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), consensusParams, pindexStalled);
+                    stateStaller->nBlocksReassigned++;
+                    LogPrint("net", "Re-requesting block %s (%d) peer=%d, stalled at peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, pto->id, staller);
+                } else if (stateStaller->nStallingSince == 0) {
+                    stateStaller->nStallingSince = nNow;
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
             }
@@ -6845,10 +7867,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        arenaBlockIndex.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
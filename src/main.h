@@ -34,6 +34,7 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewWriteBehind;
 class CChainParams;
 class CInv;
 class CScriptCheck;
@@ -78,8 +79,16 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer whose download rate is not known yet. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the number of blocks in flight from a single peer once its download rate has been measured. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
+/** Time in seconds a peer's measured download rate should need to deliver all blocks in flight from it. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_TIME = 4;
+/** A peer must have measured this many times the download rate of the peer stalling the download window
+ *  before the block it is waiting for is requested from it instead. */
+static const int64_t BLOCK_REREQUEST_SPEEDUP = 2;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -90,10 +99,20 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of threads scanning the block files for headers during -reindex. */
+static const int MAX_REINDEX_SCAN_THREADS = 8;
+/** Maximum number of threads reading and checking blocks for VerifyDB */
+static const int MAX_VERIFYDB_THREADS = 8;
+/** Number of blocks VerifyDB reads and checks ahead of the block it is at */
+static const int VERIFYDB_READAHEAD_BLOCKS = 64;
+/** Number of blocks read from disk ahead of the one being connected during -reindex. */
+static const unsigned int REINDEX_PREFETCH_BLOCKS = 32;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Share of -dbcache (in percent) the coins cache may keep of unmodified entries after a flush. */
+static const unsigned int COINS_CACHE_RETAIN_PERCENT = 50;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -128,16 +147,20 @@ static const bool DEFAULT_ENABLE_REPLACEMENT = false;
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 
-struct BlockHasher
-{
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers when requested. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to getblocktxn requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers asked to announce new blocks with a cmpctblock message, without an inv or headers round trip. */
+static const unsigned int MAX_CMPCTBLOCK_ANNOUNCERS = 3;
 
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
+/** The storage of the entries of mapBlockIndex */
+extern CBlockIndexArena arenaBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -147,6 +170,8 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
@@ -216,6 +241,11 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/**
+ * Rebuild the block index from the block files for -reindex: scan the files for headers in
+ * parallel, build the index from them and connect the blocks in chain order.
+ */
+bool ReindexBlockFiles(const CChainParams& chainparams);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
@@ -232,6 +262,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the mempool script checking thread */
+void ThreadTxScriptCheck();
 
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
@@ -280,6 +312,11 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/**
+ * Number of blocks to keep in flight from a peer that delivers nBytesPerSecond in blocks of
+ * nBlockSize bytes on average, or MAX_BLOCKS_IN_TRANSIT_PER_PEER while either is unknown (0).
+ */
+int GetBlocksInTransitLimit(int64_t nBytesPerSecond, int64_t nBlockSize);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
@@ -291,6 +328,26 @@ void PruneAndFlush();
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
 
+/**
+ * Verify the scripts of transactions about to be passed to AcceptToMemoryPool on the
+ * transaction script check threads, so that AcceptToMemoryPool finds their signatures
+ * in the signature cache. Only transactions that pass the cheap standardness and fee
+ * checks are verified; transactions may spend outputs of earlier ones in vtx. Nothing
+ * is reported, AcceptToMemoryPool still does the authoritative checks. cs_main is held
+ * only to look up the spent outputs, call this without holding it where possible.
+ */
+void PreverifyTransactions(CTxMemPool& pool, const std::vector<CTransaction>& vtx);
+/** Verify the scripts of vtx against the outputs in view on the transaction script check threads (see PreverifyTransactions) */
+void PreverifyTransactionScripts(const std::vector<CTransaction>& vtx, const CCoinsViewCache& view);
+/**
+ * Add a batch of transactions to the memory pool. The scripts of the whole batch are
+ * verified in parallel first, then the transactions are accepted in order under cs_main,
+ * so later ones may spend earlier ones. Returns the number of accepted transactions.
+ */
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransaction>& vtx,
+                                     std::vector<CValidationState>& vState, std::vector<bool>& vAccepted,
+                                     std::vector<bool>& vMissingInputs, bool fLimitFree, bool fRejectAbsurdFee=false);
+
 int GetUTXOHeight(const COutPoint& outpoint);
 int GetInputAge(const CTxIn &txin);
 int GetInputAgeIX(const uint256 &nTXHash, const CTxIn &txin);
@@ -307,6 +364,12 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlightLimit;
+    int64_t nBlocksDownloaded;
+    int64_t nBlockBytesDownloaded;
+    int64_t nDownloadRate;
+    int64_t nDownloadLatency;
+    int nBlocksReassigned;
 };
 
 struct CTimestampIndexIteratorKey {
@@ -714,11 +777,15 @@ public:
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** Read the address index of one address, optionally only the nMaxEntries entries following pkeyAfter */
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0,
+                     const CAddressIndexKey *pkeyAfter = NULL, size_t nMaxEntries = 0);
+/** Read the unspent outputs of one address, optionally only the nMaxEntries entries following pkeyAfter */
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pkeyAfter = NULL, size_t nMaxEntries = 0);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -742,7 +809,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckTxLocks = true);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
@@ -814,6 +881,28 @@ public:
     bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** Progress of the last run of CVerifyDB::VerifyDB */
+struct CVerifyDBProgress
+{
+    bool fRunning;
+    int nCheckLevel;
+    int nBlocks;       //! Number of blocks to check
+    int nChecked;      //! Blocks checked at levels 0-3
+    int nReconnected;  //! Blocks reconnected at level 4
+    int64_t nStartTime;
+    int64_t nEndTime;
+
+    CVerifyDBProgress() : fRunning(false), nCheckLevel(0), nBlocks(0), nChecked(0), nReconnected(0), nStartTime(0), nEndTime(0) {}
+
+    //! Fraction of the work done, level 4 reconnects the blocks checked after checking them all
+    double GetProgress() const;
+    //! Estimated seconds until done, or -1 if unknown
+    int64_t GetRemainingTime() const;
+};
+
+/** Get the progress of the running or last block verification */
+CVerifyDBProgress GetVerifyDBProgress();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -829,6 +918,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the view writing pcoinsTip flushes to the coin database in the background */
+extern CCoinsViewWriteBehind *pcoinsWriter;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -9,6 +9,7 @@
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "netfulfilledman.h"
+#include "perfstats.h"
 #include "spork.h"
 #include "util.h"
 
@@ -358,6 +359,8 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
             mapMasternodePaymentVotes[nHash].MarkAsNotVerified();
         }
 
+        CPerfTimer timer(perfMasternodePaymentVote);
+
         int nFirstBlock = pCurrentBlockIndex->nHeight - GetStorageLimit();
         if(vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > pCurrentBlockIndex->nHeight+20) {
             LogPrint("mnpayments", "MASTERNODEPAYMENTVOTE -- vote out of range: nFirstBlock=%d, nBlockHeight=%d, nHeight=%d\n", nFirstBlock, vote.nBlockHeight, pCurrentBlockIndex->nHeight);
@@ -821,25 +824,29 @@ std::string CMasternodePaymentVote::ToString() const
 // Send only votes for future blocks, node should request every other missing payment block individually
 void CMasternodePayments::Sync(CNode* pnode)
 {
-    LOCK(cs_mapMasternodeBlocks);
-
-    if(!pCurrentBlockIndex) return;
+    // collect the invs under the locks and queue them at once
+    std::vector<CInv> vInv;
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    int nInvCount = 0;
+        if(!pCurrentBlockIndex) return;
 
-    for(int h = pCurrentBlockIndex->nHeight; h < pCurrentBlockIndex->nHeight + 20; h++) {
-        if(mapMasternodeBlocks.count(h)) {
-            BOOST_FOREACH(CMasternodePayee& payee, mapMasternodeBlocks[h].vecPayees) {
+        for(int h = pCurrentBlockIndex->nHeight; h < pCurrentBlockIndex->nHeight + 20; h++) {
+            std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(h);
+            if(it == mapMasternodeBlocks.end()) continue;
+            BOOST_FOREACH(CMasternodePayee& payee, it->second.vecPayees) {
                 std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
-                BOOST_FOREACH(uint256& hash, vecVoteHashes) {
+                BOOST_FOREACH(const uint256& hash, vecVoteHashes) {
                     if(!HasVerifiedPaymentVote(hash)) continue;
-                    pnode->PushInventory(CInv(MSG_MASTERNODE_PAYMENT_VOTE, hash));
-                    nInvCount++;
+                    vInv.push_back(CInv(MSG_MASTERNODE_PAYMENT_VOTE, hash));
                 }
             }
         }
     }
 
+    int nInvCount = vInv.size();
+    pnode->PushInventory(vInv);
+
     LogPrintf("CMasternodePayments::Sync -- Sent %d votes to peer %d\n", nInvCount, pnode->id);
     pnode->PushMessage(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_MNW, nInvCount);
 }
@@ -587,6 +587,7 @@ bool CMasternodeBroadcast::Update(CMasternode* pmn, int& nDos)
         LogPrintf("CMasternodeBroadcast::Update -- Got UPDATED Masternode entry: addr=%s\n", addr.ToString());
         if(pmn->UpdateFromNewBroadcast((*this))) {
             pmn->Check();
+            mnodeman.UpdateMasternodeInv(*pmn);
             Relay();
         }
         masternodeSync.AddedMasternodeList();
@@ -717,7 +718,7 @@ bool CMasternodeBroadcast::CheckSignature(int& nDos)
 void CMasternodeBroadcast::Relay()
 {
     CInv inv(MSG_MASTERNODE_ANNOUNCE, GetHash());
-    RelayInv(inv);
+    RelayInv(inv, CPreparedMessage::Make(NetMsgType::MNANNOUNCE, *this));
 }
 
 CMasternodePing::CMasternodePing(CTxIn& vinNew)
@@ -859,9 +860,12 @@ bool CMasternodePing::CheckAndUpdate(CMasternode* pmn, bool fFromNewBroadcast, i
     uint256 hash = mnb.GetHash();
     if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
         mnodeman.mapSeenMasternodeBroadcast[hash].second.lastPing = *this;
+        // the relayed one has the old ping
+        RemoveRelayInv(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
     }
 
     pmn->Check(true); // force update, ignoring cache
+    mnodeman.UpdateMasternodeInv(*pmn);
     if (!pmn->IsEnabled()) return false;
 
     LogPrint("masternode", "CMasternodePing::CheckAndUpdate -- Masternode ping acceepted and relayed, masternode=%s\n", vin.prevout.ToStringShort());
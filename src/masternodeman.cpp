@@ -128,6 +128,8 @@ bool CMasternodeMan::Add(CMasternode &mn)
         LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
         vMasternodes.push_back(mn);
         indexMasternodes.AddMasternodeVIN(mn.vin);
+        mapMasternodeInvs[mn.vin.prevout] = masternode_inv_t();
+        UpdateMasternodeInv(mn);
         fMasternodesAdded = true;
         return true;
     }
@@ -172,6 +174,7 @@ void CMasternodeMan::Check()
 
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
         mn.Check();
+        UpdateMasternodeInv(mn);
     }
 }
 
@@ -203,6 +206,7 @@ void CMasternodeMan::CheckAndRemove()
                 // erase all of the broadcasts we've seen from this txin, ...
                 mapSeenMasternodeBroadcast.erase(hash);
                 mWeAskedForMasternodeListEntry.erase((*it).vin.prevout);
+                mapMasternodeInvs.erase((*it).vin.prevout);
 
                 // and finally remove it from the list
                 it->FlagGovernanceItemsAsDirty();
@@ -376,6 +380,7 @@ void CMasternodeMan::Clear()
     nLastWatchdogVoteTime = 0;
     indexMasternodes.Clear();
     indexMasternodesOld.Clear();
+    mapMasternodeInvs.clear();
 }
 
 int CMasternodeMan::CountMasternodes(int nProtocolVersion)
@@ -898,35 +903,46 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             }
         } //else, asking for a specific node which is ok
 
-        int nInvCount = 0;
+        // the entries of the list come precomputed from mapMasternodeInvs
+        std::map<COutPoint, masternode_inv_t>::iterator itBegin = mapMasternodeInvs.begin();
+        std::map<COutPoint, masternode_inv_t>::iterator itEnd = mapMasternodeInvs.end();
+        if(vin != CTxIn()) {
+            itBegin = mapMasternodeInvs.find(vin.prevout);
+            itEnd = itBegin;
+            if(itEnd != mapMasternodeInvs.end()) ++itEnd;
+        }
 
-        BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-            if (vin != CTxIn() && vin != mn.vin) continue; // asked for specific vin but we are not there yet
-            if (mn.addr.IsRFC1918() || mn.addr.IsLocal()) continue; // do not send local network masternode
-            if (mn.IsUpdateRequired()) continue; // do not send outdated masternodes
+        std::vector<CInv> vInv;
+        vInv.reserve(2 * std::distance(itBegin, itEnd));
 
-            LogPrint("masternode", "DSEG -- Sending Masternode entry: masternode=%s  addr=%s\n", mn.vin.prevout.ToStringShort(), mn.addr.ToString());
-            CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
-            uint256 hash = mnb.GetHash();
-            pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
-            pfrom->PushInventory(CInv(MSG_MASTERNODE_PING, mn.lastPing.GetHash()));
-            nInvCount++;
+        for(std::map<COutPoint, masternode_inv_t>::iterator it = itBegin; it != itEnd; ++it) {
+            const masternode_inv_t& mninv = it->second;
+            if(!mninv.fAnnounce) continue; // do not send local network or outdated masternodes
 
-            if (!mapSeenMasternodeBroadcast.count(hash)) {
-                mapSeenMasternodeBroadcast.insert(std::make_pair(hash, std::make_pair(GetTime(), mnb)));
-            }
+            LogPrint("masternode", "DSEG -- Sending Masternode entry: masternode=%s\n", it->first.ToStringShort());
+            vInv.push_back(CInv(MSG_MASTERNODE_ANNOUNCE, mninv.hashBroadcast));
+            vInv.push_back(CInv(MSG_MASTERNODE_PING, mninv.hashPing));
 
-            if (vin == mn.vin) {
-                LogPrintf("DSEG -- Sent 1 Masternode inv to peer %d\n", pfrom->id);
-                return;
+            if(!mapSeenMasternodeBroadcast.count(mninv.hashBroadcast)) {
+                CMasternode* pmn = Find(CTxIn(it->first));
+                if(pmn) {
+                    mapSeenMasternodeBroadcast.insert(std::make_pair(mninv.hashBroadcast, std::make_pair(GetTime(), CMasternodeBroadcast(*pmn))));
+                }
             }
         }
 
+        int nInvCount = vInv.size() / 2;
+        pfrom->PushInventory(vInv);
+
         if(vin == CTxIn()) {
             pfrom->PushMessage(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nInvCount);
             LogPrintf("DSEG -- Sent %d Masternode invs to peer %d\n", nInvCount, pfrom->id);
             return;
         }
+        if(nInvCount > 0) {
+            LogPrintf("DSEG -- Sent 1 Masternode inv to peer %d\n", pfrom->id);
+            return;
+        }
         // smth weird happen - someone asked us for vin we have no idea about?
         LogPrint("masternode", "DSEG -- No invs sent to peer %d\n", pfrom->id);
 
@@ -1396,6 +1412,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
             masternodeSync.AddedMasternodeList();
             mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
         }
+        UpdateMasternodeInv(*pmn);
     }
 }
 
@@ -1537,6 +1554,37 @@ void CMasternodeMan::CheckAndRebuildMasternodeIndex()
     nLastIndexRebuildTime = GetTime();
 }
 
+void CMasternodeMan::UpdateMasternodeInv(const CMasternode& mn)
+{
+    LOCK(cs);
+
+    std::map<COutPoint, masternode_inv_t>::iterator it = mapMasternodeInvs.find(mn.vin.prevout);
+    if(it == mapMasternodeInvs.end()) return; // not in the list (yet)
+    masternode_inv_t& mninv = it->second;
+
+    // the hashes only change with a new broadcast or ping
+    if(mninv.hashBroadcast.IsNull() || mninv.sigTime != mn.sigTime || mninv.nPingSigTime != mn.lastPing.sigTime) {
+        mninv.sigTime = mn.sigTime;
+        mninv.nPingSigTime = mn.lastPing.sigTime;
+        mninv.hashBroadcast = CMasternodeBroadcast(mn).GetHash();
+        mninv.hashPing = mn.lastPing.GetHash();
+    }
+
+    // do not send local network or outdated masternodes
+    mninv.fAnnounce = !mn.addr.IsRFC1918() && !mn.addr.IsLocal() && mn.nActiveState != CMasternode::MASTERNODE_UPDATE_REQUIRED;
+}
+
+void CMasternodeMan::RebuildMasternodeInvs()
+{
+    LOCK(cs);
+
+    mapMasternodeInvs.clear();
+    BOOST_FOREACH(const CMasternode& mn, vMasternodes) {
+        mapMasternodeInvs[mn.vin.prevout] = masternode_inv_t();
+        UpdateMasternodeInv(mn);
+    }
+}
+
 void CMasternodeMan::UpdateWatchdogVoteTime(const CTxIn& vin)
 {
     LOCK(cs);
@@ -1582,6 +1630,7 @@ void CMasternodeMan::CheckMasternode(const CTxIn& vin, bool fForce)
         return;
     }
     pMN->Check(fForce);
+    UpdateMasternodeInv(*pMN);
 }
 
 void CMasternodeMan::CheckMasternode(const CPubKey& pubKeyMasternode, bool fForce)
@@ -1592,6 +1641,7 @@ void CMasternodeMan::CheckMasternode(const CPubKey& pubKeyMasternode, bool fForc
         return;
     }
     pMN->Check(fForce);
+    UpdateMasternodeInv(*pMN);
 }
 
 int CMasternodeMan::GetMasternodeState(const CTxIn& vin)
@@ -1633,11 +1683,14 @@ void CMasternodeMan::SetMasternodeLastPing(const CTxIn& vin, const CMasternodePi
     }
     pMN->lastPing = mnp;
     mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+    UpdateMasternodeInv(*pMN);
 
     CMasternodeBroadcast mnb(*pMN);
     uint256 hash = mnb.GetHash();
     if(mapSeenMasternodeBroadcast.count(hash)) {
         mapSeenMasternodeBroadcast[hash].second.lastPing = mnp;
+        // the relayed one has the old ping
+        RemoveRelayInv(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
     }
 }
 
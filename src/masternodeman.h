@@ -14,6 +14,27 @@ class CMasternodeMan;
 
 extern CMasternodeMan mnodeman;
 
+/**
+ * Inventory of a masternode as announced in DSEG replies, kept up to date with the list
+ * so that replies don't have to build a broadcast and hash it for every masternode
+ */
+struct masternode_inv_t
+{
+    masternode_inv_t()
+        : sigTime(0),
+          nPingSigTime(0),
+          hashBroadcast(),
+          hashPing(),
+          fAnnounce(false)
+        {}
+
+    int64_t sigTime; //mnb message time the hashes were computed for
+    int64_t nPingSigTime; //mnp message time the hashes were computed for
+    uint256 hashBroadcast;
+    uint256 hashPing;
+    bool fAnnounce; //routable and up to date, i.e. sent in DSEG replies
+};
+
 /**
  * Provides a forward and reverse index between MN vin's and integers.
  *
@@ -150,6 +171,9 @@ private:
 
     std::vector<uint256> vecDirtyGovernanceObjectHashes;
 
+    // DSEG reply snapshot, an entry per masternode in vMasternodes
+    std::map<COutPoint, masternode_inv_t> mapMasternodeInvs;
+
     int64_t nLastWatchdogVoteTime;
 
     friend class CMasternodeSync;
@@ -194,6 +218,9 @@ public:
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
+        if(ser_action.ForRead()) {
+            RebuildMasternodeInvs();
+        }
     }
 
     CMasternodeMan();
@@ -325,6 +352,10 @@ public:
 
     void CheckAndRebuildMasternodeIndex();
 
+    /// Bring the DSEG reply entry of a masternode in the list up to date, call after changing it
+    void UpdateMasternodeInv(const CMasternode& mn);
+    void RebuildMasternodeInvs();
+
     void AddDirtyGovernanceObjectHash(const uint256& nHash)
     {
         LOCK(cs);
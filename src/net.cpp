@@ -16,6 +16,7 @@
 #include "consensus/consensus.h"
 #include "crypto/common.h"
 #include "hash.h"
+#include "perfstats.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
 #include "ui_interface.h"
@@ -96,7 +97,7 @@ std::string strSubVersion;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CPreparedMessage> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -337,6 +338,10 @@ uint64_t CNode::nTotalBytesSent = 0;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
 
+int64_t CNode::nPeerUploadRate = 0;
+CCriticalSection CNode::cs_rateBulkUpload;
+CRateLimiter CNode::rateBulkUpload;
+
 uint64_t CNode::nMaxOutboundLimit = 0;
 uint64_t CNode::nMaxOutboundTotalBytesSentInCycle = 0;
 uint64_t CNode::nMaxOutboundTimeframe = 60*60*24; //1 day
@@ -701,6 +706,23 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         nBytes -= handled;
 
         if (msg.complete()) {
+            // Validate here, so the message handler thread only gets intact messages
+            if (memcmp(msg.hdr.pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0) {
+                LogPrintf("PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), id);
+                return false;
+            }
+            if (!msg.hdr.IsValid(Params().MessageStart())) {
+                LogPrintf("PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), id);
+                vRecvMsg.pop_back();
+                continue;
+            }
+            unsigned int nChecksum = msg.GetChecksum();
+            if (nChecksum != msg.hdr.nChecksum) {
+                LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x peer=%d\n", __func__,
+                    SanitizeString(msg.hdr.GetCommand()), msg.hdr.nMessageSize, nChecksum, msg.hdr.nChecksum, id);
+                vRecvMsg.pop_back();
+                continue;
+            }
             msg.nTime = GetTimeMicros();
             messageHandlerCondition.notify_one();
         }
@@ -745,17 +767,27 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
+    if (vRecv.capacity() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.reserve(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Append rather than resize, so the buffer is not zero filled first
+    vRecv.insert(vRecv.end(), pch, pch + nCopy);
+    hasher.Write((const unsigned char*)pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+unsigned int CNetMessage::GetChecksum()
+{
+    assert(complete());
+    uint256 hash;
+    hasher.Finalize(hash.begin());
+    return ReadLE32(hash.begin());
+}
+
 
 
 
@@ -764,21 +796,32 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 
 
+static CPerfHistogram* const vPerfSendQueue[SEND_PRIORITY_COUNT] = {
+    &perfSendQueueHigh,
+    &perfSendQueueNormal,
+    &perfSendQueueBulk,
+};
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendMsg>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = *it->data;
         assert(data.size() > pnode->nSendOffset);
+        // Rate limits are checked before a message is started, a started one is finished
+        if (pnode->nSendOffset == 0 && !pnode->IsSendAllowed(it->nPriority, GetTimeMicros()))
+            break;
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
+            pnode->ConsumeSendRate(it->nPriority, nBytes);
             if (pnode->nSendOffset == data.size()) {
+                vPerfSendQueue[it->nPriority]->Record(GetTimeMicros() - it->nTimeQueued);
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
                 it++;
@@ -808,6 +851,54 @@ void SocketSendData(CNode *pnode)
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
+void CRateLimiter::SetRate(int64_t nBytesPerSecondIn)
+{
+    nBytesPerSecond = nBytesPerSecondIn;
+    nTokens = nBytesPerSecond;
+    nLastRefill = GetTimeMicros();
+}
+
+bool CRateLimiter::Allow(int64_t nNow)
+{
+    if (!IsLimited())
+        return true;
+    // Refill in whole bytes, leaving the remainder of the elapsed time for the next call
+    int64_t nElapsed = std::min(nNow - nLastRefill, (int64_t)1000000);
+    int64_t nRefill = nElapsed * nBytesPerSecond / 1000000;
+    if (nRefill > 0 || nNow - nLastRefill > 1000000) {
+        nTokens = std::min(nTokens + nRefill, nBytesPerSecond);
+        nLastRefill = nNow;
+    }
+    return nTokens > 0;
+}
+
+static std::map<std::string, SendPriority> MakeSendPriorities()
+{
+    const char* vHigh[] = {
+        NetMsgType::VERSION, NetMsgType::VERACK, NetMsgType::PING, NetMsgType::PONG,
+        NetMsgType::INV, NetMsgType::HEADERS, NetMsgType::GETDATA, NetMsgType::GETHEADERS,
+        NetMsgType::CMPCTBLOCK, NetMsgType::GETBLOCKTXN,
+        NetMsgType::TXLOCKREQUEST, NetMsgType::TXLOCKVOTE, NetMsgType::MNPING,
+    };
+    const char* vBulk[] = {
+        NetMsgType::BLOCK, NetMsgType::MERKLEBLOCK, NetMsgType::MNANNOUNCE,
+        NetMsgType::MNGOVERNANCEOBJECT, NetMsgType::MNGOVERNANCEOBJECTVOTE,
+    };
+    std::map<std::string, SendPriority> mapRet;
+    for (size_t i = 0; i < ARRAYLEN(vHigh); i++)
+        mapRet[vHigh[i]] = SEND_PRIORITY_HIGH;
+    for (size_t i = 0; i < ARRAYLEN(vBulk); i++)
+        mapRet[vBulk[i]] = SEND_PRIORITY_BULK;
+    return mapRet;
+}
+
+SendPriority GetSendPriority(const std::string& strCommand)
+{
+    static const std::map<std::string, SendPriority> mapSendPriority = MakeSendPriorities();
+    std::map<std::string, SendPriority>::const_iterator it = mapSendPriority.find(strCommand);
+    return it == mapSendPriority.end() ? SEND_PRIORITY_NORMAL : it->second;
+}
+
 static list<CNode*> vNodesDisconnected;
 
 struct NodeEvictionCandidate
@@ -1014,6 +1105,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    unsigned int nServiceRound = 0;
     while (true)
     {
         //
@@ -1135,7 +1227,9 @@ void ThreadSocketHandler()
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
                     if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
+                        // Not while held back by a rate limit, the select timeout brings us back here
+                        if (pnode->nSendOffset > 0 || pnode->IsSendAllowed(pnode->vSendMsg.front().nPriority, GetTimeMicros()))
+                            FD_SET(pnode->hSocket, &fdsetSend);
                         continue;
                     }
                 }
@@ -1182,6 +1276,9 @@ void ThreadSocketHandler()
         // Service each socket
         //
         vector<CNode*> vNodesCopy = CopyNodeVector();
+        // Start with another node every time, so they take turns at the -bulkuploadrate budget
+        if (!vNodesCopy.empty())
+            std::rotate(vNodesCopy.begin(), vNodesCopy.begin() + (nServiceRound++ % vNodesCopy.size()), vNodesCopy.end());
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
@@ -2083,6 +2180,20 @@ void CExplicitNetCleanup::callCleanup()
     delete tmp; // Stroustrup's gonna kill me for that
 }
 
+static void AddRelayMessage(const CInv& inv, const CPreparedMessage& msg)
+{
+    LOCK(cs_mapRelay);
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    if (mapRelay.insert(std::make_pair(inv, msg)).second)
+        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+}
+
 void RelayTransaction(const CTransaction& tx)
 {
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -2105,19 +2216,8 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
     int nInv = mapDarksendBroadcastTxes.count(hash) ? MSG_DSTX :
                 (instantsend.HasTxLockRequest(hash) ? MSG_TXLOCK_REQUEST : MSG_TX);
     CInv inv(nInv, hash);
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
-        {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
-
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
+    // Save original serialized message so newer versions are preserved
+    AddRelayMessage(inv, CPreparedMessage(inv.GetCommand(), ss));
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
     {
@@ -2140,6 +2240,16 @@ void RelayInv(CInv &inv, const int minProtoVersion) {
             pnode->PushInventory(inv);
 }
 
+void RelayInv(CInv &inv, const CPreparedMessage& msg, const int minProtoVersion) {
+    AddRelayMessage(inv, msg);
+    RelayInv(inv, minProtoVersion);
+}
+
+void RemoveRelayInv(const CInv& inv) {
+    LOCK(cs_mapRelay);
+    mapRelay.erase(inv);
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2163,6 +2273,13 @@ void CNode::RecordBytesSent(uint64_t bytes)
     nMaxOutboundTotalBytesSentInCycle += bytes;
 }
 
+void CNode::SetUploadRates(int64_t nPeerBytesPerSecond, int64_t nBulkBytesPerSecond)
+{
+    nPeerUploadRate = nPeerBytesPerSecond;
+    LOCK(cs_rateBulkUpload);
+    rateBulkUpload.SetRate(nBulkBytesPerSecond);
+}
+
 void CNode::SetMaxOutboundTarget(uint64_t limit)
 {
     LOCK(cs_totalBytesSent);
@@ -2392,7 +2509,7 @@ unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", DEFAUL
 unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER); }
 
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn, bool fNetworkNodeIn) :
-    ssSend(SER_NETWORK, INIT_PROTO_VERSION),
+    ssSend(SER_NETWORK, INIT_PROTO_VERSION, NetBufferAllocator()),
     addrKnown(5000, 0.001),
     filterInventoryKnown(50000, 0.000001)
 {
@@ -2421,6 +2538,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nSendPriority = SEND_PRIORITY_NORMAL;
+    rateUpload.SetRate(nPeerUploadRate);
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2519,6 +2638,7 @@ void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSen
     ENTER_CRITICAL_SECTION(cs_vSend);
     assert(ssSend.size() == 0);
     ssSend << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+    nSendPriority = GetSendPriority(pszCommand);
     LogPrint("net", "sending: %s ", SanitizeString(pszCommand));
 }
 
@@ -2563,15 +2683,82 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData(NetBufferAllocator()));
+    ssSend.GetAndClear(*pdata);
+    QueueSendMsg(pdata, nSendPriority);
+
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+void CNode::PushPreparedMessage(const CPreparedMessage& msg)
+{
+    PushPreparedMessage(msg, GetSendPriority(msg.GetCommand()));
+}
 
-    // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+void CNode::PushPreparedMessage(const CPreparedMessage& msg, SendPriority nPriority)
+{
+    if (msg.IsNull())
+        return;
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes, prepared) peer=%d\n", SanitizeString(msg.GetCommand()), msg.size() - CMessageHeader::HEADER_SIZE, id);
+
+    QueueSendMsg(msg.GetData(), nPriority);
+}
+
+void CNode::QueueSendMsg(const boost::shared_ptr<const CSerializeData>& data, SendPriority nPriority)
+{
+    // Behind the messages of the same or higher priority, and the one being sent
+    std::deque<CSendMsg>::iterator it = vSendMsg.end();
+    while (it != vSendMsg.begin() && (it - 1)->nPriority > nPriority && !(it - 1 == vSendMsg.begin() && nSendOffset > 0))
+        --it;
+    bool fFront = it == vSendMsg.begin();
+    vSendMsg.insert(it, CSendMsg(data, nPriority, GetTimeMicros()));
+    nSendSize += data->size();
+
+    // If nothing is being sent, attempt "optimistic write"
+    if (fFront)
         SocketSendData(this);
+}
 
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+bool CNode::IsSendAllowed(SendPriority nPriority, int64_t nNow)
+{
+    // Time critical messages are never held back
+    if (nPriority == SEND_PRIORITY_HIGH)
+        return true;
+    if (!rateUpload.Allow(nNow))
+        return false;
+    if (nPriority == SEND_PRIORITY_BULK) {
+        LOCK(cs_rateBulkUpload);
+        return rateBulkUpload.Allow(nNow);
+    }
+    return true;
+}
+
+void CNode::ConsumeSendRate(SendPriority nPriority, size_t nBytes)
+{
+    if (nPriority == SEND_PRIORITY_HIGH)
+        return;
+    rateUpload.Consume(nBytes);
+    if (nPriority == SEND_PRIORITY_BULK) {
+        LOCK(cs_rateBulkUpload);
+        rateBulkUpload.Consume(nBytes);
+    }
+}
+
+CPreparedMessage::CPreparedMessage(const char* pszCommand, const CDataStream& ssPayload) : strCommand(pszCommand)
+{
+    CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION, NetBufferAllocator());
+    ss.reserve(CMessageHeader::HEADER_SIZE + ssPayload.size());
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    ss << hdr;
+    ss += ssPayload;
+
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData(NetBufferAllocator()));
+    ss.GetAndClear(*pdata);
+    data = pdata;
 }
 
 std::vector<unsigned char> CNode::CalculateKeyedNetGroup(CAddress& address)
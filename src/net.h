@@ -8,6 +8,7 @@
 
 #include "bloom.h"
 #include "compat.h"
+#include "hash.h"
 #include "limitedmap.h"
 #include "netbase.h"
 #include "protocol.h"
@@ -26,6 +27,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
@@ -72,6 +74,9 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** The default for -peeruploadrate and -bulkuploadrate, in KB/s. 0 = Unlimited */
+static const unsigned int DEFAULT_PEER_UPLOAD_RATE = 0;
+static const unsigned int DEFAULT_BULK_UPLOAD_RATE = 0;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -165,9 +170,6 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
-extern CCriticalSection cs_mapRelay;
 extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
 
 extern std::vector<std::string> vAddedNodes;
@@ -224,10 +226,11 @@ public:
 
     CDataStream vRecv;              // received message data
     unsigned int nDataPos;
+    CHash256 hasher;                // double SHA256 of the data received so far
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn, NetBufferAllocator()), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn, NetBufferAllocator()) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
@@ -250,8 +253,48 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /** Checksum of the data of a complete message, for comparing with the one in the header */
+    unsigned int GetChecksum();
+};
+
+/**
+ * A message serialized once, header and checksum included, to be queued to any
+ * number of nodes (e.g. a new block or masternode broadcast that all peers ask
+ * for). Copies share the same immutable buffer, which the send queues of the
+ * nodes reference until it is sent.
+ */
+class CPreparedMessage
+{
+private:
+    std::string strCommand;
+    boost::shared_ptr<const CSerializeData> data;
+
+public:
+    CPreparedMessage() {}
+    CPreparedMessage(const char* pszCommand, const CDataStream& ssPayload);
+
+    //! The message with obj as payload, serialized as PushMessage would
+    template <typename T>
+    static CPreparedMessage Make(const char* pszCommand, const T& obj)
+    {
+        CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+        ss << obj;
+        return CPreparedMessage(pszCommand, ss);
+    }
+
+    bool IsNull() const { return !data; }
+    const std::string& GetCommand() const { return strCommand; }
+    //! Size on the wire, header included
+    size_t size() const { return data ? data->size() : 0; }
+    const boost::shared_ptr<const CSerializeData>& GetData() const { return data; }
 };
 
+/** Messages recently relayed, to answer the getdata requests of the peers they were announced to */
+extern std::map<CInv, CPreparedMessage> mapRelay;
+extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+extern CCriticalSection cs_mapRelay;
+
 
 typedef enum BanReason
 {
@@ -314,6 +357,50 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/** Priority classes of outgoing messages, the send queue of a node is kept in this order */
+enum SendPriority {
+    //! Time critical: InstantSend, masternode pings, announcements, handshake and pings
+    SEND_PRIORITY_HIGH,
+    SEND_PRIORITY_NORMAL,
+    //! Historical blocks, governance and masternode list sync
+    SEND_PRIORITY_BULK,
+    SEND_PRIORITY_COUNT
+};
+
+SendPriority GetSendPriority(const std::string& strCommand);
+
+/** A message in the send queue of a node */
+struct CSendMsg {
+    boost::shared_ptr<const CSerializeData> data;
+    SendPriority nPriority;
+    int64_t nTimeQueued; // microseconds
+
+    CSendMsg(const boost::shared_ptr<const CSerializeData>& dataIn, SendPriority nPriorityIn, int64_t nTimeQueuedIn) :
+        data(dataIn), nPriority(nPriorityIn), nTimeQueued(nTimeQueuedIn) {}
+};
+
+/**
+ * Token bucket limiting a rate in bytes per second, with a burst of one second. Sending
+ * only waits for the bucket to be positive and may take it below zero, so messages are
+ * never split and the average rate still holds.
+ */
+class CRateLimiter
+{
+private:
+    int64_t nBytesPerSecond; // 0 for no limit
+    int64_t nTokens;
+    int64_t nLastRefill; // microseconds
+
+public:
+    CRateLimiter() : nBytesPerSecond(0), nTokens(0), nLastRefill(0) {}
+
+    void SetRate(int64_t nBytesPerSecondIn);
+    bool IsLimited() const { return nBytesPerSecond > 0; }
+    //! Whether sending may start at nNow (microseconds)
+    bool Allow(int64_t nNow);
+    void Consume(size_t nBytes) { if (IsLimited()) nTokens -= nBytes; }
+};
+
 /** Information about a peer */
 class CNode
 {
@@ -325,7 +412,9 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendMsg> vSendMsg;
+    SendPriority nSendPriority; // of the message being built in ssSend
+    CRateLimiter rateUpload; // -peeruploadrate, protected by cs_vSend
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -432,6 +521,11 @@ private:
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
 
+    // upload rate limits
+    static int64_t nPeerUploadRate;
+    static CCriticalSection cs_rateBulkUpload;
+    static CRateLimiter rateBulkUpload;
+
     // outbound limit & stats
     static uint64_t nMaxOutboundTotalBytesSentInCycle;
     static uint64_t nMaxOutboundCycleStartTime;
@@ -536,6 +630,21 @@ public:
         }
     }
 
+    //! Queue a batch of invs at once, e.g. a list sync reply
+    void PushInventory(const std::vector<CInv>& vInv)
+    {
+        LOCK(cs_inventory);
+        vInventoryToSend.reserve(vInventoryToSend.size() + vInv.size());
+        BOOST_FOREACH(const CInv& inv, vInv) {
+            if (inv.type == MSG_TX && filterInventoryKnown.contains(inv.hash)) {
+                LogPrint("net", "PushInventory --  filtered inv: %s peer=%d\n", inv.ToString(), id);
+                continue;
+            }
+            vInventoryToSend.push_back(inv);
+        }
+        LogPrint("net", "PushInventory --  %u invs peer=%d\n", vInv.size(), id);
+    }
+
     void PushBlockHash(const uint256 &hash)
     {
         LOCK(cs_inventory);
@@ -555,6 +664,17 @@ public:
 
     void PushVersion();
 
+    //! Queue a message serialized beforehand, without copying it
+    void PushPreparedMessage(const CPreparedMessage& msg);
+    void PushPreparedMessage(const CPreparedMessage& msg, SendPriority nPriority);
+
+    //! Queue a serialized message ahead of those of lower priority, requires LOCK(cs_vSend)
+    void QueueSendMsg(const boost::shared_ptr<const CSerializeData>& data, SendPriority nPriority);
+
+    //! Whether the rate limits allow starting to send a message, requires LOCK(cs_vSend)
+    bool IsSendAllowed(SendPriority nPriority, int64_t nNow);
+    void ConsumeSendRate(SendPriority nPriority, size_t nBytes);
+
 
     void PushMessage(const char* pszCommand)
     {
@@ -807,6 +927,9 @@ public:
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
 
+    //!set the -peeruploadrate and -bulkuploadrate limits in bytes per second, 0 for no limit
+    static void SetUploadRates(int64_t nPeerBytesPerSecond, int64_t nBulkBytesPerSecond);
+
     //!set the max outbound target in bytes
     static void SetMaxOutboundTarget(uint64_t limit);
     static uint64_t GetMaxOutboundTarget();
@@ -841,6 +964,10 @@ class CTransaction;
 void RelayTransaction(const CTransaction& tx);
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
 void RelayInv(CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
+/** Announce inv and answer the getdata requests for it with msg from relay memory */
+void RelayInv(CInv &inv, const CPreparedMessage& msg, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
+/** Drop inv from relay memory, e.g. when the object was updated since it was relayed */
+void RemoveRelayInv(const CInv& inv);
 
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
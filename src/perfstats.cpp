@@ -0,0 +1,154 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perfstats.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+
+CPerfHistogram perfConnectBlockCheck("connectblock_check", "ConnectBlock sanity checks");
+CPerfHistogram perfConnectBlockForks("connectblock_forks", "ConnectBlock fork checks");
+CPerfHistogram perfConnectBlockConnect("connectblock_connect", "ConnectBlock transaction connection, without script verification");
+CPerfHistogram perfConnectBlockVerify("connectblock_verify", "ConnectBlock transaction connection and script verification");
+CPerfHistogram perfConnectBlockIndex("connectblock_index", "ConnectBlock undo and index writing");
+CPerfHistogram perfConnectBlockCallbacks("connectblock_callbacks", "ConnectBlock callbacks");
+CPerfHistogram perfConnectTipLoad("connecttip_load", "ConnectTip loading the block from disk");
+CPerfHistogram perfConnectTipConnect("connecttip_connect", "ConnectTip ConnectBlock call");
+CPerfHistogram perfConnectTipFlush("connecttip_flush", "ConnectTip flushing the coins view");
+CPerfHistogram perfConnectTipChainState("connecttip_chainstate", "ConnectTip writing the chainstate");
+CPerfHistogram perfConnectTipPostProcess("connecttip_postprocess", "ConnectTip mempool and wallet updates");
+CPerfHistogram perfConnectTipTotal("connecttip_total", "ConnectTip in total");
+
+CPerfHistogram perfMempoolAccept("mempool_accept", "AcceptToMemoryPool");
+CPerfCounter perfMempoolAccepted("mempool_accepted", "Transactions accepted to the mempool");
+CPerfCounter perfMempoolRejected("mempool_rejected", "Transactions rejected from the mempool");
+
+CPerfHistogram perfInstantSendLock("instantsend_lock", "InstantSend lock request acceptance to input locking");
+
+CPerfHistogram perfMasternodePaymentVote("mnpayment_vote", "Masternode payment vote processing, after the seen check");
+CPerfHistogram perfGovernanceVote("governance_vote", "Governance vote processing");
+CPerfCounter perfGovernanceVotesAccepted("governance_votes_accepted", "Governance votes accepted");
+CPerfCounter perfGovernanceVotesRejected("governance_votes_rejected", "Governance votes rejected");
+
+CPerfHistogram perfSendQueueHigh("send_queue_high", "Send queue latency of time critical messages");
+CPerfHistogram perfSendQueueNormal("send_queue_normal", "Send queue latency of normal messages");
+CPerfHistogram perfSendQueueBulk("send_queue_bulk", "Send queue latency of historical blocks and sync messages");
+
+CPerfCounter perfCompactBlocksReconstructed("cmpctblock_reconstructed", "Compact blocks reconstructed from the mempool and InstantSend lock requests alone");
+CPerfCounter perfCompactBlocksTxnRequested("cmpctblock_blocktxn", "Compact blocks completed with transactions requested by getblocktxn");
+CPerfCounter perfCompactBlocksFailed("cmpctblock_failed", "Compact blocks that had to be downloaded in full");
+
+CPerfHistogram::CPerfHistogram(const char* pszNameIn, const char* pszHelpIn) :
+    pszName(pszNameIn),
+    pszHelp(pszHelpIn),
+    nSumMicros(0),
+    nMaxMicros(0)
+{
+    for (size_t i = 0; i <= PERF_LATENCY_BUCKETS_COUNT; i++)
+        vBuckets[i] = 0;
+}
+
+void CPerfHistogram::Record(int64_t nMicros)
+{
+    // The clock is not monotonic
+    if (nMicros < 0)
+        nMicros = 0;
+    size_t nBucket = std::lower_bound(PERF_LATENCY_BUCKETS, PERF_LATENCY_BUCKETS + PERF_LATENCY_BUCKETS_COUNT, nMicros) - PERF_LATENCY_BUCKETS;
+    vBuckets[nBucket].fetch_add(1, boost::memory_order_relaxed);
+    nSumMicros.fetch_add(nMicros, boost::memory_order_relaxed);
+    uint64_t nMax = nMaxMicros.load(boost::memory_order_relaxed);
+    while ((uint64_t)nMicros > nMax && !nMaxMicros.compare_exchange_weak(nMax, nMicros, boost::memory_order_relaxed));
+}
+
+std::vector<uint64_t> CPerfHistogram::GetBuckets() const
+{
+    std::vector<uint64_t> vRet(PERF_LATENCY_BUCKETS_COUNT + 1);
+    for (size_t i = 0; i <= PERF_LATENCY_BUCKETS_COUNT; i++)
+        vRet[i] = vBuckets[i].load(boost::memory_order_relaxed);
+    return vRet;
+}
+
+const std::vector<const CPerfHistogram*>& GetPerfHistograms()
+{
+    static const CPerfHistogram* const histograms[] = {
+        &perfConnectBlockCheck,
+        &perfConnectBlockForks,
+        &perfConnectBlockConnect,
+        &perfConnectBlockVerify,
+        &perfConnectBlockIndex,
+        &perfConnectBlockCallbacks,
+        &perfConnectTipLoad,
+        &perfConnectTipConnect,
+        &perfConnectTipFlush,
+        &perfConnectTipChainState,
+        &perfConnectTipPostProcess,
+        &perfConnectTipTotal,
+        &perfMempoolAccept,
+        &perfInstantSendLock,
+        &perfMasternodePaymentVote,
+        &perfGovernanceVote,
+        &perfSendQueueHigh,
+        &perfSendQueueNormal,
+        &perfSendQueueBulk,
+    };
+    static const std::vector<const CPerfHistogram*> vHistograms(histograms, histograms + sizeof(histograms) / sizeof(histograms[0]));
+    return vHistograms;
+}
+
+const std::vector<const CPerfCounter*>& GetPerfCounters()
+{
+    static const CPerfCounter* const counters[] = {
+        &perfMempoolAccepted,
+        &perfMempoolRejected,
+        &perfGovernanceVotesAccepted,
+        &perfGovernanceVotesRejected,
+        &perfCompactBlocksReconstructed,
+        &perfCompactBlocksTxnRequested,
+        &perfCompactBlocksFailed,
+    };
+    static const std::vector<const CPerfCounter*> vCounters(counters, counters + sizeof(counters) / sizeof(counters[0]));
+    return vCounters;
+}
+
+/** Microseconds as exact decimal seconds, e.g. 2500 as "0.0025" */
+static std::string FormatSeconds(uint64_t nMicros)
+{
+    std::string str = strprintf("%d.%06d", nMicros / 1000000, nMicros % 1000000);
+    str.erase(str.find_last_not_of('0') + 1);
+    if (str[str.size() - 1] == '.')
+        str.erase(str.size() - 1);
+    return str;
+}
+
+std::string FormatPerfStatsText(const std::string& strPrefix)
+{
+    std::string strRet;
+    const std::vector<const CPerfHistogram*>& vHistograms = GetPerfHistograms();
+    for (size_t i = 0; i < vHistograms.size(); i++) {
+        const CPerfHistogram& histogram = *vHistograms[i];
+        std::string strName = strPrefix + histogram.GetName() + "_seconds";
+        // Read the buckets first, so the count never falls behind them
+        std::vector<uint64_t> vBuckets = histogram.GetBuckets();
+        uint64_t nSumMicros = histogram.GetSumMicros();
+        strRet += strprintf("# HELP %s %s\n", strName, histogram.GetHelp());
+        strRet += strprintf("# TYPE %s histogram\n", strName);
+        uint64_t nCumulative = 0;
+        for (size_t j = 0; j < vBuckets.size(); j++) {
+            nCumulative += vBuckets[j];
+            std::string strBound = j < PERF_LATENCY_BUCKETS_COUNT ? FormatSeconds(PERF_LATENCY_BUCKETS[j]) : "+Inf";
+            strRet += strprintf("%s_bucket{le=\"%s\"} %d\n", strName, strBound, nCumulative);
+        }
+        strRet += strprintf("%s_sum %s\n", strName, FormatSeconds(nSumMicros));
+        strRet += strprintf("%s_count %d\n", strName, nCumulative);
+    }
+    const std::vector<const CPerfCounter*>& vCounters = GetPerfCounters();
+    for (size_t i = 0; i < vCounters.size(); i++) {
+        std::string strName = strPrefix + vCounters[i]->GetName() + "_total";
+        strRet += strprintf("# HELP %s %s\n", strName, vCounters[i]->GetHelp());
+        strRet += strprintf("# TYPE %s counter\n", strName);
+        strRet += strprintf("%s %d\n", strName, vCounters[i]->Get());
+    }
+    return strRet;
+}
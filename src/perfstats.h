@@ -0,0 +1,134 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PERFSTATS_H
+#define BITCOIN_PERFSTATS_H
+
+#include "utiltime.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+
+/** Upper bounds (in microseconds) of the buckets of every latency histogram */
+static const int64_t PERF_LATENCY_BUCKETS[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+static const size_t PERF_LATENCY_BUCKETS_COUNT = sizeof(PERF_LATENCY_BUCKETS) / sizeof(PERF_LATENCY_BUCKETS[0]);
+
+/**
+ * Latency histogram of a processing stage. Recording only updates relaxed atomics,
+ * so the histograms are always on.
+ */
+class CPerfHistogram
+{
+private:
+    const char* pszName;
+    const char* pszHelp;
+    boost::atomic<uint64_t> nSumMicros;
+    boost::atomic<uint64_t> nMaxMicros;
+    /** One counter per bucket in PERF_LATENCY_BUCKETS plus one for anything slower */
+    boost::atomic<uint64_t> vBuckets[PERF_LATENCY_BUCKETS_COUNT + 1];
+
+    CPerfHistogram(const CPerfHistogram&);
+    CPerfHistogram& operator=(const CPerfHistogram&);
+
+public:
+    CPerfHistogram(const char* pszNameIn, const char* pszHelpIn);
+
+    void Record(int64_t nMicros);
+
+    const char* GetName() const { return pszName; }
+    const char* GetHelp() const { return pszHelp; }
+    uint64_t GetSumMicros() const { return nSumMicros.load(boost::memory_order_relaxed); }
+    uint64_t GetMaxMicros() const { return nMaxMicros.load(boost::memory_order_relaxed); }
+    /** Bucket counts, the count of all records is their sum */
+    std::vector<uint64_t> GetBuckets() const;
+};
+
+/** Monotonic event counter */
+class CPerfCounter
+{
+private:
+    const char* pszName;
+    const char* pszHelp;
+    boost::atomic<uint64_t> nValue;
+
+    CPerfCounter(const CPerfCounter&);
+    CPerfCounter& operator=(const CPerfCounter&);
+
+public:
+    CPerfCounter(const char* pszNameIn, const char* pszHelpIn) : pszName(pszNameIn), pszHelp(pszHelpIn), nValue(0) {}
+
+    void Increment(uint64_t n = 1) { nValue.fetch_add(n, boost::memory_order_relaxed); }
+
+    const char* GetName() const { return pszName; }
+    const char* GetHelp() const { return pszHelp; }
+    uint64_t Get() const { return nValue.load(boost::memory_order_relaxed); }
+};
+
+/** Records the time from its construction to its destruction into a histogram */
+class CPerfTimer
+{
+private:
+    CPerfHistogram& histogram;
+    int64_t nTimeStart;
+
+public:
+    CPerfTimer(CPerfHistogram& histogramIn) : histogram(histogramIn), nTimeStart(GetTimeMicros()) {}
+    ~CPerfTimer() { histogram.Record(GetTimeMicros() - nTimeStart); }
+};
+
+/** Block validation, see ConnectBlock() and ConnectTip() */
+extern CPerfHistogram perfConnectBlockCheck;
+extern CPerfHistogram perfConnectBlockForks;
+extern CPerfHistogram perfConnectBlockConnect;
+extern CPerfHistogram perfConnectBlockVerify;
+extern CPerfHistogram perfConnectBlockIndex;
+extern CPerfHistogram perfConnectBlockCallbacks;
+extern CPerfHistogram perfConnectTipLoad;
+extern CPerfHistogram perfConnectTipConnect;
+extern CPerfHistogram perfConnectTipFlush;
+extern CPerfHistogram perfConnectTipChainState;
+extern CPerfHistogram perfConnectTipPostProcess;
+extern CPerfHistogram perfConnectTipTotal;
+
+/** Mempool admission */
+extern CPerfHistogram perfMempoolAccept;
+extern CPerfCounter perfMempoolAccepted;
+extern CPerfCounter perfMempoolRejected;
+
+/** Time from accepting an InstantSend lock request to locking its inputs */
+extern CPerfHistogram perfInstantSendLock;
+
+/** Masternode payment and governance vote processing */
+extern CPerfHistogram perfMasternodePaymentVote;
+extern CPerfHistogram perfGovernanceVote;
+extern CPerfCounter perfGovernanceVotesAccepted;
+extern CPerfCounter perfGovernanceVotesRejected;
+
+/** Time from queueing a message for a peer to writing its last byte to the socket, per SendPriority */
+extern CPerfHistogram perfSendQueueHigh;
+extern CPerfHistogram perfSendQueueNormal;
+extern CPerfHistogram perfSendQueueBulk;
+
+/** Compact blocks by how they were reconstructed */
+extern CPerfCounter perfCompactBlocksReconstructed;
+extern CPerfCounter perfCompactBlocksTxnRequested;
+extern CPerfCounter perfCompactBlocksFailed;
+
+/** All histograms and counters, in a fixed order */
+const std::vector<const CPerfHistogram*>& GetPerfHistograms();
+const std::vector<const CPerfCounter*>& GetPerfCounters();
+
+/**
+ * All metrics in the Prometheus text exposition format (version 0.0.4), with latencies
+ * in seconds and every name prefixed by strPrefix.
+ */
+std::string FormatPerfStatsText(const std::string& strPrefix);
+
+#endif // BITCOIN_PERFSTATS_H
@@ -3,12 +3,16 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "masternodeman.h"
+#include "perfstats.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "restformat.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
@@ -24,6 +28,7 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_SPENTINFO_OUTPOINTS = 1000; //allow a max of 1000 outpoints per spentinfo query
 
 enum RetFormat {
     RF_UNDEF,
@@ -59,9 +64,9 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSONStream(CJSONStreamWriter& writer);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -126,6 +131,89 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/** Chain state a page of a bulk endpoint was read at, captured before reading */
+struct CRESTPageHeader {
+    int32_t nHeight;
+    uint256 hashTip;
+
+    CRESTPageHeader()
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nHeight);
+        READWRITE(hashTip);
+    }
+};
+
+static bool ParsePageCount(const string& strCount, size_t& nCount)
+{
+    int32_t n;
+    if (!ParseInt32(strCount, &n) || n < 1 || (size_t)n > MAX_REST_PAGE_ENTRIES)
+        return false;
+    nCount = n;
+    return true;
+}
+
+/** Cursors are the serialized key of the last record of the previous page */
+template <typename T>
+static vector<unsigned char> MakeCursor(const T& key)
+{
+    CDataStream ssCursor(SER_NETWORK, PROTOCOL_VERSION);
+    ssCursor << key;
+    return vector<unsigned char>(ssCursor.begin(), ssCursor.end());
+}
+
+template <typename T>
+static bool ParseCursor(const string& strCursor, T& key)
+{
+    if (strCursor.empty() || !IsHex(strCursor))
+        return false;
+    vector<unsigned char> vchCursor = ParseHex(strCursor);
+    try {
+        CDataStream ssCursor(vchCursor, SER_NETWORK, PROTOCOL_VERSION);
+        ssCursor >> key;
+        return ssCursor.empty();
+    } catch (const std::ios_base::failure& e) {
+        return false;
+    }
+}
+
+template <typename T>
+static bool RESTPageReply(HTTPRequest* req, RetFormat rf, const CRESTPageHeader& header,
+                          const vector<T>& vRecords, const vector<unsigned char>& vchNext)
+{
+    CDataStream ssPage(SER_NETWORK, PROTOCOL_VERSION);
+    ssPage << header << vRecords << vchNext;
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryPage = ssPage.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryPage);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssPage.begin(), ssPage.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -247,10 +335,10 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONStreamWriter writer(req, HTTP_OK);
+        blockToJSONStream(writer, block, pblockindex, showTxDetails);
+        writer.Raw("\n");
+        writer.Finish();
         return true;
     }
 
@@ -332,15 +420,65 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONStreamWriter writer(req, HTTP_OK);
+        mempoolToJSONStream(writer);
+        writer.Raw("\n");
+        writer.Finish();
         return true;
     }
+    case RF_BINARY:
+    case RF_HEX: {
+        // paged by txid: /rest/mempool/contents/<count>[/<cursor>]
+        vector<string> path;
+        if (param.size() > 1 && param[0] == '/') {
+            std::string strPage = param.substr(1);
+            boost::split(path, strPage, boost::is_any_of("/"));
+        }
+        if (path.empty() || path.size() > 2)
+            return RESTERR(req, HTTP_BAD_REQUEST, "No count specified. Use /rest/mempool/contents/<count>[/<cursor>].<ext>.");
+        size_t nCount;
+        if (!ParsePageCount(path[0], nCount))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[0]);
+        uint256 hashAfter;
+        bool fCursor = path.size() == 2;
+        if (fCursor && !ParseCursor(path[1], hashAfter))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[1]);
+
+        CRESTPageHeader header;
+        vector<CRESTMempoolEntry> vRecords;
+        {
+            LOCK(mempool.cs);
+            vector<uint256> vHashes;
+            BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx) {
+                const uint256& hash = e.GetTx().GetHash();
+                if (!fCursor || hashAfter < hash)
+                    vHashes.push_back(hash);
+            }
+            if (vHashes.size() > nCount) {
+                std::nth_element(vHashes.begin(), vHashes.begin() + nCount, vHashes.end());
+                vHashes.resize(nCount);
+            }
+            std::sort(vHashes.begin(), vHashes.end());
+            vRecords.reserve(vHashes.size());
+            BOOST_FOREACH(const uint256& hash, vHashes) {
+                const CTxMemPoolEntry& e = *mempool.mapTx.find(hash);
+                CRESTMempoolEntry entry;
+                entry.txid = hash;
+                entry.nSize = e.GetTxSize();
+                entry.nFee = e.GetFee();
+                entry.nModifiedFee = e.GetModifiedFee();
+                entry.nTime = e.GetTime();
+                entry.nHeight = e.GetHeight();
+                vRecords.push_back(entry);
+            }
+        }
+        vector<unsigned char> vchNext;
+        if (vRecords.size() == nCount)
+            vchNext = MakeCursor(vRecords.back().txid);
+        return RESTPageReply(req, rf, header, vRecords, vchNext);
+    }
     default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
     }
     }
 
@@ -596,6 +734,309 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Parse "<count>/<address>[/<cursor>]" of the /rest/address/ endpoints */
+static bool ParseAddressPage(HTTPRequest* req, const string& param, const string& strEndpoint,
+                             size_t& nCount, uint160& hashBytes, int& type, string& strCursor)
+{
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() < 2 || path.size() > 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/address/" + strEndpoint + "/<count>/<address>[/<cursor>].<ext>.");
+
+    if (!ParsePageCount(path[0], nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[0]);
+
+    CBitcoinAddress address(path[1]);
+    if (!address.GetIndexKey(hashBytes, type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + path[1]);
+
+    strCursor = path.size() == 3 ? path[2] : "";
+
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled");
+    return true;
+}
+
+static bool rest_address_utxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    size_t nCount;
+    uint160 hashBytes;
+    int type;
+    string strCursor;
+    if (!ParseAddressPage(req, param, "utxos", nCount, hashBytes, type, strCursor))
+        return false;
+
+    CAddressUnspentKey keyAfter;
+    if (!strCursor.empty() && (!ParseCursor(strCursor, keyAfter) || keyAfter.hashBytes != hashBytes || (int)keyAfter.type != type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + strCursor);
+
+    CRESTPageHeader header;
+    vector<pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs, strCursor.empty() ? NULL : &keyAfter, nCount))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address");
+
+    vector<CRESTAddressUtxo> vRecords;
+    vRecords.reserve(unspentOutputs.size());
+    for (vector<pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        CRESTAddressUtxo utxo;
+        utxo.txid = it->first.txhash;
+        utxo.nIndex = it->first.index;
+        utxo.nHeight = it->second.blockHeight;
+        utxo.nValue = it->second.satoshis;
+        utxo.script = it->second.script;
+        vRecords.push_back(utxo);
+    }
+
+    vector<unsigned char> vchNext;
+    if (unspentOutputs.size() == nCount)
+        vchNext = MakeCursor(unspentOutputs.back().first);
+    return RESTPageReply(req, rf, header, vRecords, vchNext);
+}
+
+/** Read one page of the address index for the deltas and txids endpoints */
+static bool ReadAddressIndexPage(HTTPRequest* req, const std::string& strURIPart, const string& strEndpoint, RetFormat& rf,
+                                 CRESTPageHeader& header, vector<pair<CAddressIndexKey, CAmount> >& addressIndex,
+                                 vector<unsigned char>& vchNext)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    size_t nCount;
+    uint160 hashBytes;
+    int type;
+    string strCursor;
+    if (!ParseAddressPage(req, param, strEndpoint, nCount, hashBytes, type, strCursor))
+        return false;
+
+    CAddressIndexKey keyAfter;
+    if (!strCursor.empty() && (!ParseCursor(strCursor, keyAfter) || keyAfter.hashBytes != hashBytes || (int)keyAfter.type != type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + strCursor);
+
+    header = CRESTPageHeader();
+    if (!GetAddressIndex(hashBytes, type, addressIndex, 0, 0, strCursor.empty() ? NULL : &keyAfter, nCount))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address");
+
+    if (addressIndex.size() == nCount)
+        vchNext = MakeCursor(addressIndex.back().first);
+
+    // a transaction may span the page boundary, the txids endpoint must not repeat it
+    if (!strCursor.empty() && strEndpoint == "txids") {
+        vector<pair<CAddressIndexKey, CAmount> >::iterator it = addressIndex.begin();
+        while (it != addressIndex.end() && it->first.txhash == keyAfter.txhash)
+            it++;
+        addressIndex.erase(addressIndex.begin(), it);
+    }
+    return true;
+}
+
+static bool rest_address_deltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    RetFormat rf;
+    CRESTPageHeader header;
+    vector<pair<CAddressIndexKey, CAmount> > addressIndex;
+    vector<unsigned char> vchNext;
+    if (!ReadAddressIndexPage(req, strURIPart, "deltas", rf, header, addressIndex, vchNext))
+        return false;
+
+    vector<CRESTAddressDelta> vRecords;
+    vRecords.reserve(addressIndex.size());
+    for (vector<pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        CRESTAddressDelta delta;
+        delta.txid = it->first.txhash;
+        delta.nIndex = it->first.index;
+        delta.nHeight = it->first.blockHeight;
+        delta.nBlockIndex = it->first.txindex;
+        delta.nAmount = it->second;
+        vRecords.push_back(delta);
+    }
+    return RESTPageReply(req, rf, header, vRecords, vchNext);
+}
+
+static bool rest_address_txids(HTTPRequest* req, const std::string& strURIPart)
+{
+    RetFormat rf;
+    CRESTPageHeader header;
+    vector<pair<CAddressIndexKey, CAmount> > addressIndex;
+    vector<unsigned char> vchNext;
+    if (!ReadAddressIndexPage(req, strURIPart, "txids", rf, header, addressIndex, vchNext))
+        return false;
+
+    // entries of one transaction are adjacent in the index
+    vector<uint256> vRecords;
+    for (vector<pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (vRecords.empty() || vRecords.back() != it->first.txhash)
+            vRecords.push_back(it->first.txhash);
+    }
+    return RESTPageReply(req, rf, header, vRecords, vchNext);
+}
+
+static bool rest_spentinfo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // input is either sent over the URI scheme (/rest/spentinfo/txid1-n/txid2-n/...)
+    // or as serialized vector<COutPoint> in the body, the same way as for getutxos
+    vector<COutPoint> vOutPoints;
+    vector<string> uriParts;
+    if (param.length() > 1) {
+        std::string strUriParams = param.substr(1);
+        boost::split(uriParts, strUriParams, boost::is_any_of("/"));
+    }
+    BOOST_FOREACH(const string& strOutPoint, uriParts) {
+        int32_t nOutput;
+        std::string strTxid = strOutPoint.substr(0, strOutPoint.find("-"));
+        std::string strOutput = strOutPoint.substr(strOutPoint.find("-")+1);
+        if (!ParseInt32(strOutput, &nOutput) || !IsHex(strTxid) || strTxid.size() != 64)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        vOutPoints.push_back(COutPoint(uint256S(strTxid), (uint32_t)nOutput));
+    }
+
+    std::string strRequest = req->ReadBody();
+    switch (rf) {
+    case RF_HEX: {
+        std::vector<unsigned char> vchRequest = ParseHex(strRequest);
+        strRequest.assign(vchRequest.begin(), vchRequest.end());
+    }
+
+    case RF_BINARY: {
+        if (strRequest.empty())
+            break;
+        if (!vOutPoints.empty())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Combination of URI scheme inputs and raw post data is not allowed");
+        try {
+            CDataStream oss(strRequest.data(), strRequest.data() + strRequest.size(), SER_NETWORK, PROTOCOL_VERSION);
+            oss >> vOutPoints;
+        } catch (const std::ios_base::failure& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        }
+        break;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+
+    if (vOutPoints.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Error: empty request");
+    if (vOutPoints.size() > MAX_SPENTINFO_OUTPOINTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_SPENTINFO_OUTPOINTS, vOutPoints.size()));
+    if (!fSpentIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled");
+
+    // bitmap of the spent outpoints followed by their spending inputs, like getutxos
+    CRESTPageHeader header;
+    vector<CSpentIndexValue> vSpent;
+    boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        CSpentIndexKey key(vOutPoints[i].hash, vOutPoints[i].n);
+        CSpentIndexValue value;
+        if (GetSpentIndex(key, value)) {
+            hits[i] = true;
+            vSpent.push_back(value);
+        }
+    }
+    vector<unsigned char> bitmap;
+    boost::to_block_range(hits, std::back_inserter(bitmap));
+
+    CDataStream ssSpentInfo(SER_NETWORK, PROTOCOL_VERSION);
+    ssSpentInfo << header << bitmap << vSpent;
+
+    if (rf == RF_BINARY) {
+        string binarySpentInfo = ssSpentInfo.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binarySpentInfo);
+    } else {
+        string strHex = HexStr(ssSpentInfo.begin(), ssSpentInfo.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+    }
+    return true;
+}
+
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    // served during warmup as well, scrapers poll a fixed url
+    if (!strURIPart.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Use /rest/metrics.");
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, FormatPerfStatsText("dash_"));
+    return true;
+}
+
+static bool rest_masternodes(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    // paged by collateral outpoint: /rest/masternodes/<count>[/<cursor>]
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() > 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/masternodes/<count>[/<cursor>].<ext>.");
+    size_t nCount;
+    if (!ParsePageCount(path[0], nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[0]);
+    COutPoint outpointAfter;
+    bool fCursor = path.size() == 2;
+    if (fCursor && !ParseCursor(path[1], outpointAfter))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[1]);
+
+    CRESTPageHeader header;
+    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    std::vector<std::pair<COutPoint, CMasternode*> > vSorted;
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+        if (!fCursor || outpointAfter < mn.vin.prevout)
+            vSorted.push_back(std::make_pair(mn.vin.prevout, &mn));
+    }
+    if (vSorted.size() > nCount) {
+        std::nth_element(vSorted.begin(), vSorted.begin() + nCount, vSorted.end());
+        vSorted.resize(nCount);
+    }
+    std::sort(vSorted.begin(), vSorted.end());
+
+    vector<CRESTMasternode> vRecords;
+    vRecords.reserve(vSorted.size());
+    for (std::vector<std::pair<COutPoint, CMasternode*> >::iterator it = vSorted.begin(); it != vSorted.end(); it++) {
+        CMasternode& mn = *it->second;
+        CRESTMasternode record;
+        record.outpoint = it->first;
+        record.addr = mn.addr;
+        record.payee = mn.pubKeyCollateralAddress.GetID();
+        record.nProtocolVersion = mn.nProtocolVersion;
+        record.strStatus = mn.GetStatus();
+        record.nLastSeen = mn.lastPing.sigTime;
+        record.nActiveSeconds = mn.lastPing.sigTime - mn.sigTime;
+        record.nLastPaidTime = mn.GetLastPaidTime();
+        record.nLastPaidBlock = mn.GetLastPaidBlock();
+        vRecords.push_back(record);
+    }
+
+    vector<unsigned char> vchNext;
+    if (vRecords.size() == nCount)
+        vchNext = MakeCursor(vRecords.back().outpoint);
+    return RESTPageReply(req, rf, header, vRecords, vchNext);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -608,12 +1049,23 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/utxos/", rest_address_utxos},
+      {"/rest/address/deltas/", rest_address_deltas},
+      {"/rest/address/txids/", rest_address_txids},
+      {"/rest/spentinfo", rest_spentinfo},
+      {"/rest/masternodes/", rest_masternodes},
+      {"/rest/metrics", rest_metrics},
 };
 
+static HTTPWorkClass rest_work_class(HTTPRequest* req)
+{
+    return HTTP_WORK_REST;
+}
+
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler, rest_work_class);
     return true;
 }
 
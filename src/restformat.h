@@ -0,0 +1,124 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RESTFORMAT_H
+#define BITCOIN_RESTFORMAT_H
+
+#include "amount.h"
+#include "netbase.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+
+/**
+ * Records of the binary bulk REST endpoints (see doc/REST-interface.md).
+ *
+ * Every page is serialized as
+ *   int32 chain height, uint256 chain tip hash, vector<record>, vector<unsigned char> cursor
+ * where the cursor is empty on the last page and must otherwise be passed
+ * back hex encoded to fetch the next one.
+ */
+
+/** Maximum number of records a client may request per page */
+static const size_t MAX_REST_PAGE_ENTRIES = 10000;
+
+/** /rest/address/utxos */
+struct CRESTAddressUtxo {
+    uint256 txid;
+    uint32_t nIndex;
+    int32_t nHeight;
+    CAmount nValue;
+    CScript script;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(*(CScriptBase*)(&script));
+    }
+};
+
+/** /rest/address/deltas, nAmount is negative for spends */
+struct CRESTAddressDelta {
+    uint256 txid;
+    uint32_t nIndex;
+    int32_t nHeight;
+    uint32_t nBlockIndex;
+    CAmount nAmount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(nHeight);
+        READWRITE(nBlockIndex);
+        READWRITE(nAmount);
+    }
+};
+
+/** /rest/mempool/contents */
+struct CRESTMempoolEntry {
+    uint256 txid;
+    uint32_t nSize;
+    CAmount nFee;
+    CAmount nModifiedFee;
+    int64_t nTime;
+    int32_t nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nSize);
+        READWRITE(nFee);
+        READWRITE(nModifiedFee);
+        READWRITE(nTime);
+        READWRITE(nHeight);
+    }
+};
+
+/** /rest/masternodes, the fields of "masternodelist full" */
+struct CRESTMasternode {
+    COutPoint outpoint;
+    CService addr;
+    CKeyID payee;
+    int32_t nProtocolVersion;
+    std::string strStatus;
+    int64_t nLastSeen;
+    int64_t nActiveSeconds;
+    int64_t nLastPaidTime;
+    int32_t nLastPaidBlock;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(outpoint);
+        READWRITE(addr);
+        READWRITE(payee);
+        READWRITE(nProtocolVersion);
+        READWRITE(strStatus);
+        READWRITE(nLastSeen);
+        READWRITE(nActiveSeconds);
+        READWRITE(nLastPaidTime);
+        READWRITE(nLastPaidBlock);
+    }
+};
+
+#endif // BITCOIN_RESTFORMAT_H
@@ -10,12 +10,14 @@
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -24,6 +26,10 @@
 
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
 using namespace std;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
@@ -128,6 +134,33 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+void blockToJSONStream(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    // The block level fields come from blockToJSON, only the transactions
+    // are produced one at a time so that at most one of them is in memory
+    UniValue result = blockToJSON(block, blockindex, false);
+    std::vector<std::string> keys = result.getKeys();
+    writer.BeginObject();
+    for (unsigned int i = 0; i < keys.size(); i++)
+    {
+        if (txDetails && keys[i] == "tx")
+        {
+            writer.Key(keys[i]);
+            writer.BeginArray();
+            BOOST_FOREACH(const CTransaction&tx, block.vtx)
+            {
+                UniValue objTx(UniValue::VOBJ);
+                TxToJSON(tx, uint256(), objTx);
+                writer.Value(objTx);
+            }
+            writer.EndArray();
+        }
+        else
+            writer.KeyValue(keys[i], result[i]);
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -179,6 +212,37 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
     return GetDifficulty();
 }
 
+static void entryToJSON(UniValue& info, const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(mempool.cs);
+
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+    info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -189,31 +253,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         {
             const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
+            entryToJSON(info, e);
             o.push_back(Pair(hash.ToString(), info));
         }
         return o;
@@ -231,6 +271,20 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** Verbose mempoolToJSON, one entry at a time */
+void mempoolToJSONStream(CJSONStreamWriter& writer)
+{
+    LOCK(mempool.cs);
+    writer.BeginObject();
+    BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+    {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e);
+        writer.KeyValue(e.GetTx().GetHash().ToString(), info);
+    }
+    writer.EndObject();
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -482,6 +536,17 @@ UniValue getblockheaders(const UniValue& params, bool fHelp)
     return arrHeaders;
 }
 
+bool getrawmempool_stream(const UniValue& params, CJSONStreamWriter& result)
+{
+    // Only the verbose form is big enough to be worth streaming
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool())
+        return false;
+
+    LOCK(cs_main);
+    mempoolToJSONStream(result);
+    return true;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -552,6 +617,32 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+bool getblock_stream(const UniValue& params, CJSONStreamWriter& result)
+{
+    if (params.size() < 1 || params.size() > 2 || !params[0].isStr())
+        return false;
+    if (params.size() > 1 && (!params[1].isBool() || !params[1].get_bool()))
+        return false;
+
+    LOCK(cs_main);
+
+    uint256 hash(uint256S(params[0].get_str()));
+    // Errors are left to getblock
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        return false;
+
+    CBlock block;
+    CBlockIndex* pblockindex = mi->second;
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        return false;
+    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        return false;
+
+    blockToJSONStream(result, block, pblockindex);
+    return true;
+}
+
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -590,6 +681,113 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+/** Start of the files written by dumptxoutset */
+static const unsigned char UTXO_DUMP_MAGIC[4] = {'u', 't', 'x', 'o'};
+static const uint32_t UTXO_DUMP_VERSION = 1;
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"filename\"\n"
+            "\nWrites the unspent transaction output set at the current tip to a file.\n"
+            "The file is written from a snapshot of the chainstate, blocks keep being connected meanwhile.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The file to write, relative to the data directory if not absolute.\n"
+            "                  It must not exist yet.\n"
+            "\nThe file holds the 4 bytes \"utxo\", the format version (uint32, currently 1), the hash of\n"
+            "the best block and its height (int32), followed by one record per transaction with unspent\n"
+            "outputs in txid order: the txid and the outputs serialized as in the chainstate (CCoins).\n"
+            "The records end with a null txid, after which follow the number of transactions and of\n"
+            "outputs (uint64 each). Integers are little endian.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filename\": \"path\",     (string) The file written\n"
+            "  \"height\":n,              (numeric) The height of the block the dump is at\n"
+            "  \"bestblock\": \"hex\",     (string) The hash of that block\n"
+            "  \"transactions\": n,       (numeric) The number of transactions\n"
+            "  \"txouts\": n,             (numeric) The number of unspent outputs\n"
+            "  \"total_amount\": x.xxx,   (numeric) The total amount\n"
+            "  \"bytes\": n               (numeric) The size of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".incomplete";
+
+    // Only taking the snapshot needs cs_main, so that it matches the tip
+    boost::scoped_ptr<CCoinsViewCursor> pcursor;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsTip->Cursor());
+        if (!pcursor)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the chainstate");
+        BlockMap::const_iterator mi = mapBlockIndex.find(pcursor->GetBestBlock());
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Best block of the chainstate not found");
+        nHeight = mi->second->nHeight;
+    }
+
+    CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + pathTmp.string() + " for writing");
+
+    uint64_t nTransactions = 0;
+    uint64_t nTransactionOutputs = 0;
+    CAmount nTotalAmount = 0;
+    try {
+        fileout << FLATDATA(UTXO_DUMP_MAGIC) << UTXO_DUMP_VERSION << pcursor->GetBestBlock() << nHeight;
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            CCoins coins;
+            if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the chainstate");
+            fileout << txid << coins;
+            nTransactions++;
+            BOOST_FOREACH(const CTxOut& out, coins.vout) {
+                if (!out.IsNull()) {
+                    nTransactionOutputs++;
+                    nTotalAmount += out.nValue;
+                }
+            }
+        }
+        fileout << uint256() << nTransactions << nTransactionOutputs;
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        if (!RenameOver(pathTmp, path))
+            throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " + pathTmp.string() + " to " + path.string());
+    } catch (const std::ios_base::failure& e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Unable to write %s: %s", pathTmp.string(), e.what()));
+    } catch (...) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        throw;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filename", path.string()));
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("bestblock", pcursor->GetBestBlock().GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)nTransactionOutputs));
+    ret.push_back(Pair("total_amount", ValueFromAmount(nTotalAmount)));
+    ret.push_back(Pair("bytes", (int64_t)boost::filesystem::file_size(path)));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -760,6 +958,28 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) heighest block available\n"
+            "  \"chainstate\": {          (object) the coins cache and its flushes to the coin database\n"
+            "     \"cacheusage\": xxxxx,       (numeric) memory usage of the coins cache in bytes\n"
+            "     \"cachetransactions\": xxx,  (numeric) number of transactions in the coins cache\n"
+            "     \"flushing\": xx,            (boolean) if a flush is being written in the background\n"
+            "     \"flushes\": xxx,            (numeric) number of flushes written since startup\n"
+            "     \"lastflushtime\": xxx,      (numeric) time the last flush completed in seconds since epoch (Jan 1 1970 GMT)\n"
+            "     \"lastflushtransactions\": xxx, (numeric) number of transactions written by the last flush\n"
+            "     \"lastflushbytes\": xxx,     (numeric) memory usage of the entries written by the last flush\n"
+            "     \"lastflushms\": xxx,        (numeric) time the last flush took to write, in milliseconds\n"
+            "     \"totalflushms\": xxx        (numeric) time all flushes took to write, in milliseconds\n"
+            "  },\n"
+            "  \"verification\": {        (object, only after a block verification ran) the checks of the last blocks at startup or by verifychain\n"
+            "     \"running\": xx,             (boolean) if the verification is running; it holds the chain state until done, so only \"chain\"\n"
+            "                                and this object are returned meanwhile\n"
+            "     \"level\": xxx,              (numeric) the check level\n"
+            "     \"blocks\": xxx,             (numeric) the number of blocks to check\n"
+            "     \"checked\": xxx,            (numeric) the number of blocks checked\n"
+            "     \"reconnected\": xxx,        (numeric) the number of blocks reconnected (level 4)\n"
+            "     \"progress\": xxx,           (numeric) estimate of the progress [0..1]\n"
+            "     \"elapsed\": xxx,            (numeric) seconds the verification took so far\n"
+            "     \"eta\": xxx                 (numeric, only while running) estimated seconds until done\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -785,10 +1005,33 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockchaininfo", "")
         );
 
-    LOCK(cs_main);
-
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain",                 Params().NetworkIDString()));
+
+    CVerifyDBProgress verifyProgress = GetVerifyDBProgress();
+    UniValue verification(UniValue::VOBJ);
+    if (verifyProgress.nStartTime != 0) {
+        verification.push_back(Pair("running",      verifyProgress.fRunning));
+        verification.push_back(Pair("level",        verifyProgress.nCheckLevel));
+        verification.push_back(Pair("blocks",       verifyProgress.nBlocks));
+        verification.push_back(Pair("checked",      verifyProgress.nChecked));
+        verification.push_back(Pair("reconnected",  verifyProgress.nReconnected));
+        verification.push_back(Pair("progress",     verifyProgress.GetProgress()));
+        verification.push_back(Pair("elapsed",      (verifyProgress.fRunning ? GetTime() : verifyProgress.nEndTime) - verifyProgress.nStartTime));
+        if (verifyProgress.fRunning)
+            verification.push_back(Pair("eta",      verifyProgress.GetRemainingTime()));
+    }
+    if (verifyProgress.fRunning) {
+        // The verification holds cs_main until it completes, report how far it got instead of waiting
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain) {
+            obj.push_back(Pair("verification",  verification));
+            return obj;
+        }
+    }
+
+    LOCK(cs_main);
+
     obj.push_back(Pair("blocks",                (int)chainActive.Height()));
     obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
     obj.push_back(Pair("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex()));
@@ -817,6 +1060,21 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
 
         obj.push_back(Pair("pruneheight",        block->nHeight));
     }
+
+    CCoinsFlushStats flushStats = pcoinsWriter->GetFlushStats();
+    UniValue chainstate(UniValue::VOBJ);
+    chainstate.push_back(Pair("cacheusage",            (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    chainstate.push_back(Pair("cachetransactions",     (int64_t)pcoinsTip->GetCacheSize()));
+    chainstate.push_back(Pair("flushing",              pcoinsWriter->IsWriting()));
+    chainstate.push_back(Pair("flushes",               (int64_t)flushStats.nFlushes));
+    chainstate.push_back(Pair("lastflushtime",         flushStats.nLastTime));
+    chainstate.push_back(Pair("lastflushtransactions", (int64_t)flushStats.nLastEntries));
+    chainstate.push_back(Pair("lastflushbytes",        (int64_t)flushStats.nLastUsage));
+    chainstate.push_back(Pair("lastflushms",           flushStats.nLastWriteMicros / 1000));
+    chainstate.push_back(Pair("totalflushms",          flushStats.nTotalWriteMicros / 1000));
+    obj.push_back(Pair("chainstate",            chainstate));
+    if (!verification.empty())
+        obj.push_back(Pair("verification",      verification));
     return obj;
 }
 
@@ -952,6 +1210,7 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("indexusage", (int64_t) mempool.IndexMemoryUsage()));
     size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
@@ -970,6 +1229,7 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+            "  \"indexusage\": xxxxx,         (numeric) Part of usage taken by the address and spent indexes\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
             "}\n"
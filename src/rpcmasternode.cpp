@@ -5,6 +5,7 @@
 #include "activemasternode.h"
 #include "darksend.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
@@ -440,6 +441,69 @@ UniValue masternode(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+// Modes of masternodelist which list the masternodes one by one, i.e. all but "rank"
+static bool IsMasternodeListMode(const std::string& strMode)
+{
+    return strMode == "activeseconds" || strMode == "addr" || strMode == "full" ||
+           strMode == "lastseen" || strMode == "lastpaidtime" || strMode == "lastpaidblock" ||
+           strMode == "protocol" || strMode == "payee" || strMode == "status";
+}
+
+// Value of a masternode in one of the IsMasternodeListMode modes, false if it doesn't pass the filter
+static bool MasternodeListEntry(CMasternode& mn, const std::string& strMode, const std::string& strFilter, UniValue& valueRet)
+{
+    std::string strOutpoint = mn.vin.prevout.ToStringShort();
+    if (strMode == "activeseconds") {
+        if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = (int64_t)(mn.lastPing.sigTime - mn.sigTime);
+    } else if (strMode == "addr") {
+        std::string strAddress = mn.addr.ToString();
+        if (strFilter !="" && strAddress.find(strFilter) == std::string::npos &&
+            strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = strAddress;
+    } else if (strMode == "full") {
+        std::ostringstream streamFull;
+        streamFull << std::setw(18) <<
+                       mn.GetStatus() << " " <<
+                       mn.nProtocolVersion << " " <<
+                       CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString() << " " <<
+                       (int64_t)mn.lastPing.sigTime << " " << std::setw(8) <<
+                       (int64_t)(mn.lastPing.sigTime - mn.sigTime) << " " << std::setw(10) <<
+                       mn.GetLastPaidTime() << " "  << std::setw(6) <<
+                       mn.GetLastPaidBlock() << " " <<
+                       mn.addr.ToString();
+        std::string strFull = streamFull.str();
+        if (strFilter !="" && strFull.find(strFilter) == std::string::npos &&
+            strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = strFull;
+    } else if (strMode == "lastpaidblock") {
+        if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = mn.GetLastPaidBlock();
+    } else if (strMode == "lastpaidtime") {
+        if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = mn.GetLastPaidTime();
+    } else if (strMode == "lastseen") {
+        if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = (int64_t)mn.lastPing.sigTime;
+    } else if (strMode == "payee") {
+        CBitcoinAddress address(mn.pubKeyCollateralAddress.GetID());
+        std::string strPayee = address.ToString();
+        if (strFilter !="" && strPayee.find(strFilter) == std::string::npos &&
+            strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = strPayee;
+    } else if (strMode == "protocol") {
+        if (strFilter !="" && strFilter != strprintf("%d", mn.nProtocolVersion) &&
+            strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = (int64_t)mn.nProtocolVersion;
+    } else if (strMode == "status") {
+        std::string strStatus = mn.GetStatus();
+        if (strFilter !="" && strStatus.find(strFilter) == std::string::npos &&
+            strOutpoint.find(strFilter) == std::string::npos) return false;
+        valueRet = strStatus;
+    }
+    return true;
+}
+
 UniValue masternodelist(const UniValue& params, bool fHelp)
 {
     std::string strMode = "status";
@@ -448,10 +512,7 @@ UniValue masternodelist(const UniValue& params, bool fHelp)
     if (params.size() >= 1) strMode = params[0].get_str();
     if (params.size() == 2) strFilter = params[1].get_str();
 
-    if (fHelp || (
-                strMode != "activeseconds" && strMode != "addr" && strMode != "full" &&
-                strMode != "lastseen" && strMode != "lastpaidtime" && strMode != "lastpaidblock" &&
-                strMode != "protocol" && strMode != "payee" && strMode != "rank" && strMode != "status"))
+    if (fHelp || (strMode != "rank" && !IsMasternodeListMode(strMode)))
     {
         throw std::runtime_error(
                 "masternodelist ( \"mode\" \"filter\" )\n"
@@ -493,60 +554,48 @@ UniValue masternodelist(const UniValue& params, bool fHelp)
     } else {
         std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
         BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-            std::string strOutpoint = mn.vin.prevout.ToStringShort();
-            if (strMode == "activeseconds") {
-                if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)(mn.lastPing.sigTime - mn.sigTime)));
-            } else if (strMode == "addr") {
-                std::string strAddress = mn.addr.ToString();
-                if (strFilter !="" && strAddress.find(strFilter) == std::string::npos &&
-                    strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strAddress));
-            } else if (strMode == "full") {
-                std::ostringstream streamFull;
-                streamFull << std::setw(18) <<
-                               mn.GetStatus() << " " <<
-                               mn.nProtocolVersion << " " <<
-                               CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString() << " " <<
-                               (int64_t)mn.lastPing.sigTime << " " << std::setw(8) <<
-                               (int64_t)(mn.lastPing.sigTime - mn.sigTime) << " " << std::setw(10) <<
-                               mn.GetLastPaidTime() << " "  << std::setw(6) <<
-                               mn.GetLastPaidBlock() << " " <<
-                               mn.addr.ToString();
-                std::string strFull = streamFull.str();
-                if (strFilter !="" && strFull.find(strFilter) == std::string::npos &&
-                    strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strFull));
-            } else if (strMode == "lastpaidblock") {
-                if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, mn.GetLastPaidBlock()));
-            } else if (strMode == "lastpaidtime") {
-                if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, mn.GetLastPaidTime()));
-            } else if (strMode == "lastseen") {
-                if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)mn.lastPing.sigTime));
-            } else if (strMode == "payee") {
-                CBitcoinAddress address(mn.pubKeyCollateralAddress.GetID());
-                std::string strPayee = address.ToString();
-                if (strFilter !="" && strPayee.find(strFilter) == std::string::npos &&
-                    strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strPayee));
-            } else if (strMode == "protocol") {
-                if (strFilter !="" && strFilter != strprintf("%d", mn.nProtocolVersion) &&
-                    strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)mn.nProtocolVersion));
-            } else if (strMode == "status") {
-                std::string strStatus = mn.GetStatus();
-                if (strFilter !="" && strStatus.find(strFilter) == std::string::npos &&
-                    strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strStatus));
-            }
+            UniValue value;
+            if (MasternodeListEntry(mn, strMode, strFilter, value))
+                obj.push_back(Pair(mn.vin.prevout.ToStringShort(), value));
         }
     }
     return obj;
 }
 
+bool masternodelist_stream(const UniValue& params, CJSONStreamWriter& result)
+{
+    // Ranks are computed for the whole list at once anyway, they and
+    // malformed requests are left to masternodelist
+    if (params.size() > 2)
+        return false;
+    BOOST_FOREACH(const UniValue& param, params.getValues())
+        if (!param.isStr())
+            return false;
+
+    std::string strMode = "status";
+    std::string strFilter = "";
+
+    if (params.size() >= 1) strMode = params[0].get_str();
+    if (params.size() == 2) strFilter = params[1].get_str();
+
+    if (!IsMasternodeListMode(strMode))
+        return false;
+
+    if (strMode == "full" || strMode == "lastpaidtime" || strMode == "lastpaidblock") {
+        mnodeman.UpdateLastPaid();
+    }
+
+    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    result.BeginObject();
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+        UniValue value;
+        if (MasternodeListEntry(mn, strMode, strFilter, value))
+            result.KeyValue(mn.vin.prevout.ToStringShort(), value);
+    }
+    result.EndObject();
+    return true;
+}
+
 bool DecodeHexVecMnb(std::vector<CMasternodeBroadcast>& vecMnb, std::string strHexMnb) {
 
     if (!IsHex(strHexMnb))
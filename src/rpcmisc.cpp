@@ -135,6 +135,7 @@ UniValue debug(const UniValue& params, bool fHelp)
     mapArgs["-debug"] = mapMultiArgs["-debug"][mapMultiArgs["-debug"].size() - 1];
 
     fDebug = mapArgs["-debug"] != "0";
+    UpdateLogCategories();
 
     return "Debug mode: " + (fDebug ? strMode : "off");
 }
@@ -11,6 +11,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
+#include "support/netbufferpool.h"
 #include "sync.h"
 #include "timedata.h"
 #include "ui_interface.h"
@@ -111,7 +112,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) The number of blocks we keep in flight from this peer\n"
+            "    \"blocks_downloaded\": n,    (numeric) The number of requested blocks this peer delivered\n"
+            "    \"block_bytes_downloaded\": n, (numeric) The total size of those blocks\n"
+            "    \"download_rate\": n,        (numeric) The measured block download rate in bytes per second, 0 if unknown\n"
+            "    \"download_latency\": n,     (numeric) The measured time from requesting a block to receiving it, in seconds\n"
+            "    \"blocks_reassigned\": n,    (numeric) The number of blocks requested from a faster peer because this one stalled the download\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -163,6 +170,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInFlightLimit));
+            obj.push_back(Pair("blocks_downloaded", statestats.nBlocksDownloaded));
+            obj.push_back(Pair("block_bytes_downloaded", statestats.nBlockBytesDownloaded));
+            obj.push_back(Pair("download_rate", statestats.nDownloadRate));
+            obj.push_back(Pair("download_latency", statestats.nDownloadLatency / 1e6));
+            obj.push_back(Pair("blocks_reassigned", statestats.nBlocksReassigned));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -456,6 +469,12 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
             "  }\n"
             "  ,...\n"
             "  ]\n"
+            "  \"buffers\": {                           (object) memory of the network message buffers\n"
+            "    \"inuse\": xxxxx,                      (numeric) bytes held by messages being received, queued or relayed\n"
+            "    \"pooled\": xxxxx,                     (numeric) bytes kept for reuse\n"
+            "    \"allocations\": xxxxx,                (numeric) buffers allocated since startup\n"
+            "    \"reused\": xxxxx                      (numeric) of which were reused from the pool\n"
+            "  },\n"
             "  \"warnings\": \"...\"                    (string) any network warnings (such as alert messages) \n"
             "}\n"
             "\nExamples:\n"
@@ -487,6 +506,13 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
         }
     }
     obj.push_back(Pair("localaddresses", localAddresses));
+    CNetBufferPool::Stats bufferStats = CNetBufferPool::Instance().GetStats();
+    UniValue buffers(UniValue::VOBJ);
+    buffers.push_back(Pair("inuse",       (uint64_t)bufferStats.nInUseBytes));
+    buffers.push_back(Pair("pooled",      (uint64_t)bufferStats.nPooledBytes));
+    buffers.push_back(Pair("allocations", bufferStats.nAllocations));
+    buffers.push_back(Pair("reused",      bufferStats.nReused));
+    obj.push_back(Pair("buffers",        buffers));
     obj.push_back(Pair("warnings",       GetWarnings("statusbar")));
     return obj;
 }
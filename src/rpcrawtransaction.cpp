@@ -878,3 +878,76 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 
     return hashTx.GetHex();
 }
+
+UniValue sendrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits several raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The scripts of all transactions are verified in parallel, then they are added to the\n"
+            "memory pool in the given order, so a transaction may spend the outputs of earlier ones.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees  (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array of json objects, in the order of the transactions)\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",   (string) The transaction hash in hex\n"
+            "    \"accepted\" : true|false, (boolean) If the transaction is in the memory pool\n"
+            "    \"error\" : \"text\"   (string, only if not accepted) Why the transaction was rejected\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex1\\\",\\\"signedhex2\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex1\", \"signedhex2\"]")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    const UniValue& hexstrings = params[0].get_array();
+    std::vector<CTransaction> vtx(hexstrings.size());
+    for (unsigned int i = 0; i < hexstrings.size(); i++) {
+        if (!DecodeHexTx(vtx[i], hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+    }
+
+    bool fOverrideFees = false;
+    if (params.size() > 1)
+        fOverrideFees = params[1].get_bool();
+
+    // Scripts are verified without cs_main, which is only taken to add the batch
+    std::vector<CValidationState> vState;
+    std::vector<bool> vAccepted, vMissingInputs;
+    AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false, !fOverrideFees);
+
+    UniValue result(UniValue::VARR);
+    for (unsigned int i = 0; i < vtx.size(); i++) {
+        bool fAccepted = vAccepted[i];
+        std::string strError;
+        if (!fAccepted) {
+            if (vState[i].GetRejectCode() == REJECT_ALREADY_KNOWN) {
+                // already in the memory pool, relay it again like sendrawtransaction does
+                fAccepted = true;
+            } else if (vState[i].IsInvalid()) {
+                strError = strprintf("%i: %s", vState[i].GetRejectCode(), vState[i].GetRejectReason());
+            } else if (vMissingInputs[i]) {
+                strError = "Missing inputs";
+            } else {
+                strError = vState[i].GetRejectReason();
+            }
+        }
+        if (fAccepted)
+            RelayTransaction(vtx[i]);
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", vtx[i].GetHash().GetHex()));
+        entry.push_back(Pair("accepted", fAccepted));
+        if (!fAccepted)
+            entry.push_back(Pair("error", strError));
+        result.push_back(entry);
+    }
+    return result;
+}
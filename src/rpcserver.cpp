@@ -7,13 +7,17 @@
 #include "rpcserver.h"
 
 #include "base58.h"
+#include "httpserver.h"
 #include "init.h"
+#include "perfstats.h"
 #include "random.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <deque>
+
 #include <univalue.h>
 
 #include <boost/bind.hpp>
@@ -39,6 +43,35 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+/** Upper bounds (in microseconds) of the latency histogram buckets kept per method */
+static const int64_t RPC_LATENCY_BUCKETS[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+static const size_t RPC_LATENCY_BUCKETS_COUNT = sizeof(RPC_LATENCY_BUCKETS) / sizeof(RPC_LATENCY_BUCKETS[0]);
+
+/** Call counters and latency histogram of a single RPC method */
+struct CRPCMethodStats
+{
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    /** One counter per bucket in RPC_LATENCY_BUCKETS plus one for anything slower */
+    std::vector<uint64_t> vBuckets;
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0), vBuckets(RPC_LATENCY_BUCKETS_COUNT + 1, 0) {}
+};
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+/* Worker threads and queue for batch element execution */
+static CWaitableCriticalSection cs_rpcBatchQueue;
+static CConditionVariable condRPCBatchQueue;
+static std::deque<boost::function<void ()> > queueRPCBatch;
+static bool fRPCBatchRunning = false;
+static boost::thread_group threadGroupRPCBatch;
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -236,6 +269,284 @@ UniValue help(const UniValue& params, bool fHelp)
     return tableRPC.help(strCommand);
 }
 
+static void RecordRPCCall(const std::string& strMethod, int64_t nMicros, bool fError)
+{
+    LOCK(cs_rpcStats);
+    CRPCMethodStats& stats = mapRPCStats[strMethod];
+    stats.nCalls++;
+    if (fError)
+        stats.nErrors++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    size_t nBucket = std::lower_bound(RPC_LATENCY_BUCKETS, RPC_LATENCY_BUCKETS + RPC_LATENCY_BUCKETS_COUNT, nMicros) - RPC_LATENCY_BUCKETS;
+    stats.vBuckets[nBucket]++;
+}
+
+static UniValue RPCStatsToJSON(const CRPCMethodStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("calls", stats.nCalls));
+    obj.push_back(Pair("errors", stats.nErrors));
+    obj.push_back(Pair("total_us", stats.nTotalMicros));
+    obj.push_back(Pair("max_us", stats.nMaxMicros));
+    UniValue histogram(UniValue::VARR);
+    for (size_t i = 0; i < stats.vBuckets.size(); i++) {
+        UniValue bucket(UniValue::VOBJ);
+        if (i < RPC_LATENCY_BUCKETS_COUNT)
+            bucket.push_back(Pair("le_us", RPC_LATENCY_BUCKETS[i]));
+        else
+            bucket.push_back(Pair("le_us", "inf"));
+        bucket.push_back(Pair("count", stats.vBuckets[i]));
+        histogram.push_back(bucket);
+    }
+    obj.push_back(Pair("histogram", histogram));
+    return obj;
+}
+
+UniValue getrpcstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( \"method\" )\n"
+            "\nReturns call counts and latency histograms of RPC methods executed since startup.\n"
+            "\nArguments:\n"
+            "1. \"method\"     (string, optional) Only return statistics for this method\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\": {            (object) statistics of a single method\n"
+            "    \"calls\": n,          (numeric) number of calls\n"
+            "    \"errors\": n,         (numeric) number of calls which returned an error\n"
+            "    \"total_us\": n,       (numeric) total execution time in microseconds\n"
+            "    \"max_us\": n,         (numeric) slowest execution time in microseconds\n"
+            "    \"histogram\": [       (array) latency histogram\n"
+            "      {\n"
+            "        \"le_us\": n,      (numeric or \"inf\") upper bound of the bucket in microseconds\n"
+            "        \"count\": n       (numeric) number of calls in this bucket\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleCli("getrpcstats", "\"getblock\"")
+            + HelpExampleRpc("getrpcstats", "\"getblock\"")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+
+    LOCK(cs_rpcStats);
+    if (params.size() > 0) {
+        std::map<std::string, CRPCMethodStats>::const_iterator it = mapRPCStats.find(params[0].get_str());
+        if (it != mapRPCStats.end())
+            ret.push_back(Pair(it->first, RPCStatsToJSON(it->second)));
+        return ret;
+    }
+
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapRPCStats.begin(); it != mapRPCStats.end(); ++it)
+        ret.push_back(Pair(it->first, RPCStatsToJSON(it->second)));
+    return ret;
+}
+
+UniValue gethttpstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gethttpstats\n"
+            "\nReturns the state of the HTTP server work queues.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queue\": {              (object) one of rpc, rpccheap and rest\n"
+            "    \"threads\": n,         (numeric) number of worker threads\n"
+            "    \"depth\": n,           (numeric) number of requests waiting\n"
+            "    \"maxdepth\": n,        (numeric) number of requests that may wait before new ones are rejected\n"
+            "    \"peakdepth\": n,       (numeric) highest number of requests that were waiting at once\n"
+            "    \"processed\": n,       (numeric) number of requests taken from the queue\n"
+            "    \"rejected\": n,        (numeric) number of requests rejected because the queue was full\n"
+            "    \"wait_total_us\": n,   (numeric) total time processed requests were waiting in microseconds\n"
+            "    \"wait_max_us\": n      (numeric) longest time a request was waiting in microseconds\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gethttpstats", "")
+            + HelpExampleRpc("gethttpstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    BOOST_FOREACH(const HTTPWorkQueueStats& stats, GetHTTPWorkQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("threads", stats.nThreads));
+        obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        obj.push_back(Pair("maxdepth", (uint64_t)stats.nMaxDepth));
+        obj.push_back(Pair("peakdepth", (uint64_t)stats.nPeakDepth));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("wait_total_us", stats.nWaitTotal));
+        obj.push_back(Pair("wait_max_us", stats.nWaitMax));
+        ret.push_back(Pair(stats.name, obj));
+    }
+    return ret;
+}
+
+static bool CompareLockSiteWait(const CLockSiteInfo& a, const CLockSiteInfo& b)
+{
+    if (a.nWaitMicros != b.nWaitMicros)
+        return a.nWaitMicros > b.nWaitMicros;
+    return a.nAcquired > b.nAcquired;
+}
+
+static UniValue LockHistogramToJSON(const std::vector<uint64_t>& vHistogram)
+{
+    UniValue histogram(UniValue::VARR);
+    for (size_t i = 0; i < vHistogram.size(); i++) {
+        if (vHistogram[i] == 0)
+            continue;
+        UniValue bucket(UniValue::VOBJ);
+        if (i + 1 < vHistogram.size())
+            bucket.push_back(Pair("le_us", ((uint64_t)2 << i) - 1));
+        else
+            bucket.push_back(Pair("le_us", "inf"));
+        bucket.push_back(Pair("count", vHistogram[i]));
+        histogram.push_back(bucket);
+    }
+    return histogram;
+}
+
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getlockstats ( count reset )\n"
+            "\nReturns lock contention statistics per lock site, most waited for first. Requires -lockstats.\n"
+            "\nArguments:\n"
+            "1. count     (numeric, optional, default=20) Number of lock sites to return, 0 for all\n"
+            "2. reset     (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"name\",       (string) the locked mutex as named in the source\n"
+            "    \"site\": \"file:line\",  (string) where it is locked\n"
+            "    \"acquired\": n,         (numeric) number of acquisitions\n"
+            "    \"contended\": n,        (numeric) number of acquisitions which had to wait\n"
+            "    \"wait_us\": n,          (numeric) total wait time in microseconds\n"
+            "    \"wait_max_us\": n,      (numeric) longest wait in microseconds\n"
+            "    \"wait_histogram\": [    (array) wait times of the contended acquisitions, empty buckets omitted\n"
+            "      {\n"
+            "        \"le_us\": n,        (numeric or \"inf\") upper bound of the bucket in microseconds\n"
+            "        \"count\": n         (numeric) number of waits in this bucket\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"hold_samples\": n,     (numeric) number of acquisitions whose hold time was measured\n"
+            "    \"hold_us\": n,          (numeric) total of the measured hold times in microseconds\n"
+            "    \"hold_histogram\": [...] (array) measured hold times, like wait_histogram\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "0 true")
+            + HelpExampleRpc("getlockstats", "10")
+        );
+
+    if (!fLockStats)
+        throw JSONRPCError(RPC_MISC_ERROR, "Lock statistics are disabled, restart with -lockstats");
+
+    size_t nCount = 20;
+    if (params.size() > 0) {
+        if (params[0].get_int() < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must not be negative");
+        nCount = params[0].get_int();
+    }
+
+    std::vector<CLockSiteInfo> vStats;
+    GetLockStats(vStats);
+    if (params.size() > 1 && params[1].get_bool())
+        ResetLockStats();
+    std::sort(vStats.begin(), vStats.end(), CompareLockSiteWait);
+    if (nCount > 0 && vStats.size() > nCount)
+        vStats.resize(nCount);
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const CLockSiteInfo& info, vStats) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", info.strName));
+        obj.push_back(Pair("site", strprintf("%s:%d", info.strFile, info.nLine)));
+        obj.push_back(Pair("acquired", info.nAcquired));
+        obj.push_back(Pair("contended", info.nContended));
+        obj.push_back(Pair("wait_us", info.nWaitMicros));
+        obj.push_back(Pair("wait_max_us", info.nWaitMaxMicros));
+        obj.push_back(Pair("wait_histogram", LockHistogramToJSON(info.vWaitHistogram)));
+        obj.push_back(Pair("hold_samples", info.nHoldSamples));
+        obj.push_back(Pair("hold_us", info.nHoldMicros));
+        obj.push_back(Pair("hold_histogram", LockHistogramToJSON(info.vHoldHistogram)));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getperfstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getperfstats\n"
+            "\nReturns latency histograms and counters of block validation, mempool admission,\n"
+            "InstantSend locking and vote processing since startup.\n"
+            "The same metrics are served in Prometheus text format at /rest/metrics with -rest.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"latencies\": {\n"
+            "    \"stage\": {             (object) latency histogram of a single stage\n"
+            "      \"count\": n,          (numeric) number of times the stage ran\n"
+            "      \"total_us\": n,       (numeric) total time in microseconds\n"
+            "      \"max_us\": n,         (numeric) slowest run in microseconds\n"
+            "      \"histogram\": [       (array) latency histogram\n"
+            "        {\n"
+            "          \"le_us\": n,      (numeric or \"inf\") upper bound of the bucket in microseconds\n"
+            "          \"count\": n       (numeric) number of runs in this bucket\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"counters\": {\n"
+            "    \"name\": n,             (numeric) number of events since startup\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getperfstats", "")
+            + HelpExampleRpc("getperfstats", "")
+        );
+
+    UniValue latencies(UniValue::VOBJ);
+    BOOST_FOREACH(const CPerfHistogram* pHistogram, GetPerfHistograms()) {
+        std::vector<uint64_t> vBuckets = pHistogram->GetBuckets();
+        uint64_t nCount = 0;
+        UniValue histogram(UniValue::VARR);
+        for (size_t i = 0; i < vBuckets.size(); i++) {
+            nCount += vBuckets[i];
+            UniValue bucket(UniValue::VOBJ);
+            if (i < PERF_LATENCY_BUCKETS_COUNT)
+                bucket.push_back(Pair("le_us", PERF_LATENCY_BUCKETS[i]));
+            else
+                bucket.push_back(Pair("le_us", "inf"));
+            bucket.push_back(Pair("count", vBuckets[i]));
+            histogram.push_back(bucket);
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", nCount));
+        obj.push_back(Pair("total_us", pHistogram->GetSumMicros()));
+        obj.push_back(Pair("max_us", pHistogram->GetMaxMicros()));
+        obj.push_back(Pair("histogram", histogram));
+        latencies.push_back(Pair(pHistogram->GetName(), obj));
+    }
+
+    UniValue counters(UniValue::VOBJ);
+    BOOST_FOREACH(const CPerfCounter* pCounter, GetPerfCounters())
+        counters.push_back(Pair(pCounter->GetName(), pCounter->Get()));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("latencies", latencies));
+    ret.push_back(Pair("counters", counters));
+    return ret;
+}
 
 UniValue stop(const UniValue& params, bool fHelp)
 {
@@ -254,156 +565,171 @@ UniValue stop(const UniValue& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  okParallel  okCheap
+  //  --------------------- ------------------------  -----------------------  ----------  ----------  -------
     /* Overall control/query calls */
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "debug",                  &debug,                  true  },
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getinfo",                &getinfo,                true,  true,  false }, /* uses wallet if enabled */
+    { "control",            "debug",                  &debug,                  true,  false, false },
+    { "control",            "help",                   &help,                   true,  true,  true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true,  true,  true  },
+    { "control",            "gethttpstats",           &gethttpstats,           true,  true,  true  },
+    { "control",            "getlockstats",           &getlockstats,           true,  true,  true  },
+    { "control",            "getperfstats",           &getperfstats,           true,  true,  true  },
+    { "control",            "stop",                   &stop,                   true,  false, true  },
 
     /* P2P networking */
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  true,  true  },
+    { "network",            "addnode",                &addnode,                true,  false, false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,  false, false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  true,  false },
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,  true,  true  },
+    { "network",            "getnettotals",           &getnettotals,           true,  true,  true  },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,  true,  false },
+    { "network",            "ping",                   &ping,                   true,  false, true  },
+    { "network",            "setban",                 &setban,                 true,  false, false },
+    { "network",            "listbanned",             &listbanned,             true,  true,  false },
+    { "network",            "clearbanned",            &clearbanned,            true,  false, false },
 
     /* Block chain and UTXO */
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getblockheaders",        &getblockheaders,        true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true,  true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true,  true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  true,  true  },
+    { "blockchain",         "getblock",               &getblock,               true,  true,  false },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,  true,  false },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  true,  true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  true,  true  },
+    { "blockchain",         "getblockheaders",        &getblockheaders,        true,  true,  false },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  true,  false },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true,  true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true,  true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true,  false },
+    { "blockchain",         "gettxout",               &gettxout,               true,  true,  true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  true,  false },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  true,  false },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  true,  false },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  true,  false },
+    { "blockchain",         "verifychain",            &verifychain,            true,  false, false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, true,  true  },
 
     /* Mining */
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  false, false },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  true,  true  },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  true,  false },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  false, false },
+    { "mining",             "submitblock",            &submitblock,            true,  false, false },
 
     /* Coin generation */
-    { "generating",         "getgenerate",            &getgenerate,            true  },
-    { "generating",         "setgenerate",            &setgenerate,            true  },
-    { "generating",         "generate",               &generate,               true  },
+    { "generating",         "getgenerate",            &getgenerate,            true,  false, false },
+    { "generating",         "setgenerate",            &setgenerate,            true,  false, false },
+    { "generating",         "generate",               &generate,               true,  false, false },
 
     /* Raw transactions */
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  true,  true  },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  true,  true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  true,  true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  true,  false },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, false, false },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false, false, false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, false, false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
-    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false },
+    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false, false, false },
 #endif
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  true,  false },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, true,  false },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, true,  false },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, true,  false },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, true,  false },
 
     /* Utility functions */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
-    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
+    { "util",               "createmultisig",         &createmultisig,         true,  true,  false },
+    { "util",               "validateaddress",        &validateaddress,        true,  true,  true  }, /* uses wallet if enabled */
+    { "util",               "verifymessage",          &verifymessage,          true,  true,  true  },
+    { "util",               "estimatefee",            &estimatefee,            true,  true,  true  },
+    { "util",               "estimatepriority",       &estimatepriority,       true,  true,  true  },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,  true,  true  },
+    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true,  true,  true  },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,  false, false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  false, false },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false, false },
 #ifdef ENABLE_WALLET
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true},
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,  false, false },
 #endif
 
     /* Dash features */
-    { "dash",               "masternode",             &masternode,             true  },
-    { "dash",               "masternodelist",         &masternodelist,         true  },
-    { "dash",               "masternodebroadcast",    &masternodebroadcast,    true  },
-    { "dash",               "gobject",                &gobject,                true  },
-    { "dash",               "getgovernanceinfo",      &getgovernanceinfo,      true  },
-    { "dash",               "getsuperblockbudget",    &getsuperblockbudget,    true  },
-    { "dash",               "voteraw",                &voteraw,                true  },
-    { "dash",               "mnsync",                 &mnsync,                 true  },
-    { "dash",               "spork",                  &spork,                  true  },
-    { "dash",               "getpoolinfo",            &getpoolinfo,            true  },
+    { "dash",               "masternode",             &masternode,             true,  false, false },
+    { "dash",               "masternodelist",         &masternodelist,         true,  true,  false },
+    { "dash",               "masternodebroadcast",    &masternodebroadcast,    true,  false, false },
+    { "dash",               "gobject",                &gobject,                true,  false, false },
+    { "dash",               "getgovernanceinfo",      &getgovernanceinfo,      true,  true,  true  },
+    { "dash",               "getsuperblockbudget",    &getsuperblockbudget,    true,  true,  false },
+    { "dash",               "voteraw",                &voteraw,                true,  false, false },
+    { "dash",               "mnsync",                 &mnsync,                 true,  false, true  },
+    { "dash",               "spork",                  &spork,                  true,  false, true  },
+    { "dash",               "getpoolinfo",            &getpoolinfo,            true,  true,  true  },
 #ifdef ENABLE_WALLET
-    { "dash",               "privatesend",            &privatesend,            false },
+    { "dash",               "privatesend",            &privatesend,            false, false, false },
 
     /* Wallet */
-    { "wallet",             "keepass",                &keepass,                true },
-    { "wallet",             "instantsendtoaddress",   &instantsendtoaddress,   false },
-    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true  },
-    { "wallet",             "backupwallet",           &backupwallet,           true  },
-    { "wallet",             "dumpprivkey",            &dumpprivkey,            true  },
-    { "wallet",             "dumpwallet",             &dumpwallet,             true  },
-    { "wallet",             "encryptwallet",          &encryptwallet,          true  },
-    { "wallet",             "getaccountaddress",      &getaccountaddress,      true  },
-    { "wallet",             "getaccount",             &getaccount,             true  },
-    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true  },
-    { "wallet",             "getbalance",             &getbalance,             false },
-    { "wallet",             "getnewaddress",          &getnewaddress,          true  },
-    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
-    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false },
-    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false },
-    { "wallet",             "gettransaction",         &gettransaction,         false },
-    { "wallet",             "abandontransaction",     &abandontransaction,     false },
-    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false },
-    { "wallet",             "getwalletinfo",          &getwalletinfo,          false },
-    { "wallet",             "importprivkey",          &importprivkey,          true  },
-    { "wallet",             "importwallet",           &importwallet,           true  },
-    { "wallet",             "importelectrumwallet",   &importelectrumwallet,   true  },
-    { "wallet",             "importaddress",          &importaddress,          true  },
-    { "wallet",             "importpubkey",           &importpubkey,           true  },
-    { "wallet",             "keypoolrefill",          &keypoolrefill,          true  },
-    { "wallet",             "listaccounts",           &listaccounts,           false },
-    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
-    { "wallet",             "listlockunspent",        &listlockunspent,        false },
-    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false },
-    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false },
-    { "wallet",             "listsinceblock",         &listsinceblock,         false },
-    { "wallet",             "listtransactions",       &listtransactions,       false },
-    { "wallet",             "listunspent",            &listunspent,            false },
-    { "wallet",             "lockunspent",            &lockunspent,            true  },
-    { "wallet",             "move",                   &movecmd,                false },
-    { "wallet",             "sendfrom",               &sendfrom,               false },
-    { "wallet",             "sendmany",               &sendmany,               false },
-    { "wallet",             "sendtoaddress",          &sendtoaddress,          false },
-    { "wallet",             "setaccount",             &setaccount,             true  },
-    { "wallet",             "settxfee",               &settxfee,               true  },
-    { "wallet",             "signmessage",            &signmessage,            true  },
-    { "wallet",             "walletlock",             &walletlock,             true  },
-    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true  },
-    { "wallet",             "walletpassphrase",       &walletpassphrase,       true  },
+    { "wallet",             "keepass",                &keepass,                true,  false, false },
+    { "wallet",             "instantsendtoaddress",   &instantsendtoaddress,   false, false, false },
+    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true,  false, false },
+    { "wallet",             "backupwallet",           &backupwallet,           true,  false, false },
+    { "wallet",             "dumpprivkey",            &dumpprivkey,            true,  false, false },
+    { "wallet",             "dumpwallet",             &dumpwallet,             true,  false, false },
+    { "wallet",             "encryptwallet",          &encryptwallet,          true,  false, false },
+    { "wallet",             "getaccountaddress",      &getaccountaddress,      true,  false, false },
+    { "wallet",             "getaccount",             &getaccount,             true,  false, false },
+    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true,  false, false },
+    { "wallet",             "getbalance",             &getbalance,             false, false, false },
+    { "wallet",             "getnewaddress",          &getnewaddress,          true,  false, false },
+    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true,  false, false },
+    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false, false, false },
+    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false, false, false },
+    { "wallet",             "gettransaction",         &gettransaction,         false, false, false },
+    { "wallet",             "abandontransaction",     &abandontransaction,     false, false, false },
+    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false, false, false },
+    { "wallet",             "getwalletinfo",          &getwalletinfo,          false, false, false },
+    { "wallet",             "importprivkey",          &importprivkey,          true,  false, false },
+    { "wallet",             "importwallet",           &importwallet,           true,  false, false },
+    { "wallet",             "importelectrumwallet",   &importelectrumwallet,   true,  false, false },
+    { "wallet",             "importaddress",          &importaddress,          true,  false, false },
+    { "wallet",             "importpubkey",           &importpubkey,           true,  false, false },
+    { "wallet",             "keypoolrefill",          &keypoolrefill,          true,  false, false },
+    { "wallet",             "listaccounts",           &listaccounts,           false, false, false },
+    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false, false, false },
+    { "wallet",             "listlockunspent",        &listlockunspent,        false, false, false },
+    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false, false, false },
+    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false, false, false },
+    { "wallet",             "listsinceblock",         &listsinceblock,         false, false, false },
+    { "wallet",             "listtransactions",       &listtransactions,       false, false, false },
+    { "wallet",             "listunspent",            &listunspent,            false, false, false },
+    { "wallet",             "lockunspent",            &lockunspent,            true,  false, false },
+    { "wallet",             "move",                   &movecmd,                false, false, false },
+    { "wallet",             "sendfrom",               &sendfrom,               false, false, false },
+    { "wallet",             "sendmany",               &sendmany,               false, false, false },
+    { "wallet",             "sendtoaddress",          &sendtoaddress,          false, false, false },
+    { "wallet",             "setaccount",             &setaccount,             true,  false, false },
+    { "wallet",             "settxfee",               &settxfee,               true,  false, false },
+    { "wallet",             "signmessage",            &signmessage,            true,  false, false },
+    { "wallet",             "walletlock",             &walletlock,             true,  false, false },
+    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true,  false, false },
+    { "wallet",             "walletpassphrase",       &walletpassphrase,       true,  false, false },
 #endif // ENABLE_WALLET
 };
 
+/** Commands whose large results are written out as they are produced */
+static const CRPCStreamCommand vRPCStreamCommands[] =
+{ //  name                      actor (function)
+  //  ------------------------  -----------------------
+    { "getblock",               &getblock_stream         },
+    { "getrawmempool",          &getrawmempool_stream    },
+    { "masternodelist",         &masternodelist_stream   },
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -414,6 +740,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamCommands[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].actor;
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -424,10 +752,35 @@ const CRPCCommand *CRPCTable::operator[](const std::string &name) const
     return (*it).second;
 }
 
+static void ThreadRPCBatchWorker()
+{
+    while (true) {
+        boost::function<void ()> task;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_rpcBatchQueue);
+            while (fRPCBatchRunning && queueRPCBatch.empty())
+                condRPCBatchQueue.wait(lock);
+            if (!fRPCBatchRunning)
+                break;
+            task = queueRPCBatch.front();
+            queueRPCBatch.pop_front();
+        }
+        task();
+    }
+}
+
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
     fRPCRunning = true;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_rpcBatchQueue);
+        fRPCBatchRunning = true;
+    }
+    int nBatchThreads = GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS);
+    LogPrintf("RPC: starting %d batch worker threads\n", std::max(nBatchThreads, 0));
+    for (int i = 0; i < nBatchThreads; i++)
+        threadGroupRPCBatch.create_thread(boost::bind(&TraceThread<void (*)()>, "rpcbatch", &ThreadRPCBatchWorker));
     g_rpcSignals.Started();
     return true;
 }
@@ -443,6 +796,13 @@ void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
     deadlineTimers.clear();
+    {
+        boost::unique_lock<boost::mutex> lock(cs_rpcBatchQueue);
+        fRPCBatchRunning = false;
+        queueRPCBatch.clear();
+        condRPCBatchQueue.notify_all();
+    }
+    threadGroupRPCBatch.join_all();
     g_rpcSignals.Stopped();
 }
 
@@ -526,11 +886,106 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * A run of consecutive batch elements which may be executed concurrently.
+ * Elements are claimed one by one by the HTTP worker thread that received the
+ * batch and by any batch worker threads that picked up a helper task.
+ */
+class CRPCBatchSegment
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    const UniValue& vReq;
+    std::vector<UniValue>& vResults;
+    size_t nNext;
+    size_t nEnd;
+    size_t nRemaining;
+
+public:
+    CRPCBatchSegment(const UniValue& vReqIn, std::vector<UniValue>& vResultsIn, size_t nBegin, size_t nEndIn) :
+        vReq(vReqIn), vResults(vResultsIn), nNext(nBegin), nEnd(nEndIn), nRemaining(nEndIn - nBegin) {}
+
+    /** Execute elements until none are left to claim */
+    void Work()
+    {
+        while (true) {
+            size_t nIdx;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                // vReq and vResults are only touched for claimed elements,
+                // so a late helper never uses them after Wait() returned
+                if (nNext >= nEnd)
+                    return;
+                nIdx = nNext++;
+            }
+            UniValue result = JSONRPCExecOne(vReq[nIdx]);
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                vResults[nIdx] = result;
+                if (--nRemaining == 0)
+                    cond.notify_all();
+            }
+        }
+    }
+
+    /** Block until every element of the segment has been executed */
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nRemaining > 0)
+            cond.wait(lock);
+    }
+};
+
+static bool IsParallelRPCRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return true;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return true; // fails in JSONRequest::parse without side effects
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd == NULL || pcmd->okParallel;
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    const size_t nConcurrency = std::max((int)GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY), 1);
+    std::vector<UniValue> vResults(vReq.size());
+
+    size_t nBegin = 0;
+    while (nBegin < vReq.size()) {
+        if (!IsParallelRPCRequest(vReq[nBegin])) {
+            // state-changing commands wait for everything before them and run alone
+            vResults[nBegin] = JSONRPCExecOne(vReq[nBegin]);
+            nBegin++;
+            continue;
+        }
+
+        size_t nEnd = nBegin + 1;
+        while (nEnd < vReq.size() && IsParallelRPCRequest(vReq[nEnd]))
+            nEnd++;
+
+        boost::shared_ptr<CRPCBatchSegment> segment(new CRPCBatchSegment(vReq, vResults, nBegin, nEnd));
+        size_t nHelpers = std::min(nConcurrency, nEnd - nBegin) - 1;
+        if (nHelpers > 0) {
+            boost::unique_lock<boost::mutex> lock(cs_rpcBatchQueue);
+            if (fRPCBatchRunning && threadGroupRPCBatch.size() > 0) {
+                for (size_t i = 0; i < nHelpers; i++)
+                    queueRPCBatch.push_back(boost::bind(&CRPCBatchSegment::Work, segment));
+                condRPCBatchQueue.notify_all();
+            }
+        }
+        segment->Work();
+        segment->Wait();
+
+        nBegin = nEnd;
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (size_t i = 0; i < vResults.size(); i++)
+        ret.push_back(vResults[i]);
 
     return ret.write() + "\n";
 }
@@ -551,19 +1006,68 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    int64_t nTimeStart = GetTimeMicros();
     try
     {
         // Execute
-        return pcmd->actor(params, false);
+        UniValue result = pcmd->actor(params, false);
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, false);
+        return result;
     }
     catch (const std::exception& e)
     {
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, true);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
+    catch (...)
+    {
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, true);
+        throw;
+    }
 
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStreamWriter &result) const
+{
+    map<string, rpcstreamfn_type>::const_iterator it = mapStreamCommands.find(strMethod);
+    if (it == mapStreamCommands.end())
+        return false;
+
+    // Warmup errors are reported by execute()
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            return false;
+    }
+
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    assert(pcmd);
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    int64_t nTimeStart = GetTimeMicros();
+    try
+    {
+        if (!it->second(params, result))
+            return false;
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, false);
+    }
+    catch (const std::exception& e)
+    {
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, true);
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+    catch (...)
+    {
+        RecordRPCCall(strMethod, GetTimeMicros() - nTimeStart, true);
+        throw;
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+    return true;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
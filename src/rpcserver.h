@@ -20,6 +20,12 @@
 #include <univalue.h>
 
 class CRPCCommand;
+class CJSONStreamWriter;
+
+/** Default number of threads executing elements of batched requests */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+/** Default maximum number of elements of one batch executed at the same time */
+static const int DEFAULT_RPC_BATCH_CONCURRENCY = 4;
 
 namespace RPCServer
 {
@@ -120,6 +126,25 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    /** May run concurrently with neighbouring elements of a batch request */
+    bool okParallel;
+    /** Returns quickly, single calls are served from the cheap RPC work queue (HTTP_WORK_RPC_CHEAP) */
+    bool okCheap;
+};
+
+/**
+ * Streaming variant of a command: writes the result value into the writer
+ * while producing it, instead of returning a UniValue tree.
+ * Returns false, before writing anything, to leave the request to the
+ * regular actor (e.g. for parameters it does not handle or errors).
+ */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStreamWriter& result);
+
+class CRPCStreamCommand
+{
+public:
+    std::string name;
+    rpcstreamfn_type actor;
 };
 
 /**
@@ -129,6 +154,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamCommands;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -143,6 +169,16 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute the streaming variant of a method, if it has one.
+     * @param method   Method to execute
+     * @param params   UniValue Array of arguments (JSON objects)
+     * @param result   Writer receiving the result value
+     * @returns false if nothing was written and the request should go through execute().
+     * @throws an exception (UniValue) when an error happens.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStreamWriter &result) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -262,6 +298,7 @@ extern UniValue decodescript(const UniValue& params, bool fHelp);
 extern UniValue fundrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue signrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue sendrawtransaction(const UniValue& params, bool fHelp);
+extern UniValue sendrawtransactions(const UniValue& params, bool fHelp);
 extern UniValue gettxoutproof(const UniValue& params, bool fHelp);
 extern UniValue verifytxoutproof(const UniValue& params, bool fHelp);
 
@@ -270,6 +307,7 @@ extern UniValue getpoolinfo(const UniValue& params, bool fHelp);
 extern UniValue spork(const UniValue& params, bool fHelp);
 extern UniValue masternode(const UniValue& params, bool fHelp);
 extern UniValue masternodelist(const UniValue& params, bool fHelp);
+extern bool masternodelist_stream(const UniValue& params, CJSONStreamWriter& result);
 extern UniValue masternodebroadcast(const UniValue& params, bool fHelp);
 extern UniValue gobject(const UniValue& params, bool fHelp);
 extern UniValue getgovernanceinfo(const UniValue& params, bool fHelp);
@@ -283,12 +321,15 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern bool getrawmempool_stream(const UniValue& params, CJSONStreamWriter& result);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getblockheaders(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool getblock_stream(const UniValue& params, CJSONStreamWriter& result);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
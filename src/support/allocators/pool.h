@@ -0,0 +1,181 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+
+/**
+ * Memory of a node based container (e.g. the coins cache), handed out from chunks in fixed
+ * size blocks. Freed blocks are kept in per size free lists for reuse, and the chunks are
+ * only released all at once when the resource is destroyed.
+ *
+ * Not thread safe, every container gets a resource of its own (see pool_allocator).
+ */
+class CPoolResource
+{
+public:
+    //! Blocks are multiples of this, which is enough for the nodes stored here
+    static const size_t ALIGN = 8;
+    //! Larger requests (e.g. bucket arrays) go to operator new
+    static const size_t MAX_BLOCK_SIZE = 256;
+    //! Chunks double in size from MIN_CHUNK_SIZE, so short lived containers stay cheap
+    static const size_t MIN_CHUNK_SIZE = 4096;
+    static const size_t MAX_CHUNK_SIZE = 256 * 1024;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* vFreeLists[MAX_BLOCK_SIZE / ALIGN + 1];
+    std::vector<void*> vChunks;
+    char* pAvailable;
+    char* pAvailableEnd;
+    size_t nNextChunkSize;
+    size_t nChunkBytes;
+    size_t nBlockBytes;
+
+    CPoolResource(const CPoolResource&);
+    CPoolResource& operator=(const CPoolResource&);
+
+    static size_t BlockIndex(size_t nBytes) { return (nBytes + ALIGN - 1) / ALIGN; }
+
+    void AllocateChunk()
+    {
+        // Keep what is left of the current chunk for later use
+        while (pAvailableEnd - pAvailable >= (ptrdiff_t)ALIGN) {
+            size_t nIndex = std::min((size_t)(pAvailableEnd - pAvailable) / ALIGN, MAX_BLOCK_SIZE / ALIGN);
+            FreeBlock* pblock = reinterpret_cast<FreeBlock*>(pAvailable);
+            pblock->next = vFreeLists[nIndex];
+            vFreeLists[nIndex] = pblock;
+            pAvailable += nIndex * ALIGN;
+        }
+        void* pchunk = ::operator new(nNextChunkSize);
+        vChunks.push_back(pchunk);
+        pAvailable = static_cast<char*>(pchunk);
+        pAvailableEnd = pAvailable + nNextChunkSize;
+        nChunkBytes += nNextChunkSize;
+        nNextChunkSize = std::min(nNextChunkSize * 2, (size_t)MAX_CHUNK_SIZE);
+    }
+
+public:
+    CPoolResource() : pAvailable(NULL), pAvailableEnd(NULL), nNextChunkSize(MIN_CHUNK_SIZE), nChunkBytes(0), nBlockBytes(0)
+    {
+        std::fill(vFreeLists, vFreeLists + MAX_BLOCK_SIZE / ALIGN + 1, (FreeBlock*)NULL);
+    }
+
+    ~CPoolResource()
+    {
+        for (std::vector<void*>::iterator it = vChunks.begin(); it != vChunks.end(); it++)
+            ::operator delete(*it);
+    }
+
+    void* Allocate(size_t nBytes)
+    {
+        if (nBytes > MAX_BLOCK_SIZE)
+            return ::operator new(nBytes);
+        size_t nIndex = BlockIndex(nBytes);
+        nBlockBytes += nIndex * ALIGN;
+        if (vFreeLists[nIndex] != NULL) {
+            FreeBlock* pblock = vFreeLists[nIndex];
+            vFreeLists[nIndex] = pblock->next;
+            return pblock;
+        }
+        if ((size_t)(pAvailableEnd - pAvailable) < nIndex * ALIGN)
+            AllocateChunk();
+        void* p = pAvailable;
+        pAvailable += nIndex * ALIGN;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nBytes)
+    {
+        if (nBytes > MAX_BLOCK_SIZE) {
+            ::operator delete(p);
+            return;
+        }
+        size_t nIndex = BlockIndex(nBytes);
+        nBlockBytes -= nIndex * ALIGN;
+        FreeBlock* pblock = static_cast<FreeBlock*>(p);
+        pblock->next = vFreeLists[nIndex];
+        vFreeLists[nIndex] = pblock;
+    }
+
+    //! Size of the blocks a request of nBytes takes from the pool
+    static size_t BlockSize(size_t nBytes) { return BlockIndex(nBytes) * ALIGN; }
+
+    //! Bytes held in chunks, including the free blocks
+    size_t ChunkBytes() const { return nChunkBytes; }
+
+    //! Bytes of the blocks in use
+    size_t BlockBytes() const { return nBlockBytes; }
+};
+
+/**
+ * Allocator taking the memory of a container from a CPoolResource of its own, shared by the
+ * rebound copies the container makes. Swapping containers swaps their resources along.
+ */
+template <typename T>
+class pool_allocator
+{
+public:
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T value_type;
+    typedef boost::true_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U> other;
+    };
+
+    boost::shared_ptr<CPoolResource> resource;
+
+    pool_allocator() : resource(new CPoolResource()) {}
+    pool_allocator(const pool_allocator& a) : resource(a.resource) {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U>& a) : resource(a.resource) {}
+
+    //! A copied container gets a resource of its own
+    pool_allocator select_on_container_copy_construction() const { return pool_allocator(); }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    pointer allocate(size_type n, const void* hint = 0)
+    {
+        return static_cast<pointer>(resource->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type n)
+    {
+        resource->Deallocate(p, n * sizeof(T));
+    }
+
+    size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    void construct(pointer p, const T& val) { new ((void*)p) T(val); }
+    void destroy(pointer p) { p->~T(); }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U>& a) const { return resource == a.resource; }
+    template <typename U>
+    bool operator!=(const pool_allocator<U>& a) const { return resource != a.resource; }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
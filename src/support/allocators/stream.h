@@ -0,0 +1,83 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_STREAM_H
+#define BITCOIN_SUPPORT_ALLOCATORS_STREAM_H
+
+#include "support/cleanse.h"
+#include "support/netbufferpool.h"
+
+#include <memory>
+#include <vector>
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+/**
+ * Allocator of the serialization buffers. By default it clears the memory before
+ * freeing it, as the buffers may hold key material (e.g. wallet records). Network
+ * streams use a pooled one instead (see NetBufferAllocator), taking their buffers
+ * from CNetBufferPool without clearing them.
+ */
+template <typename T>
+struct stream_allocator : public std::allocator<T> {
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+#if __cplusplus >= 201103L
+    //! The buffer goes along with its allocator (C++03 containers swap unequal allocators anyway)
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+#endif
+
+    bool fPooled;
+
+    stream_allocator() throw() : fPooled(false) {}
+    explicit stream_allocator(bool fPooledIn) throw() : fPooled(fPooledIn) {}
+    stream_allocator(const stream_allocator& a) throw() : base(a), fPooled(a.fPooled) {}
+    template <typename U>
+    stream_allocator(const stream_allocator<U>& a) throw() : base(a), fPooled(a.fPooled)
+    {
+    }
+    ~stream_allocator() throw() {}
+    template <typename _Other>
+    struct rebind {
+        typedef stream_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        if (fPooled)
+            return static_cast<T*>(CNetBufferPool::Instance().Allocate(sizeof(T) * n));
+        return base::allocate(n, hint);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (fPooled) {
+            CNetBufferPool::Instance().Deallocate(p, sizeof(T) * n);
+            return;
+        }
+        if (p != NULL)
+            memory_cleanse(p, sizeof(T) * n);
+        base::deallocate(p, n);
+    }
+
+    bool operator==(const stream_allocator& a) const { return fPooled == a.fPooled; }
+    bool operator!=(const stream_allocator& a) const { return fPooled != a.fPooled; }
+};
+
+// Byte-vector that clears its contents before deletion, unless it is a network buffer.
+typedef std::vector<char, stream_allocator<char> > CSerializeData;
+
+//! The allocator of the network streams
+inline CSerializeData::allocator_type NetBufferAllocator() { return CSerializeData::allocator_type(true); }
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_STREAM_H
@@ -0,0 +1,71 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/netbufferpool.h"
+
+#include <new>
+
+CNetBufferPool* CNetBufferPool::_instance = NULL;
+boost::once_flag CNetBufferPool::init_flag = BOOST_ONCE_INIT;
+
+CNetBufferPool::CNetBufferPool()
+{
+    stats.nInUseBytes = 0;
+    stats.nPooledBytes = 0;
+    stats.nAllocations = 0;
+    stats.nReused = 0;
+}
+
+int CNetBufferPool::SizeIndex(size_t nBytes)
+{
+    if (nBytes > MAX_BUFFER_SIZE)
+        return -1;
+    int nIndex = 0;
+    while ((MIN_BUFFER_SIZE << nIndex) < nBytes)
+        nIndex++;
+    return nIndex;
+}
+
+void* CNetBufferPool::Allocate(size_t nBytes)
+{
+    int nIndex = SizeIndex(nBytes);
+    size_t nSize = nIndex < 0 ? nBytes : MIN_BUFFER_SIZE << nIndex;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        stats.nAllocations++;
+        stats.nInUseBytes += nSize;
+        if (nIndex >= 0 && !vFree[nIndex].empty()) {
+            void* p = vFree[nIndex].back();
+            vFree[nIndex].pop_back();
+            stats.nPooledBytes -= nSize;
+            stats.nReused++;
+            return p;
+        }
+    }
+    return ::operator new(nSize);
+}
+
+void CNetBufferPool::Deallocate(void* p, size_t nBytes)
+{
+    if (p == NULL)
+        return;
+    int nIndex = SizeIndex(nBytes);
+    size_t nSize = nIndex < 0 ? nBytes : MIN_BUFFER_SIZE << nIndex;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        stats.nInUseBytes -= nSize;
+        if (nIndex >= 0 && stats.nPooledBytes + nSize <= MAX_POOLED_BYTES) {
+            vFree[nIndex].push_back(p);
+            stats.nPooledBytes += nSize;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+CNetBufferPool::Stats CNetBufferPool::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_NETBUFFERPOOL_H
+#define BITCOIN_SUPPORT_NETBUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+
+/**
+ * Buffers of the network streams (received messages, send queues), recycled across
+ * messages and peers. Sizes are rounded up to a power of two and freed buffers are
+ * kept in a free list per size, up to MAX_POOLED_BYTES in total. They hold public
+ * data, so unlike other serialization buffers they are not cleansed when freed.
+ */
+class CNetBufferPool
+{
+public:
+    static const size_t MIN_BUFFER_SIZE = 256;
+    //! Larger buffers are allocated and freed directly
+    static const size_t MAX_BUFFER_SIZE = 4 * 1024 * 1024;
+    static const size_t MAX_POOLED_BYTES = 32 * 1024 * 1024;
+
+    struct Stats {
+        size_t nInUseBytes;     //! handed out and not freed yet, rounded up
+        size_t nPooledBytes;    //! kept in the free lists
+        uint64_t nAllocations;
+        uint64_t nReused;       //! allocations served from the free lists
+    };
+
+    static CNetBufferPool& Instance()
+    {
+        boost::call_once(CNetBufferPool::CreateInstance, CNetBufferPool::init_flag);
+        return *CNetBufferPool::_instance;
+    }
+
+    void* Allocate(size_t nBytes);
+    void Deallocate(void* p, size_t nBytes);
+    Stats GetStats() const;
+
+private:
+    static const int NUM_SIZES = 15; // MIN_BUFFER_SIZE << 14 == MAX_BUFFER_SIZE
+
+    mutable boost::mutex mutex;
+    std::vector<void*> vFree[NUM_SIZES];
+    Stats stats;
+
+    CNetBufferPool();
+
+    //! Index of the size nBytes is rounded up to, or -1 if it is too large for the pool
+    static int SizeIndex(size_t nBytes);
+
+    static void CreateInstance()
+    {
+        // Never destroyed: static containers (e.g. mapRelay) may free their buffers
+        // after any static pool would be gone.
+        CNetBufferPool::_instance = new CNetBufferPool();
+    }
+
+    static CNetBufferPool* _instance;
+    static boost::once_flag init_flag;
+};
+
+#endif // BITCOIN_SUPPORT_NETBUFFERPOOL_H
@@ -7,8 +7,11 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+#include <map>
 #include <stdio.h>
 
+#include <boost/atomic.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
@@ -19,6 +22,164 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+bool fLockStats = false;
+
+/**
+ * Contention statistics of one lock site, i.e. one LOCK/LOCK2/TRY_LOCK in the source.
+ * Sites live in a fixed open addressing table keyed by the __FILE__ pointer and line,
+ * so recording takes no lock.
+ */
+struct CLockSiteStats {
+    CLockSiteStats() : nState(0), pszName(NULL), pszFile(NULL), nLine(0) { Reset(); }
+
+    void Reset()
+    {
+        nAcquired = 0;
+        nContended = 0;
+        nWaitMicros = 0;
+        nWaitMaxMicros = 0;
+        nHoldSamples = 0;
+        nHoldMicros = 0;
+        for (int i = 0; i < LOCKSTATS_HISTOGRAM_BUCKETS; i++) {
+            vWaitHistogram[i] = 0;
+            vHoldHistogram[i] = 0;
+        }
+    }
+
+    boost::atomic<int> nState; // 0: free, 1: being claimed, 2: in use
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    boost::atomic<uint64_t> nAcquired;
+    boost::atomic<uint64_t> nContended;
+    boost::atomic<uint64_t> nWaitMicros;
+    boost::atomic<uint64_t> nWaitMaxMicros;
+    boost::atomic<uint64_t> vWaitHistogram[LOCKSTATS_HISTOGRAM_BUCKETS];
+    boost::atomic<uint64_t> nHoldSamples;
+    boost::atomic<uint64_t> nHoldMicros;
+    boost::atomic<uint64_t> vHoldHistogram[LOCKSTATS_HISTOGRAM_BUCKETS];
+};
+
+static const size_t LOCKSTATS_TABLE_SIZE = 4096;
+//! Every how many acquisitions of a site its hold time is measured
+static const uint64_t LOCKSTATS_HOLD_SAMPLE_RATE = 16;
+
+//! Allocated by EnableLockStats and leaked, as lock sites are used until the very end
+static CLockSiteStats* vLockSites = NULL;
+
+static int HistogramBucket(int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nMicros > 1 && nBucket < LOCKSTATS_HISTOGRAM_BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+static CLockSiteStats* FindLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    size_t nHash = ((size_t)pszFile >> 3) ^ ((size_t)nLine * 2654435761U);
+    for (size_t i = 0; i < LOCKSTATS_TABLE_SIZE; i++) {
+        CLockSiteStats& site = vLockSites[(nHash + i) % LOCKSTATS_TABLE_SIZE];
+        int nState = site.nState.load(boost::memory_order_acquire);
+        if (nState == 0) {
+            if (site.nState.compare_exchange_strong(nState, 1, boost::memory_order_acq_rel)) {
+                site.pszName = pszName;
+                site.pszFile = pszFile;
+                site.nLine = nLine;
+                site.nState.store(2, boost::memory_order_release);
+                return &site;
+            }
+        }
+        // another thread is claiming the slot right now
+        while (nState == 1)
+            nState = site.nState.load(boost::memory_order_acquire);
+        if (site.pszFile == pszFile && site.nLine == nLine)
+            return &site;
+    }
+    return NULL; // table full
+}
+
+CLockSiteStats* LockStatsAcquired(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros)
+{
+    if (vLockSites == NULL)
+        return NULL;
+    CLockSiteStats* psite = FindLockSite(pszName, pszFile, nLine);
+    if (psite == NULL)
+        return NULL;
+
+    uint64_t nAcquired = psite->nAcquired.fetch_add(1, boost::memory_order_relaxed);
+    if (fContended) {
+        psite->nContended.fetch_add(1, boost::memory_order_relaxed);
+        psite->nWaitMicros.fetch_add(nWaitMicros, boost::memory_order_relaxed);
+        psite->vWaitHistogram[HistogramBucket(nWaitMicros)].fetch_add(1, boost::memory_order_relaxed);
+        uint64_t nMax = psite->nWaitMaxMicros.load(boost::memory_order_relaxed);
+        while ((uint64_t)nWaitMicros > nMax && !psite->nWaitMaxMicros.compare_exchange_weak(nMax, nWaitMicros, boost::memory_order_relaxed)) {}
+    }
+    return nAcquired % LOCKSTATS_HOLD_SAMPLE_RATE == 0 ? psite : NULL;
+}
+
+void LockStatsReleased(CLockSiteStats* psite, int64_t nHoldMicros)
+{
+    psite->nHoldSamples.fetch_add(1, boost::memory_order_relaxed);
+    psite->nHoldMicros.fetch_add(nHoldMicros, boost::memory_order_relaxed);
+    psite->vHoldHistogram[HistogramBucket(nHoldMicros)].fetch_add(1, boost::memory_order_relaxed);
+}
+
+void EnableLockStats()
+{
+    if (vLockSites == NULL)
+        vLockSites = new CLockSiteStats[LOCKSTATS_TABLE_SIZE];
+    fLockStats = true;
+}
+
+void GetLockStats(std::vector<CLockSiteInfo>& vStatsRet)
+{
+    vStatsRet.clear();
+    if (vLockSites == NULL)
+        return;
+
+    // the same site can show up with different __FILE__ pointers, e.g. in headers
+    std::map<std::pair<std::string, int>, CLockSiteInfo> mapSites;
+    for (size_t i = 0; i < LOCKSTATS_TABLE_SIZE; i++) {
+        const CLockSiteStats& site = vLockSites[i];
+        if (site.nState.load(boost::memory_order_acquire) != 2)
+            continue;
+        std::string strFile = site.pszFile;
+        size_t nPos = strFile.rfind("src/");
+        if (nPos != std::string::npos)
+            strFile = strFile.substr(nPos + 4);
+
+        CLockSiteInfo& info = mapSites[std::make_pair(strFile, site.nLine)];
+        info.strName = site.pszName;
+        info.strFile = strFile;
+        info.nLine = site.nLine;
+        info.nAcquired += site.nAcquired.load();
+        info.nContended += site.nContended.load();
+        info.nWaitMicros += site.nWaitMicros.load();
+        info.nWaitMaxMicros = std::max(info.nWaitMaxMicros, (uint64_t)site.nWaitMaxMicros.load());
+        info.nHoldSamples += site.nHoldSamples.load();
+        info.nHoldMicros += site.nHoldMicros.load();
+        for (int j = 0; j < LOCKSTATS_HISTOGRAM_BUCKETS; j++) {
+            info.vWaitHistogram[j] += site.vWaitHistogram[j].load();
+            info.vHoldHistogram[j] += site.vHoldHistogram[j].load();
+        }
+    }
+
+    for (std::map<std::pair<std::string, int>, CLockSiteInfo>::const_iterator it = mapSites.begin(); it != mapSites.end(); ++it)
+        vStatsRet.push_back(it->second);
+}
+
+void ResetLockStats()
+{
+    if (vLockSites == NULL)
+        return;
+    for (size_t i = 0; i < LOCKSTATS_TABLE_SIZE; i++)
+        vLockSites[i].Reset();
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -7,6 +7,10 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
+
+#include <string>
+#include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -99,16 +103,86 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock contention profiling (-lockstats): every lock site records how often it was
+ * acquired, how long it waited for contended locks, and a sample of the hold times.
+ */
+extern bool fLockStats;
+static const bool DEFAULT_LOCKSTATS = false;
+
+//! Histogram bucket i counts times in [2^i, 2^(i+1)) microseconds, the last one everything above
+static const int LOCKSTATS_HISTOGRAM_BUCKETS = 24;
+
+struct CLockSiteStats;
+
+/** Statistics of one lock site as returned by GetLockStats */
+struct CLockSiteInfo {
+    CLockSiteInfo()
+        : nLine(0),
+          nAcquired(0),
+          nContended(0),
+          nWaitMicros(0),
+          nWaitMaxMicros(0),
+          vWaitHistogram(LOCKSTATS_HISTOGRAM_BUCKETS, 0),
+          nHoldSamples(0),
+          nHoldMicros(0),
+          vHoldHistogram(LOCKSTATS_HISTOGRAM_BUCKETS, 0)
+    {}
+
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    uint64_t nAcquired;
+    uint64_t nContended;
+    uint64_t nWaitMicros;
+    uint64_t nWaitMaxMicros;
+    std::vector<uint64_t> vWaitHistogram;
+    uint64_t nHoldSamples;
+    uint64_t nHoldMicros;
+    std::vector<uint64_t> vHoldHistogram;
+};
+
+/** Record an acquisition, returns the site if its hold time is to be sampled */
+CLockSiteStats* LockStatsAcquired(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros);
+void LockStatsReleased(CLockSiteStats* psite, int64_t nHoldMicros);
+void EnableLockStats();
+void GetLockStats(std::vector<CLockSiteInfo>& vStatsRet);
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    //! Set if the hold time of this acquisition is sampled
+    CLockSiteStats* pLockSite;
+    int64_t nLockedMicros;
+
+    void EnterProfiled(const char* pszName, const char* pszFile, int nLine)
+    {
+        bool fContended = !lock.try_lock();
+        int64_t nWaitMicros = 0;
+        if (fContended) {
+#ifdef DEBUG_LOCKCONTENTION
+            PrintLockContention(pszName, pszFile, nLine);
+#endif
+            int64_t nStart = GetTimeMicros();
+            lock.lock();
+            nWaitMicros = GetTimeMicros() - nStart;
+        }
+        pLockSite = LockStatsAcquired(pszName, pszFile, nLine, fContended, nWaitMicros);
+        if (pLockSite)
+            nLockedMicros = GetTimeMicros();
+    }
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (fLockStats) {
+            EnterProfiled(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -125,11 +199,16 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockStats) {
+            pLockSite = LockStatsAcquired(pszName, pszFile, nLine, false, 0);
+            if (pLockSite)
+                nLockedMicros = GetTimeMicros();
+        }
         return lock.owns_lock();
     }
 
 public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock), pLockSite(NULL), nLockedMicros(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -137,7 +216,7 @@ public:
             Enter(pszName, pszFile, nLine);
     }
 
-    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : pLockSite(NULL), nLockedMicros(0)
     {
         if (!pmutexIn) return;
 
@@ -150,8 +229,11 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (pLockSite)
+                LockStatsReleased(pLockSite, GetTimeMicros() - nLockedMicros);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -4,10 +4,13 @@
 
 #include "util.h"
 
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
+#include "support/allocators/stream.h"
 #include "test/test_dash.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/unordered_map.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
 
@@ -117,4 +120,95 @@ BOOST_AUTO_TEST_CASE(test_LockedPageManagerBase)
     BOOST_CHECK((last_unlock_len & (test_page_size-1)) == 0); // always unlock entire pages
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource)
+{
+    CPoolResource pool;
+    void* p1 = pool.Allocate(20);
+    void* p2 = pool.Allocate(24);
+    BOOST_CHECK_EQUAL(pool.BlockBytes(), 48U);
+    BOOST_CHECK_EQUAL(pool.ChunkBytes(), (size_t)CPoolResource::MIN_CHUNK_SIZE);
+    BOOST_CHECK_EQUAL((char*)p2 - (char*)p1, 24);
+
+    // freed blocks are reused for requests of the same size
+    pool.Deallocate(p1, 20);
+    BOOST_CHECK_EQUAL(pool.Allocate(17), p1);
+    pool.Deallocate(p1, 17);
+    pool.Deallocate(p2, 24);
+    BOOST_CHECK_EQUAL(pool.BlockBytes(), 0U);
+
+    // chunks double in size, large requests bypass the pool
+    std::vector<void*> vBlocks;
+    for (int i = 0; i < 1000; i++)
+        vBlocks.push_back(pool.Allocate(64));
+    BOOST_CHECK_EQUAL(pool.ChunkBytes(), 4096U + 8192U + 16384U + 32768U + 65536U);
+    void* pLarge = pool.Allocate(CPoolResource::MAX_BLOCK_SIZE + 1);
+    BOOST_CHECK_EQUAL(pool.BlockBytes(), 64000U);
+    pool.Deallocate(pLarge, CPoolResource::MAX_BLOCK_SIZE + 1);
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        pool.Deallocate(vBlocks[i], 64);
+    BOOST_CHECK_EQUAL(pool.BlockBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_map)
+{
+    typedef boost::unordered_map<int, int, boost::hash<int>, std::equal_to<int>, pool_allocator<std::pair<const int, int> > > map_type;
+    map_type map1, map2;
+    BOOST_CHECK(map1.get_allocator() != map2.get_allocator());
+    for (int i = 0; i < 10000; i++)
+        map1[i] = i;
+    map2[-1] = -1;
+    BOOST_CHECK(map1.get_allocator().resource->BlockBytes() > 10000 * sizeof(std::pair<const int, int>));
+
+    // the pools go along with the nodes
+    boost::shared_ptr<CPoolResource> resource1 = map1.get_allocator().resource;
+    map1.swap(map2);
+    BOOST_CHECK(map2.get_allocator().resource == resource1);
+    BOOST_CHECK_EQUAL(map1.size(), 1U);
+    BOOST_CHECK_EQUAL(map2.size(), 10000U);
+    for (int i = 0; i < 10000; i += 2)
+        map2.erase(i);
+    BOOST_CHECK_EQUAL(map2[9999], 9999);
+
+    // a copy has a pool of its own
+    map_type map3(map2);
+    BOOST_CHECK(map3.get_allocator() != map2.get_allocator());
+    BOOST_CHECK(map3 == map2);
+}
+
+BOOST_AUTO_TEST_CASE(net_buffer_pool)
+{
+    CNetBufferPool& pool = CNetBufferPool::Instance();
+    CNetBufferPool::Stats before = pool.GetStats();
+
+    // network buffers are rounded up and recycled
+    const char* pBuffer;
+    {
+        CSerializeData data(NetBufferAllocator());
+        data.resize(3000);
+        pBuffer = &data[0];
+        BOOST_CHECK_EQUAL(pool.GetStats().nInUseBytes, before.nInUseBytes + 4096);
+    }
+    CNetBufferPool::Stats after = pool.GetStats();
+    BOOST_CHECK_EQUAL(after.nInUseBytes, before.nInUseBytes);
+    BOOST_CHECK_EQUAL(after.nAllocations, before.nAllocations + 1);
+    {
+        CSerializeData data(NetBufferAllocator());
+        data.resize(2049);
+        BOOST_CHECK(&data[0] == pBuffer);
+        BOOST_CHECK_EQUAL(pool.GetStats().nReused, after.nReused + 1);
+    }
+
+    // other serialization buffers do not use the pool, and a swap takes the allocators along
+    CSerializeData plain, net(NetBufferAllocator());
+    plain.resize(100);
+    net.resize(100);
+    BOOST_CHECK(plain.get_allocator() != net.get_allocator());
+    plain.swap(net);
+    BOOST_CHECK(plain.get_allocator() == NetBufferAllocator());
+    BOOST_CHECK(!net.get_allocator().fPooled);
+    net.clear();
+    net.shrink_to_fit();
+    BOOST_CHECK_EQUAL(pool.GetStats().nInUseBytes, before.nInUseBytes + 256);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
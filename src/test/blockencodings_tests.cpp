@@ -0,0 +1,122 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CBlock BuildBlockTestCase(std::vector<CMutableTransaction>& vtxRet)
+{
+    CBlock block;
+    vtxRet.resize(4);
+    for (size_t i = 0; i < vtxRet.size(); i++) {
+        vtxRet[i].vin.resize(1);
+        vtxRet[i].vin[0].scriptSig = CScript() << OP_11 << (int64_t)i;
+        vtxRet[i].vin[0].prevout.hash = GetRandHash();
+        vtxRet[i].vin[0].prevout.n = i;
+        vtxRet[i].vout.resize(1);
+        vtxRet[i].vout[0].nValue = 42;
+        block.vtx.push_back(vtxRet[i]);
+    }
+    vtxRet[0].vin[0].prevout.SetNull();
+    block.vtx[0] = vtxRet[0];
+
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_roundtrip)
+{
+    std::vector<CMutableTransaction> vtx;
+    CBlock block = BuildBlockTestCase(vtx);
+
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    pool.addUnchecked(vtx[2].GetHash(), entry.FromTx(vtx[2]));
+    std::vector<CTransaction> vExtraTxn(1, vtx[3]);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CBlockHeaderAndShortTxIDs(block);
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    stream >> cmpctblock;
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), 4U);
+
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool, vExtraTxn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));  // coinbase is prefilled
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));  // from the mempool
+    BOOST_CHECK(partialBlock.IsTxAvailable(3));  // from the extra transactions
+    BOOST_CHECK_EQUAL(partialBlock.nPrefilled, 1U);
+    BOOST_CHECK_EQUAL(partialBlock.nMempool, 1U);
+    BOOST_CHECK_EQUAL(partialBlock.nExtra, 1U);
+
+    CBlock blockRet;
+    BOOST_CHECK(partialBlock.FillBlock(blockRet, std::vector<CTransaction>()) == READ_STATUS_INVALID);
+    BOOST_CHECK(partialBlock.FillBlock(blockRet, std::vector<CTransaction>(2, vtx[1])) == READ_STATUS_INVALID);
+    // The wrong transaction is only noticed by the merkle root
+    BOOST_CHECK(partialBlock.FillBlock(blockRet, std::vector<CTransaction>(1, vtx[2])) == READ_STATUS_FAILED);
+    BOOST_CHECK(partialBlock.FillBlock(blockRet, std::vector<CTransaction>(1, vtx[1])) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(blockRet.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(blockRet.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(blockRet.vtx[i] == block.vtx[i]);
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_invalid)
+{
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CTransaction> vExtraTxn;
+
+    // Neither short IDs nor prefilled transactions
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(CBlockHeaderAndShortTxIDs(), pool, vExtraTxn) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(blocktxn_request_roundtrip)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = GetRandHash();
+    req1.vIndexes.push_back(0);
+    req1.vIndexes.push_back(1);
+    req1.vIndexes.push_back(3);
+    req1.vIndexes.push_back(65535);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    // Indexes are sent as differences
+    CDataStream streamExpected(SER_NETWORK, PROTOCOL_VERSION);
+    streamExpected << req1.blockhash;
+    WriteCompactSize(streamExpected, 4);
+    WriteCompactSize(streamExpected, 0);
+    WriteCompactSize(streamExpected, 0);
+    WriteCompactSize(streamExpected, 1);
+    WriteCompactSize(streamExpected, 65531);
+    BOOST_CHECK(stream.str() == streamExpected.str());
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK(req2.blockhash == req1.blockhash);
+    BOOST_CHECK(req2.vIndexes == req1.vIndexes);
+
+    // Differences adding up past 16 bits are rejected
+    CDataStream streamOverflow(SER_NETWORK, PROTOCOL_VERSION);
+    streamOverflow << req1.blockhash;
+    WriteCompactSize(streamOverflow, 2);
+    WriteCompactSize(streamOverflow, 65535);
+    WriteCompactSize(streamOverflow, 0);
+    BOOST_CHECK_THROW(streamOverflow >> req2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,11 +7,13 @@
 #include "uint256.h"
 #include "test/test_dash.h"
 #include "main.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/test/unit_test.hpp>
 
 namespace
@@ -347,4 +349,188 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+// The chainstate database stores every output separately, check that spending
+// outputs one by one through a cache erases exactly those from disk.
+BOOST_AUTO_TEST_CASE(coins_db_per_output_test)
+{
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 100;
+    coins.fCoinBase = true;
+    coins.vout.resize(3);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = (i + 1) * COIN;
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyNewCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins read;
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+
+    // spend the middle output, the others stay as they were
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        BOOST_CHECK(cache.Flush());
+    }
+    coins.Spend(1);
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+    BOOST_CHECK(read.vout[1].IsNull());
+
+    // and spending the last one trims the trailing outputs
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(2));
+        BOOST_CHECK(cache.Flush());
+    }
+    coins.Spend(2);
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK_EQUAL(read.vout.size(), 1U);
+    BOOST_CHECK(read == coins);
+
+    // a neighbouring transaction does not leak into the lookup
+    uint256 txidNext = txid;
+    *txidNext.begin() ^= 1;
+    BOOST_CHECK(!db.HaveCoins(txidNext));
+    BOOST_CHECK(!db.GetCoins(txidNext, read));
+
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(0));
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, read));
+}
+
+// Flushing through the background writer keeps the unspent entries cached, while the
+// writer serves the entries that are not written yet.
+BOOST_AUTO_TEST_CASE(coins_write_behind_test)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewWriteBehind writer(&db);
+    CCoinsViewCacheTest cache(&writer);
+    uint256 txid = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 10;
+    coins.vout.resize(2);
+    coins.vout[0].nValue = COIN;
+    coins.vout[1].nValue = 2 * COIN;
+    *cache.ModifyNewCoins(txid) = coins;
+    cache.SetBestBlock(hashBlock);
+
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    CCoins read;
+    BOOST_CHECK(writer.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    BOOST_CHECK(!writer.IsWriting());
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), 0U);
+    cache.SelfTest();
+
+    // clean entries are evicted, a pruned one leaves the cache at once
+    BOOST_CHECK_EQUAL(cache.Trim(0), 1U);
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+    BOOST_CHECK(cache.ModifyCoins(txid)->Spend(0));
+    BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(!cache.HaveCoins(txid));
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(!db.HaveCoins(txid));
+    cache.SelfTest();
+
+    CCoinsFlushStats stats = writer.GetFlushStats();
+    BOOST_CHECK_EQUAL(stats.nFlushes, 2U);
+    BOOST_CHECK_EQUAL(stats.nTotalEntries, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_stats_cursor_test)
+{
+    CCoinsViewDB db(1 << 20, true);
+    uint256 hashBlock = GetRandHash();
+    std::map<uint256, CCoins> mapCoins;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 1000; i++) {
+            CCoins coins;
+            coins.nVersion = 1;
+            coins.nHeight = i;
+            coins.vout.resize(1 + insecure_rand() % 3);
+            for (unsigned int j = 0; j < coins.vout.size(); j++) {
+                coins.vout[j].nValue = insecure_rand() % COIN;
+                coins.vout[j].scriptPubKey = CScript() << OP_TRUE;
+            }
+            uint256 txid = GetRandHash();
+            *cache.ModifyNewCoins(txid) = coins;
+            mapCoins[txid] = coins;
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // the cursor sees the transactions in txid order, and the partitioned statistics
+    // hash them as reading the chainstate serially would
+    boost::scoped_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    BOOST_CHECK(pcursor->GetBestBlock() == hashBlock);
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    std::map<uint256, CCoins>::const_iterator it = mapCoins.begin();
+    for (; pcursor->Valid(); pcursor->Next(), it++) {
+        uint256 txid;
+        CCoins coins;
+        BOOST_CHECK(pcursor->GetKey(txid));
+        BOOST_CHECK(pcursor->GetValue(coins));
+        BOOST_REQUIRE(it != mapCoins.end());
+        BOOST_CHECK(txid == it->first);
+        BOOST_CHECK(coins == it->second);
+        for (unsigned int i = 0; i < coins.vout.size(); i++)
+            ss << VARINT(i+1) << coins.vout[i];
+        ss << VARINT(0);
+    }
+    BOOST_CHECK(it == mapCoins.end());
+
+    CCoinsStats stats;
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK(stats.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(stats.nTransactions, mapCoins.size());
+    BOOST_CHECK(stats.hashSerialized == ss.GetHash());
+
+    // a cursor keeps reading the state it was created at
+    pcursor.reset(db.Cursor());
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.ModifyCoins(mapCoins.begin()->first)->Spend(0));
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(pcursor->GetBestBlock() == hashBlock);
+    CCoins coins;
+    BOOST_CHECK(pcursor->GetValue(coins));
+    BOOST_CHECK(coins == mapCoins.begin()->second);
+    size_t nTransactions = 0;
+    for (; pcursor->Valid(); pcursor->Next())
+        nTransactions++;
+    BOOST_CHECK_EQUAL(nTransactions, mapCoins.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
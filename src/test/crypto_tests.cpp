@@ -8,6 +8,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_dash.h"
@@ -248,4 +249,25 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every batch size up to several rounds of the widest implementation, against CHash256
+    for (size_t nBlocks = 0; nBlocks <= 33; nBlocks++) {
+        std::vector<unsigned char> in(64 * nBlocks);
+        for (size_t i = 0; i < in.size(); i++)
+            in[i] = insecure_rand();
+        std::vector<unsigned char> expected(32 * nBlocks);
+        for (size_t i = 0; i < nBlocks; i++)
+            CHash256().Write(&in[64 * i], 64).Finalize(&expected[32 * i]);
+
+        std::vector<unsigned char> out(32 * nBlocks);
+        SHA256D64(begin_ptr(out), begin_ptr(in), nBlocks);
+        BOOST_CHECK(out == expected);
+
+        // In place, the way merkle tree levels are computed
+        SHA256D64(begin_ptr(in), begin_ptr(in), nBlocks);
+        BOOST_CHECK(std::equal(expected.begin(), expected.end(), in.begin()));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+#include "test/test_dash.h"
+
+#include <univalue.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(jsonwriter_tests, BasicTestingSetup)
+
+// Counts the chunks handed to the sink
+class CJSONCountingWriter : public CJSONStringWriter
+{
+public:
+    int nChunks;
+    CJSONCountingWriter(size_t nFlushThresholdIn) : CJSONStringWriter(nFlushThresholdIn), nChunks(0) {}
+
+protected:
+    void WriteChunk(const std::string& strChunk)
+    {
+        nChunks++;
+        CJSONStringWriter::WriteChunk(strChunk);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(jsonwriter_matches_univalue)
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("two \"quoted\"\n");
+    inner.push_back(UniValue(UniValue::VOBJ));
+    inner.push_back(NullUniValue);
+
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    expected.push_back(Pair("inner", inner));
+    expected.push_back(Pair("key \\ with escapes", true));
+    expected.push_back(Pair("num", 1.5));
+
+    CJSONStringWriter writer;
+    writer.BeginObject();
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Key("inner");
+    writer.BeginArray();
+    writer.Value(1);
+    writer.Value("two \"quoted\"\n");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.Value(NullUniValue);
+    writer.EndArray();
+    writer.KeyValue("key \\ with escapes", true);
+    writer.KeyValue("num", 1.5);
+    writer.EndObject();
+
+    BOOST_CHECK_EQUAL(writer.str(), expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_flush)
+{
+    UniValue expected(UniValue::VARR);
+    CJSONCountingWriter writer(100);
+    writer.BeginArray();
+    for (int i = 0; i < 1000; i++) {
+        expected.push_back(i);
+        writer.Value(i);
+    }
+    writer.EndArray();
+    // nothing has been flushed explicitly, yet most of the output is already out
+    BOOST_CHECK(writer.HasFlushed());
+    BOOST_CHECK(writer.nChunks > 10);
+    BOOST_CHECK_EQUAL(writer.str(), expected.write());
+
+    // discarding before the first flush leaves no trace
+    CJSONCountingWriter writer2(100);
+    writer2.BeginObject();
+    writer2.Key("result");
+    writer2.Discard();
+    BOOST_CHECK(!writer2.HasFlushed());
+    writer2.Value("replacement");
+    BOOST_CHECK_EQUAL(writer2.str(), "\"replacement\"");
+    BOOST_CHECK_EQUAL(writer2.nChunks, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
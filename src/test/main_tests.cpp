@@ -78,4 +78,38 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(verifydb_test, TestChain100Setup)
+{
+    // blocks are checked ahead from other threads, then disconnected and reconnected in order
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 4, 50));
+    CVerifyDBProgress progress = GetVerifyDBProgress();
+    BOOST_CHECK(!progress.fRunning);
+    BOOST_CHECK_EQUAL(progress.nCheckLevel, 4);
+    // the tip and the 50 blocks below it
+    BOOST_CHECK_EQUAL(progress.nBlocks, 51);
+    BOOST_CHECK_EQUAL(progress.nChecked, 51);
+    BOOST_CHECK_EQUAL(progress.nReconnected, 51);
+    BOOST_CHECK_EQUAL(progress.GetProgress(), 1.0);
+    BOOST_CHECK_EQUAL(progress.GetRemainingTime(), -1);
+
+    // the whole chain but the genesis block at level 2
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 2, 0));
+    progress = GetVerifyDBProgress();
+    BOOST_CHECK_EQUAL(progress.nBlocks, chainActive.Height());
+    BOOST_CHECK_EQUAL(progress.nChecked, chainActive.Height());
+    BOOST_CHECK_EQUAL(progress.nReconnected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(blocks_in_transit_limit)
+{
+    // Unmeasured peers get the fixed limit
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(0, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    // Enough blocks for BLOCK_DOWNLOAD_TARGET_TIME seconds at the measured rate
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000, 40000), 100000 * BLOCK_DOWNLOAD_TARGET_TIME / 40000);
+    // Slow and fast peers are clamped
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000, 1000000), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000000, 1000), MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -473,4 +473,85 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAddressSpentIndexTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    uint160 hashA(ParseHex("1111111111111111111111111111111111111111"));
+    uint160 hashB(ParseHex("2222222222222222222222222222222222222222"));
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vout.resize(3);
+    txFunding.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashA) << OP_EQUALVERIFY << OP_CHECKSIG;
+    txFunding.vout[0].nValue = 5000;
+    txFunding.vout[1].scriptPubKey = CScript() << OP_HASH160 << ToByteVector(hashB) << OP_EQUAL;
+    txFunding.vout[1].nValue = 6000;
+    txFunding.vout[2].scriptPubKey = CScript() << OP_TRUE;
+    txFunding.vout[2].nValue = 7000;
+    uint256 hashFunding = txFunding.GetHash();
+    {
+        CCoinsModifier coins = view.ModifyNewCoins(hashFunding);
+        *coins = CCoins(txFunding, 1);
+    }
+
+    // spends the P2PKH and the anyone-can-spend outputs, pays to A and B
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(hashFunding, 0);
+    tx.vin[1].prevout = COutPoint(hashFunding, 2);
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = txFunding.vout[0].scriptPubKey;
+    tx.vout[0].nValue = 1000;
+    tx.vout[1].scriptPubKey = txFunding.vout[1].scriptPubKey;
+    tx.vout[1].nValue = 2000;
+    uint256 hashTx = tx.GetHash();
+
+    size_t nUsageEmpty = pool.IndexMemoryUsage();
+    pool.addUnchecked(hashTx, entry.Time(10).FromTx(tx));
+    pool.addAddressIndex(entry.FromTx(tx), view);
+    pool.addSpentIndex(entry.FromTx(tx), view);
+    BOOST_CHECK(pool.IndexMemoryUsage() > nUsageEmpty);
+    BOOST_CHECK(pool.DynamicMemoryUsage() > pool.IndexMemoryUsage());
+
+    std::vector<std::pair<uint160, int> > addresses;
+    addresses.push_back(std::make_pair(hashA, 1));
+    addresses.push_back(std::make_pair(hashB, 2));
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK_EQUAL(results.size(), 3);
+    // A: the output to it, then the input spending from it
+    BOOST_CHECK(results[0].first.txhash == hashTx && results[0].first.index == 0 && results[0].first.spending == 0);
+    BOOST_CHECK_EQUAL(results[0].second.amount, 1000);
+    BOOST_CHECK_EQUAL(results[0].second.time, 10);
+    BOOST_CHECK(results[1].first.index == 0 && results[1].first.spending == 1);
+    BOOST_CHECK_EQUAL(results[1].second.amount, -5000);
+    BOOST_CHECK(results[1].second.prevhash == hashFunding && results[1].second.prevout == 0);
+    BOOST_CHECK(results[2].first.type == 2 && results[2].first.addressBytes == hashB && results[2].first.index == 1);
+    BOOST_CHECK_EQUAL(results[2].second.amount, 2000);
+
+    CSpentIndexKey key(hashFunding, 0);
+    CSpentIndexValue value;
+    BOOST_CHECK(pool.getSpentIndex(key, value));
+    BOOST_CHECK(value.txid == hashTx && value.inputIndex == 0 && value.blockHeight == -1);
+    BOOST_CHECK(value.satoshis == 5000 && value.addressType == 1 && value.addressHash == hashA);
+    key = CSpentIndexKey(hashFunding, 2);
+    BOOST_CHECK(pool.getSpentIndex(key, value));
+    BOOST_CHECK(value.inputIndex == 1 && value.satoshis == 7000 && value.addressType == 0);
+    key = CSpentIndexKey(hashFunding, 1);
+    BOOST_CHECK(!pool.getSpentIndex(key, value));
+
+    std::list<CTransaction> removed;
+    pool.remove(tx, removed);
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK(results.empty());
+    key = CSpentIndexKey(hashFunding, 0);
+    BOOST_CHECK(!pool.getSpentIndex(key, value));
+    // only the (empty) hash tables remain
+    BOOST_CHECK(pool.IndexMemoryUsage() < nUsageEmpty + 1024);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
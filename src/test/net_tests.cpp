@@ -0,0 +1,158 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(prepared_message)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.hash = GetRandHash();
+    mtx.vin[0].scriptSig = CScript() << OP_1;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 42;
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CTransaction tx(mtx);
+
+    // No socket, the messages stay queued
+    struct in_addr ipv4;
+    ipv4.s_addr = htonl(0x7f000001);
+    CNode node(INVALID_SOCKET, CAddress(CService(ipv4, 9999)), "", true);
+    node.PushMessage(NetMsgType::TX, tx);
+    CPreparedMessage msg = CPreparedMessage::Make(NetMsgType::TX, tx);
+    node.PushPreparedMessage(msg);
+    node.PushPreparedMessage(msg);
+
+    // The same bytes as a message serialized for the node, and queued without a copy
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 3U);
+    BOOST_CHECK(*node.vSendMsg[0].data == *msg.GetData());
+    BOOST_CHECK(node.vSendMsg[1].data == msg.GetData());
+    BOOST_CHECK(node.vSendMsg[2].data == msg.GetData());
+    BOOST_CHECK_EQUAL(node.nSendSize, 3 * msg.size());
+
+    // The receiving side accepts it
+    const CSerializeData& data = *msg.GetData();
+    CNetMessage recv(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    int nHeader = recv.readHeader(&data[0], data.size());
+    BOOST_CHECK_EQUAL(nHeader, CMessageHeader::HEADER_SIZE);
+    recv.readData(&data[nHeader], data.size() - nHeader);
+    BOOST_CHECK(recv.complete());
+    BOOST_CHECK(recv.hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(recv.hdr.GetCommand(), NetMsgType::TX);
+    BOOST_CHECK_EQUAL(recv.GetChecksum(), recv.hdr.nChecksum);
+    CTransaction txRecv;
+    recv.vRecv >> txRecv;
+    BOOST_CHECK(txRecv.GetHash() == tx.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(receive_checksum)
+{
+    struct in_addr ipv4;
+    ipv4.s_addr = htonl(0x7f000001);
+    CNode node(INVALID_SOCKET, CAddress(CService(ipv4, 9999)), "", true);
+    CSerializeData data = *CPreparedMessage::Make(NetMsgType::PING, (uint64_t)42).GetData();
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::VERACK, 0);
+    uint256 hash = Hash(data.end(), data.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ssEmpty(SER_NETWORK, INIT_PROTO_VERSION);
+    ssEmpty << hdr;
+    CSerializeData empty(ssEmpty.begin(), ssEmpty.end());
+
+    // Split across reads, the checksum is computed as the data arrives
+    BOOST_CHECK(node.ReceiveMsgBytes(&data[0], 10));
+    BOOST_CHECK(node.ReceiveMsgBytes(&data[10], 20));
+    BOOST_CHECK(node.ReceiveMsgBytes(&data[30], data.size() - 30));
+    BOOST_CHECK(node.ReceiveMsgBytes(&empty[0], empty.size()));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U);
+    BOOST_CHECK(node.vRecvMsg[0].complete());
+    BOOST_CHECK_EQUAL(node.vRecvMsg[0].hdr.GetCommand(), NetMsgType::PING);
+    BOOST_CHECK(node.vRecvMsg[1].complete());
+
+    // A corrupted message is dropped before it reaches the message handler
+    data[data.size() - 1] ^= 1;
+    BOOST_CHECK(node.ReceiveMsgBytes(&data[0], data.size()));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U);
+
+    // and a wrong message start disconnects
+    empty[0] ^= 1;
+    BOOST_CHECK(!node.ReceiveMsgBytes(&empty[0], empty.size()));
+}
+
+static std::string SendCommand(const CSendMsg& msg)
+{
+    CDataStream ss(msg.data->begin(), msg.data->end(), SER_NETWORK, INIT_PROTO_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    ss >> hdr;
+    return hdr.GetCommand();
+}
+
+BOOST_AUTO_TEST_CASE(send_priority)
+{
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::TXLOCKVOTE), SEND_PRIORITY_HIGH);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::TX), SEND_PRIORITY_NORMAL);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::BLOCK), SEND_PRIORITY_BULK);
+
+    struct in_addr ipv4;
+    ipv4.s_addr = htonl(0x7f000001);
+    CNode node(INVALID_SOCKET, CAddress(CService(ipv4, 9999)), "", true);
+    std::vector<CInv> vInv;
+    node.PushMessage(NetMsgType::BLOCK, vInv);
+    node.PushMessage(NetMsgType::TX, vInv);
+    node.PushMessage(NetMsgType::MNGOVERNANCEOBJECT, vInv);
+    node.PushMessage(NetMsgType::INV, vInv);
+    node.PushPreparedMessage(CPreparedMessage::Make(NetMsgType::BLOCK, vInv), SEND_PRIORITY_NORMAL);
+
+    // Ordered by priority, first in first out within one
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 5U);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[0]), NetMsgType::INV);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[1]), NetMsgType::TX);
+    BOOST_CHECK_EQUAL(node.vSendMsg[2].nPriority, SEND_PRIORITY_NORMAL);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[2]), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[3]), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[4]), NetMsgType::MNGOVERNANCEOBJECT);
+
+    // A message being sent is not overtaken
+    LOCK(node.cs_vSend);
+    node.vSendMsg.erase(node.vSendMsg.begin(), node.vSendMsg.begin() + 3);
+    node.nSendOffset = 1;
+    node.QueueSendMsg(CPreparedMessage::Make(NetMsgType::PING, (uint64_t)1).GetData(), SEND_PRIORITY_HIGH);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[0]), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[1]), NetMsgType::PING);
+    BOOST_CHECK_EQUAL(SendCommand(node.vSendMsg[2]), NetMsgType::MNGOVERNANCEOBJECT);
+}
+
+BOOST_AUTO_TEST_CASE(rate_limiter)
+{
+    CRateLimiter limiter;
+    BOOST_CHECK(!limiter.IsLimited());
+    BOOST_CHECK(limiter.Allow(0));
+
+    limiter.SetRate(1000);
+    int64_t nNow = GetTimeMicros();
+    BOOST_CHECK(limiter.Allow(nNow));
+    // A message larger than the bucket is sent whole and paid for afterwards
+    limiter.Consume(2500);
+    BOOST_CHECK(!limiter.Allow(nNow));
+    BOOST_CHECK(!limiter.Allow(nNow + 1000000));
+    // Refills in small steps add up
+    for (int i = 1; i <= 500; i++)
+        limiter.Allow(nNow + 1000000 + i * 1000);
+    BOOST_CHECK(!limiter.Allow(nNow + 1500000));
+    BOOST_CHECK(limiter.Allow(nNow + 1501000));
+    // The burst is one second
+    BOOST_CHECK(limiter.Allow(nNow + 60000000));
+    limiter.Consume(1000);
+    BOOST_CHECK(!limiter.Allow(nNow + 60000000));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
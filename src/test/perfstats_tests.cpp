@@ -0,0 +1,55 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perfstats.h"
+#include "test/test_dash.h"
+#include "tinyformat.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(perfstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(perfstats_histogram)
+{
+    CPerfHistogram histogram("test", "Test histogram");
+    histogram.Record(50);
+    histogram.Record(100);  // bounds are inclusive
+    histogram.Record(101);
+    histogram.Record(20000000);
+    histogram.Record(-5);   // clock went backwards
+
+    std::vector<uint64_t> vBuckets = histogram.GetBuckets();
+    BOOST_CHECK_EQUAL(vBuckets.size(), PERF_LATENCY_BUCKETS_COUNT + 1);
+    BOOST_CHECK_EQUAL(vBuckets[0], 3U);
+    BOOST_CHECK_EQUAL(vBuckets[1], 1U);
+    BOOST_CHECK_EQUAL(vBuckets[PERF_LATENCY_BUCKETS_COUNT], 1U);
+    BOOST_CHECK_EQUAL(histogram.GetSumMicros(), 20000251U);
+    BOOST_CHECK_EQUAL(histogram.GetMaxMicros(), 20000000U);
+
+    CPerfCounter counter("test", "Test counter");
+    counter.Increment();
+    counter.Increment(4);
+    BOOST_CHECK_EQUAL(counter.Get(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(perfstats_text)
+{
+    perfMempoolRejected.Increment();
+    perfInstantSendLock.Record(2500);
+    perfInstantSendLock.Record(1500000);
+    std::string strText = FormatPerfStatsText("test_");
+
+    BOOST_CHECK(strText.find("# TYPE test_instantsend_lock_seconds histogram\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_bucket{le=\"0.0001\"} 0\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_bucket{le=\"0.0025\"} 1\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_bucket{le=\"2.5\"} 2\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_bucket{le=\"10\"} 2\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_bucket{le=\"+Inf\"} 2\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_sum 1.5025\n") != std::string::npos);
+    BOOST_CHECK(strText.find("test_instantsend_lock_seconds_count 2\n") != std::string::npos);
+    BOOST_CHECK(strText.find("# TYPE test_mempool_rejected_total counter\n") != std::string::npos);
+    BOOST_CHECK(strText.find(strprintf("test_mempool_rejected_total %d\n", perfMempoolRejected.Get())) != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -307,4 +307,24 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    // Parallel and serialized elements mixed, results must come back in request order
+    UniValue vReq = ParseNonRFCJSONValue(
+        "[{\"id\":0,\"method\":\"getblockcount\"},"
+        "{\"id\":1,\"method\":\"getbestblockhash\"},"
+        "{\"id\":2,\"method\":\"setmocktime\",\"params\":[0]},"
+        "{\"id\":3,\"method\":\"nosuchmethod\"},"
+        "{\"id\":4,\"method\":\"getdifficulty\"},"
+        "{\"id\":5,\"method\":\"getblockcount\"}]");
+    UniValue ret = ParseNonRFCJSONValue(JSONRPCExecBatch(vReq));
+    BOOST_CHECK(ret.isArray());
+    BOOST_CHECK_EQUAL(ret.size(), vReq.size());
+    for (unsigned int i = 0; i < ret.size(); i++)
+        BOOST_CHECK_EQUAL(find_value(ret[i].get_obj(), "id").get_int(), (int)i);
+
+    BOOST_CHECK(tableRPC["getblockcount"]->okParallel);
+    BOOST_CHECK(!tableRPC["setmocktime"]->okParallel);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
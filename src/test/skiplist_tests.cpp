@@ -100,4 +100,50 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindexmap_test)
+{
+    CBlockIndexMap map;
+    CBlockIndexArena arena;
+    std::vector<uint256> vHashes(10000);
+    std::vector<CBlockIndex*> vIndex(vHashes.size());
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i] = arena.Create();
+        std::pair<CBlockIndexMap::iterator, bool> ret = map.insert(std::make_pair(vHashes[i], vIndex[i]));
+        BOOST_CHECK(ret.second);
+        vIndex[i]->phashBlock = &ret.first->first;
+    }
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+    BOOST_CHECK_EQUAL(arena.size(), vHashes.size());
+
+    // the entries keep their keys and addresses while the table grows
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        CBlockIndexMap::const_iterator it = map.find(vHashes[i]);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK(it->second == vIndex[i]);
+        BOOST_CHECK(vIndex[i]->GetBlockHash() == vHashes[i]);
+        BOOST_CHECK(!map.insert(std::make_pair(vHashes[i], (CBlockIndex*)NULL)).second);
+    }
+
+    // entries that differ from existing ones in their cheap hash only are told apart
+    uint256 hash = vHashes[0];
+    *(hash.end() - 1) ^= 1;
+    BOOST_CHECK(map.find(hash) == map.end());
+    BOOST_CHECK_EQUAL(map.count(hash), 0U);
+    BOOST_CHECK(map[hash] == NULL);
+    BOOST_CHECK_EQUAL(map.count(hash), 1U);
+
+    // iteration is in insertion order
+    size_t i = 0;
+    for (CBlockIndexMap::iterator it = map.begin(); it != map.end(); it++, i++)
+        BOOST_CHECK(it->first == (i < vHashes.size() ? vHashes[i] : hash));
+    BOOST_CHECK_EQUAL(i, vHashes.size() + 1);
+
+    map.clear();
+    arena.Clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(vHashes[0]) == map.end());
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_dash.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static CCriticalSection csTest;
+
+static void HoldLock(int nMillis)
+{
+    LOCK(csTest);
+    MilliSleep(nMillis);
+}
+
+static bool FindSite(const std::vector<CLockSiteInfo>& vStats, const std::string& strName, CLockSiteInfo& infoRet)
+{
+    for (size_t i = 0; i < vStats.size(); i++) {
+        if (vStats[i].strName == strName && vStats[i].strFile == "test/sync_tests.cpp") {
+            infoRet = vStats[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(lockstats)
+{
+    bool fLockStatsOld = fLockStats;
+    EnableLockStats();
+    ResetLockStats();
+
+    for (int i = 0; i < 100; i++) {
+        LOCK(csTest);
+    }
+    {
+        TRY_LOCK(csTest, lockTest);
+        bool fLocked = lockTest;
+        BOOST_CHECK(fLocked);
+    }
+
+    // make one acquisition wait for another thread
+    boost::thread thread(boost::bind(&HoldLock, 100));
+    MilliSleep(20);
+    {
+        LOCK(csTest);
+    }
+    thread.join();
+
+    std::vector<CLockSiteInfo> vStats;
+    GetLockStats(vStats);
+
+    CLockSiteInfo info;
+    BOOST_CHECK(FindSite(vStats, "csTest", info));
+    size_t nAcquired = 0, nContended = 0, nHoldSamples = 0;
+    uint64_t nWaitMax = 0;
+    for (size_t i = 0; i < vStats.size(); i++) {
+        if (vStats[i].strName != "csTest")
+            continue;
+        nAcquired += vStats[i].nAcquired;
+        nContended += vStats[i].nContended;
+        nHoldSamples += vStats[i].nHoldSamples;
+        nWaitMax = std::max(nWaitMax, vStats[i].nWaitMaxMicros);
+    }
+    BOOST_CHECK_EQUAL(nAcquired, 103U);
+    BOOST_CHECK_EQUAL(nContended, 1U);
+    BOOST_CHECK(nWaitMax >= 10000);
+    BOOST_CHECK(nHoldSamples > 0);
+
+    ResetLockStats();
+    GetLockStats(vStats);
+    BOOST_CHECK(FindSite(vStats, "csTest", info));
+    BOOST_CHECK_EQUAL(info.nAcquired, 0U);
+
+    fLockStats = fLockStatsOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -83,4 +83,59 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+static void
+SignSpend(CMutableTransaction& tx, const CScript& scriptPubKey, const CKey& key)
+{
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig = CScript() << vchSig;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // parent, child spending the parent, a transaction with a bad signature and one with missing inputs
+    std::vector<CMutableTransaction> spends(4);
+    for (int i = 0; i < 4; i++) {
+        spends[i].vin.resize(1);
+        spends[i].vout.resize(1);
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+    }
+    spends[0].vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spends[0].vout[0].nValue = 11*CENT;
+    SignSpend(spends[0], scriptPubKey, coinbaseKey);
+
+    spends[1].vin[0].prevout = COutPoint(spends[0].GetHash(), 0);
+    spends[1].vout[0].nValue = 10*CENT;
+    SignSpend(spends[1], scriptPubKey, coinbaseKey);
+
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    spends[2].vin[0].prevout = COutPoint(coinbaseTxns[1].GetHash(), 0);
+    spends[2].vout[0].nValue = 11*CENT;
+    SignSpend(spends[2], scriptPubKey, otherKey);
+
+    spends[3].vin[0].prevout = COutPoint(GetRandHash(), 0);
+    spends[3].vout[0].nValue = 11*CENT;
+    SignSpend(spends[3], scriptPubKey, coinbaseKey);
+
+    std::vector<CTransaction> vtx(spends.begin(), spends.end());
+    std::vector<CValidationState> vState;
+    std::vector<bool> vAccepted, vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false), 2);
+    BOOST_CHECK(vAccepted[0] && vAccepted[1]);
+    BOOST_CHECK(mempool.exists(vtx[0].GetHash()) && mempool.exists(vtx[1].GetHash()));
+    BOOST_CHECK(!vAccepted[2] && vState[2].IsInvalid() && !vMissingInputs[2]);
+    BOOST_CHECK(!vAccepted[3] && vMissingInputs[3]);
+
+    // the preverified signatures don't make the checks under cs_main pass by themselves
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false), 0);
+    BOOST_CHECK_EQUAL(vState[0].GetRejectCode(), REJECT_ALREADY_KNOWN);
+    BOOST_CHECK(vState[2].IsInvalid());
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -489,4 +489,36 @@ BOOST_AUTO_TEST_CASE(test_ParseFixedPoint)
     BOOST_CHECK(!ParseFixedPoint("1.", 8, &amount));
 }
 
+BOOST_AUTO_TEST_CASE(util_LogAcceptCategory)
+{
+    bool fDebugOld = fDebug;
+    std::vector<std::string> vDebugOld = mapMultiArgs["-debug"];
+
+    fDebug = true;
+    mapMultiArgs["-debug"].clear();
+    mapMultiArgs["-debug"].push_back("net");
+    mapMultiArgs["-debug"].push_back("dash");
+    UpdateLogCategories();
+    BOOST_CHECK(LogAcceptCategory(NULL));
+    BOOST_CHECK(LogAcceptCategory("net"));
+    BOOST_CHECK(LogAcceptCategory("masternode"));
+    BOOST_CHECK(LogAcceptCategory("gobject"));
+    BOOST_CHECK(!LogAcceptCategory("mempool"));
+    BOOST_CHECK(!LogAcceptCategory("unknown"));
+
+    mapMultiArgs["-debug"].clear();
+    mapMultiArgs["-debug"].push_back("1");
+    UpdateLogCategories();
+    BOOST_CHECK(LogAcceptCategory("mempool"));
+    BOOST_CHECK(LogAcceptCategory("unknown"));
+
+    fDebug = false;
+    BOOST_CHECK(LogAcceptCategory(NULL));
+    BOOST_CHECK(!LogAcceptCategory("net"));
+
+    fDebug = fDebugOld;
+    mapMultiArgs["-debug"] = vDebugOld;
+    UpdateLogCategories();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
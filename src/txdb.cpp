@@ -8,17 +8,24 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
+#include <algorithm>
+#include <deque>
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
-static const char DB_COINS = 'c';
+static const char DB_COIN = 'C';
+static const char DB_COINS = 'c'; //! transaction records of the chainstate before per-output storage
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
@@ -33,16 +40,82 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
+/**
+ * One unspent output in the chainstate, keyed by (DB_COIN, outpoint), with the metadata of its
+ * transaction. Spending an output erases its record instead of rewriting the whole transaction.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 2 + fCoinBase)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+struct CCoinsOutputRecord
+{
+    int nVersion;
+    int nHeight;
+    bool fCoinBase;
+    CTxOut txout;
+
+    CCoinsOutputRecord() : nVersion(0), nHeight(0), fCoinBase(false) {}
+    CCoinsOutputRecord(const CCoins& coins, unsigned int n) :
+        nVersion(coins.nVersion), nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), txout(coins.vout[n]) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn) {
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nVersion));
+        READWRITE(VARINT(nCode));
+        nHeight = nCode / 2;
+        fCoinBase = nCode & 1;
+        READWRITE(REF(CTxOutCompressor(txout)));
+    }
+};
+
+/**
+ * Collect the output records of txid into coins, starting at the current position of pcursor
+ * and leaving it after the last one. Returns false if pcursor is not at an output of txid.
+ */
+static bool ReadCoinsOutputs(CDBIterator* pcursor, const uint256& txid, CCoins& coins, size_t* pnSize = NULL)
+{
+    coins.Clear();
+    bool fFound = false;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, COutPoint> key;
+        if (!pcursor->GetKey(key) || key.first != DB_COIN || key.second.hash != txid)
+            break;
+        CCoinsOutputRecord record;
+        if (!pcursor->GetValue(record))
+            throw std::runtime_error("Unable to read chainstate output record");
+        coins.fCoinBase = record.fCoinBase;
+        coins.nHeight = record.nHeight;
+        coins.nVersion = record.nVersion;
+        if (coins.vout.size() <= key.second.n)
+            coins.vout.resize(key.second.n + 1);
+        coins.vout[key.second.n] = record.txout;
+        if (pnSize)
+            *pnSize += pcursor->GetKeySize() + pcursor->GetValueSize();
+        fFound = true;
+    }
+    return fFound;
+}
+
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
 {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(make_pair(DB_COIN, COutPoint(txid, 0)));
+    return ReadCoinsOutputs(pcursor.get(), txid, coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(make_pair(DB_COIN, COutPoint(txid, 0)));
+    std::pair<char, COutPoint> key;
+    return pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COIN && key.second.hash == txid;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -52,29 +125,253 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+// mapCoins is left as it is, so that CCoinsViewWriteBehind can serve reads from it meanwhile
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(&db.GetObfuscateKey());
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t nWritten = 0;
+    size_t nErased = 0;
+    std::vector<bool> vOnDisk;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+            const uint256& txid = it->first;
+            const CCoins& coins = it->second.coins;
+            vOnDisk.assign(coins.vout.size(), false);
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH)) {
+                // Only touch the outputs that changed: erase the ones spent since they were
+                // read, keep the ones still unspent, write the ones a disconnect brought back
+                pcursor->Seek(make_pair(DB_COIN, COutPoint(txid, 0)));
+                for (; pcursor->Valid(); pcursor->Next()) {
+                    std::pair<char, COutPoint> key;
+                    if (!pcursor->GetKey(key) || key.first != DB_COIN || key.second.hash != txid)
+                        break;
+                    if (coins.IsAvailable(key.second.n)) {
+                        vOnDisk[key.second.n] = true;
+                    } else {
+                        batch.Erase(key);
+                        nErased++;
+                    }
+                }
+            }
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull() && !vOnDisk[i]) {
+                    batch.Write(make_pair(DB_COIN, COutPoint(txid, i)), CCoinsOutputRecord(coins, i));
+                    nWritten++;
+                }
+            }
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database, %u outputs written, %u erased...\n",
+        (unsigned int)changed, (unsigned int)count, (unsigned int)nWritten, (unsigned int)nErased);
     return db.WriteBatch(batch);
 }
 
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS)
+        return true;
+
+    LogPrintf("Upgrading chainstate database to per-output records...\n");
+    uiInterface.ShowProgress(_("Upgrading chainstate database..."), 0);
+    const size_t nBatchWrites = 1 << 16;
+    CDBBatch batch(&db.GetObfuscateKey());
+    size_t nWrites = 0;
+    int64_t nTransactions = 0;
+    int nLastProgress = 0;
+    std::pair<char, uint256> keyCompacted(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        if (ShutdownRequested())
+            break;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        CCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("%s: unable to read transaction record", __func__);
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull()) {
+                batch.Write(make_pair(DB_COIN, COutPoint(key.second, i)), CCoinsOutputRecord(coins, i));
+                nWrites++;
+            }
+        }
+        batch.Erase(key);
+        nWrites++;
+        nTransactions++;
+
+        if (nWrites >= nBatchWrites) {
+            // the old and new records of a transaction go in the same batch, so an
+            // interrupted upgrade simply carries on at the next start
+            db.WriteBatch(batch);
+            batch = CDBBatch(&db.GetObfuscateKey());
+            nWrites = 0;
+            db.CompactRange(keyCompacted, key);
+            keyCompacted = key;
+            // txids are uniformly distributed, the first two bytes tell the progress
+            int nProgress = (int)((0x100 * *key.second.begin() + *(key.second.begin() + 1)) * 100 / 65536);
+            if (nProgress > nLastProgress) {
+                LogPrintf("Upgrading chainstate database: %d%% (%d transactions)\n", nProgress, nTransactions);
+                uiInterface.ShowProgress(_("Upgrading chainstate database..."), nProgress);
+                nLastProgress = nProgress;
+            }
+        }
+        pcursor->Next();
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(keyCompacted, make_pair(DB_COINS, uint256S(std::string(64, 'f'))));
+    uiInterface.ShowProgress("", 100);
+    if (ShutdownRequested()) {
+        LogPrintf("Chainstate database upgrade interrupted, it continues at the next start\n");
+        return false;
+    }
+    LogPrintf("Chainstate database upgrade done, %d transactions\n", nTransactions);
+    return true;
+}
+
+CCoinsViewWriteBehind::CCoinsViewWriteBehind(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), nPendingUsage(0), fWriting(false), fFailed(false)
+{
+}
+
+CCoinsViewWriteBehind::~CCoinsViewWriteBehind()
+{
+    Wait();
+    if (threadWrite.joinable())
+        threadWrite.join();
+}
+
+bool CCoinsViewWriteBehind::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    // Not part of the pending write, so the base has it regardless of its progress
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewWriteBehind::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end())
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewWriteBehind::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fWriting && !hashPendingBlock.IsNull())
+            return hashPendingBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewWriteBehind::WaitLocked(boost::unique_lock<boost::mutex>& lock) const {
+    while (fWriting)
+        condWritten.wait(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewWriteBehind::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (!WaitLocked(lock))
+        return false;
+    if (threadWrite.joinable())
+        threadWrite.join();
+    mapPending.clear();
+    mapPending.swap(mapCoins);
+    hashPendingBlock = hashBlock;
+    nPendingUsage = memusage::DynamicUsage(mapPending);
+    for (CCoinsMap::const_iterator it = mapPending.begin(); it != mapPending.end(); it++)
+        nPendingUsage += it->second.coins.DynamicMemoryUsage();
+    fWriting = true;
+    threadWrite = boost::thread(boost::bind(&CCoinsViewWriteBehind::ThreadWrite, this));
+    return true;
+}
+
+void CCoinsViewWriteBehind::ThreadWrite() {
+    RenameThread("dash-coinsflush");
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    // mapPending is not modified while fWriting, so it is read here without holding cs
+    try {
+        fOk = base->BatchWrite(mapPending, hashPendingBlock);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    int64_t nTime = GetTimeMicros() - nStart;
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fOk) {
+        stats.nFlushes++;
+        stats.nLastTime = GetTime();
+        stats.nLastEntries = mapPending.size();
+        stats.nLastUsage = nPendingUsage;
+        stats.nLastWriteMicros = nTime;
+        stats.nTotalEntries += mapPending.size();
+        stats.nTotalWriteMicros += nTime;
+        LogPrint("coindb", "Wrote %u transactions (%.1f MiB) to the coin database in %.2fms\n",
+            (unsigned int)mapPending.size(), nPendingUsage * (1.0 / (1<<20)), nTime * 0.001);
+    } else {
+        LogPrintf("%s: failed to write to the coin database\n", __func__);
+        fFailed = true;
+    }
+    CCoinsMap().swap(mapPending);
+    nPendingUsage = 0;
+    fWriting = false;
+    condWritten.notify_all();
+}
+
+bool CCoinsViewWriteBehind::Wait() {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return WaitLocked(lock);
+}
+
+bool CCoinsViewWriteBehind::GetStats(CCoinsStats &statsOut) const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!WaitLocked(lock))
+            return false;
+    }
+    return base->GetStats(statsOut);
+}
+
+CCoinsViewCursor *CCoinsViewWriteBehind::Cursor() const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!WaitLocked(lock))
+            return NULL;
+    }
+    return base->Cursor();
+}
+
+bool CCoinsViewWriteBehind::IsWriting() const {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return fWriting;
+}
+
+size_t CCoinsViewWriteBehind::DynamicMemoryUsage() const {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nPendingUsage;
+}
+
+CCoinsFlushStats CCoinsViewWriteBehind::GetFlushStats() const {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return stats;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -98,52 +395,271 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
+namespace {
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
+/** The ranges of txids GetStats() splits the chainstate in, by the first byte of the txid */
+static const int COINS_STATS_PARTITIONS = 256;
+/** Serialized outputs a partition hands to the hasher at once */
+static const size_t COINS_STATS_CHUNK_SIZE = 1 << 20;
+/** Serialized outputs a partition reads ahead of the hasher at most */
+static const size_t COINS_STATS_MAX_QUEUED = 8 << 20;
+static const int MAX_COINS_STATS_THREADS = 8;
+
+/** The outputs of one partition of the chainstate, serialized as GetStats() hashes them */
+struct CCoinsStatsPartition
+{
+    std::deque<std::string> chunks;
+    size_t nQueued;
+    bool fDone;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+
+    CCoinsStatsPartition() : nQueued(0), fDone(false), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Reads the partitions of a snapshot of the chainstate from several threads, while the caller
+ * hashes them in key order. The threads take the partitions in order and only read a bounded
+ * amount ahead, so the partitions the caller waits for are always being read.
+ */
+class CCoinsStatsReader
+{
+private:
+    const CDBWrapper &db;
+    const leveldb::Snapshot *snapshot;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    boost::thread_group threads;
+    std::vector<CCoinsStatsPartition> vPartitions;
+    int nNextPartition;
+    bool fAbort;
+    std::string strError;
+
+    bool Push(CCoinsStatsPartition &partition, CDataStream &ss, bool fDone)
+    {
+        std::string chunk = ss.str();
+        ss.clear();
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (!fAbort && partition.nQueued >= COINS_STATS_MAX_QUEUED)
+            cond.wait(lock);
+        if (fAbort)
+            return false;
+        partition.nQueued += chunk.size();
+        partition.chunks.push_back(std::string());
+        partition.chunks.back().swap(chunk);
+        partition.fDone = fDone;
+        cond.notify_all();
+        return true;
+    }
+
+    void ThreadRead()
+    {
+        RenameThread("dash-coinsstats");
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+        while (true) {
+            int nPartition;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                if (fAbort || nNextPartition == COINS_STATS_PARTITIONS)
+                    return;
+                nPartition = nNextPartition++;
+            }
+            CCoinsStatsPartition &partition = vPartitions[nPartition];
+            CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+            uint256 txidFirst;
+            *txidFirst.begin() = nPartition;
+            try {
+                pcursor->Seek(make_pair(DB_COIN, COutPoint(txidFirst, 0)));
+                while (pcursor->Valid()) {
+                    std::pair<char, COutPoint> key;
+                    if (!pcursor->GetKey(key) || key.first != DB_COIN || *key.second.hash.begin() != nPartition)
+                        break;
+                    CCoins coins;
+                    size_t nSize = 0;
+                    ReadCoinsOutputs(pcursor.get(), key.second.hash, coins, &nSize);
+                    partition.nTransactions++;
+                    partition.nSerializedSize += nSize;
+                    for (unsigned int i=0; i<coins.vout.size(); i++) {
+                        const CTxOut &out = coins.vout[i];
+                        if (!out.IsNull()) {
+                            partition.nTransactionOutputs++;
+                            ss << VARINT(i+1);
+                            ss << out;
+                            partition.nTotalAmount += out.nValue;
+                        }
                     }
+                    ss << VARINT(0);
+                    if (ss.size() >= COINS_STATS_CHUNK_SIZE && !Push(partition, ss, false))
+                        return;
                 }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
-            } else {
-                return error("CCoinsViewDB::GetStats() : unable to read value");
+            } catch (const std::exception& e) {
+                boost::unique_lock<boost::mutex> lock(cs);
+                strError = e.what();
+                fAbort = true;
+                cond.notify_all();
+                return;
             }
-        } else {
-            break;
+            if (!Push(partition, ss, true))
+                return;
+        }
+    }
+
+public:
+    CCoinsStatsReader(const CDBWrapper &dbIn, const leveldb::Snapshot *snapshotIn, int nThreads) :
+        db(dbIn), snapshot(snapshotIn), vPartitions(COINS_STATS_PARTITIONS), nNextPartition(0), fAbort(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CCoinsStatsReader::ThreadRead, this));
+    }
+
+    ~CCoinsStatsReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fAbort = true;
+            cond.notify_all();
+        }
+        threads.join_all();
+    }
+
+    /** Feed the outputs of the partition to ss, returns false if reading them failed */
+    bool Hash(int nPartition, CHashWriter &ss, CCoinsStats &stats)
+    {
+        CCoinsStatsPartition &partition = vPartitions[nPartition];
+        while (true) {
+            std::string chunk;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fAbort && partition.chunks.empty() && !partition.fDone)
+                    cond.wait(lock);
+                if (fAbort)
+                    return error("CCoinsViewDB::GetStats() : %s", strError);
+                if (partition.chunks.empty())
+                    break;
+                chunk.swap(partition.chunks.front());
+                partition.chunks.pop_front();
+                partition.nQueued -= chunk.size();
+                cond.notify_all();
+            }
+            ss.write(chunk.data(), chunk.size());
+        }
+        stats.nTransactions += partition.nTransactions;
+        stats.nTransactionOutputs += partition.nTransactionOutputs;
+        stats.nSerializedSize += partition.nSerializedSize;
+        stats.nTotalAmount += partition.nTotalAmount;
+        return true;
+    }
+};
+
+/** Releases a snapshot of the database when going out of scope */
+class CDBSnapshotHolder
+{
+private:
+    const CDBWrapper &db;
+public:
+    const leveldb::Snapshot *snapshot;
+
+    CDBSnapshotHolder(const CDBWrapper &dbIn) : db(dbIn), snapshot(dbIn.GetSnapshot()) {}
+    ~CDBSnapshotHolder() { db.ReleaseSnapshot(snapshot); }
+};
+
+uint256 ReadBestBlock(CDBIterator *pcursor)
+{
+    uint256 hashBestChain;
+    char chKey;
+    pcursor->Seek(DB_BEST_BLOCK);
+    if (!pcursor->Valid() || !pcursor->GetKey(chKey) || chKey != DB_BEST_BLOCK || !pcursor->GetValue(hashBestChain))
+        return uint256();
+    return hashBestChain;
+}
+
+}
+
+bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
+    // All threads read the same snapshot, so the outputs, the counts and the best block agree
+    // even if the chainstate is written meanwhile. The partitions are hashed in key order,
+    // which gives the same hash as reading the chainstate serially.
+    CDBSnapshotHolder holder(db);
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator(holder.snapshot));
+        stats.hashBlock = ReadBestBlock(pcursor.get());
+    }
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+    stats.nTransactions = 0;
+    stats.nTransactionOutputs = 0;
+    stats.nSerializedSize = 0;
+    stats.nTotalAmount = 0;
+    {
+        CCoinsStatsReader reader(db, holder.snapshot, std::max(1, std::min(GetNumCores(), MAX_COINS_STATS_THREADS)));
+        for (int nPartition = 0; nPartition < COINS_STATS_PARTITIONS; nPartition++) {
+            boost::this_thread::interruption_point();
+            if (!reader.Hash(nPartition, ss, stats))
+                return false;
         }
-        pcursor->Next();
     }
     {
         LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+        BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+        stats.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
     }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
+CCoinsViewCursor *CCoinsViewDB::Cursor() const {
+    const leveldb::Snapshot *snapshot = db.GetSnapshot();
+    uint256 hashBestChain;
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+        hashBestChain = ReadBestBlock(pcursor.get());
+    }
+    return new CCoinsViewDBCursor(db, hashBestChain, snapshot);
+}
+
+CCoinsViewDBCursor::CCoinsViewDBCursor(const CDBWrapper &dbIn, const uint256 &hashBlockIn, const leveldb::Snapshot *snapshotIn) :
+    CCoinsViewCursor(hashBlockIn), db(dbIn), snapshot(snapshotIn), pcursor(dbIn.NewIterator(snapshotIn)), fValid(false)
+{
+    pcursor->Seek(DB_COIN);
+    Next();
+}
+
+CCoinsViewDBCursor::~CCoinsViewDBCursor() {
+    pcursor.reset();
+    db.ReleaseSnapshot(snapshot);
+}
+
+bool CCoinsViewDBCursor::GetKey(uint256 &key) const {
+    if (!fValid)
+        return false;
+    key = txid;
+    return true;
+}
+
+bool CCoinsViewDBCursor::GetValue(CCoins &coinsOut) const {
+    if (!fValid)
+        return false;
+    coinsOut = coins;
+    return true;
+}
+
+bool CCoinsViewDBCursor::Valid() const {
+    return fValid;
+}
+
+void CCoinsViewDBCursor::Next() {
+    // The outputs of the next transaction are read here already, which moves the iterator past them
+    std::pair<char, COutPoint> key;
+    fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COIN;
+    if (fValid) {
+        txid = key.second.hash;
+        ReadCoinsOutputs(pcursor.get(), txid, coins);
+    }
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -195,20 +711,44 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
+/** Position pcursor right after the entry keyed (prefix, keyAfter), skipping it if present */
+template <typename K>
+static void SeekAfter(CDBIterator* pcursor, char prefix, const K& keyAfter)
+{
+    pcursor->Seek(make_pair(prefix, keyAfter));
+    if (!pcursor->Valid())
+        return;
+    CDataStream ssAfter(SER_DISK, CLIENT_VERSION), ssKey(SER_DISK, CLIENT_VERSION);
+    ssAfter << keyAfter;
+    std::pair<char, K> key;
+    if (pcursor->GetKey(key) && key.first == prefix) {
+        ssKey << key.second;
+        if (ssKey.str() == ssAfter.str())
+            pcursor->Next();
+    }
+}
+
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           const CAddressUnspentKey *pkeyAfter, size_t nMaxEntries) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pkeyAfter) {
+        SeekAfter(pcursor.get(), DB_ADDRESSUNSPENTINDEX, *pkeyAfter);
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
-    while (pcursor->Valid()) {
+    size_t nEntries = 0;
+    while (pcursor->Valid() && (nMaxEntries == 0 || nEntries < nMaxEntries)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(make_pair(key.second, nValue));
+                nEntries++;
                 pcursor->Next();
             } else {
                 return error("failed to get address unspent value");
@@ -237,17 +777,21 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+                                    int start, int end,
+                                    const CAddressIndexKey *pkeyAfter, size_t nMaxEntries) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pkeyAfter) {
+        SeekAfter(pcursor.get(), DB_ADDRESSINDEX, *pkeyAfter);
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
-    while (pcursor->Valid()) {
+    size_t nEntries = 0;
+    while (pcursor->Valid() && (nMaxEntries == 0 || nEntries < nMaxEntries)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
@@ -257,6 +801,7 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(make_pair(key.second, nValue));
+                nEntries++;
                 pcursor->Next();
             } else {
                 return error("failed to get address index value");
@@ -307,10 +852,48 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+namespace {
+/** The leading fields of a CDiskBlockIndex, enough to order the entries by height */
+struct CDiskBlockIndexHeight
+{
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        int nClientVersion = 0;
+        READWRITE(VARINT(nClientVersion));
+        READWRITE(VARINT(nHeight));
+    }
+};
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
+    // Create the entries in height order first, so that the arena stores a chain contiguously
+    // and walking it back touches neighbouring memory
+    std::vector<std::pair<int, uint256> > vHeights;
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        CDiskBlockIndexHeight diskheight;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+            break;
+        if (!pcursor->GetValue(diskheight))
+            return error("LoadBlockIndex() : failed to read value");
+        vHeights.push_back(std::make_pair(diskheight.nHeight, key.second));
+        pcursor->Next();
+    }
+    std::sort(vHeights.begin(), vHeights.end());
+    mapBlockIndex.reserve(vHeights.size());
+    for (size_t i = 0; i < vHeights.size(); i++)
+        InsertBlockIndex(vHeights[i].second);
+    std::vector<std::pair<int, uint256> >().swap(vHeights);
+
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
     // Load mapBlockIndex
@@ -8,12 +8,16 @@
 
 #include "coins.h"
 #include "dbwrapper.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
 class CBlockFileInfo;
 class CBlockIndex;
 struct CDiskTxPos;
@@ -48,6 +52,99 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+    CCoinsViewCursor *Cursor() const;
+
+    /**
+     * Convert the per-transaction records of older versions to per-output ones. Returns
+     * false on errors and if interrupted by a shutdown, the upgrade then resumes next time.
+     */
+    bool Upgrade();
+};
+
+/** Cursor over a snapshot of the coin database, see CCoinsViewDB::Cursor() */
+class CCoinsViewDBCursor : public CCoinsViewCursor
+{
+public:
+    ~CCoinsViewDBCursor();
+
+    bool GetKey(uint256 &key) const;
+    bool GetValue(CCoins &coins) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CCoinsViewDBCursor(const CDBWrapper &dbIn, const uint256 &hashBlockIn, const leveldb::Snapshot *snapshotIn);
+
+    const CDBWrapper &db;
+    const leveldb::Snapshot *snapshot;
+    boost::scoped_ptr<CDBIterator> pcursor;
+    uint256 txid;                  //! Transaction the cursor is at
+    CCoins coins;                  //! and its outputs, read ahead
+    bool fValid;
+
+    friend class CCoinsViewDB;
+};
+
+/** Statistics of the chainstate flushes done by CCoinsViewWriteBehind */
+struct CCoinsFlushStats
+{
+    uint64_t nFlushes;     //! Number of flushes completed
+    int64_t nLastTime;     //! Time the last flush completed
+    uint64_t nLastEntries; //! Number of transactions written by the last flush
+    uint64_t nLastUsage;   //! Memory usage of the entries written by the last flush
+    int64_t nLastWriteMicros; //! Time the last flush took to write in the background
+    uint64_t nTotalEntries;
+    int64_t nTotalWriteMicros;
+
+    CCoinsFlushStats() : nFlushes(0), nLastTime(0), nLastEntries(0), nLastUsage(0), nLastWriteMicros(0), nTotalEntries(0), nTotalWriteMicros(0) {}
+};
+
+/**
+ * CCoinsView that writes the modifications pushed to it to its base from a background thread,
+ * so that a flush of the coins cache does not block validation while the database writes.
+ *
+ * The entries being written stay readable here until the write completes. BatchWrite() waits
+ * for the previous write to finish first, so writes reach the base in order. Call Wait() when
+ * the base has to be up to date, e.g. before pruning block files.
+ */
+class CCoinsViewWriteBehind : public CCoinsViewBacked
+{
+private:
+    mutable CWaitableCriticalSection cs;
+    mutable CConditionVariable condWritten;
+    boost::thread threadWrite;
+    CCoinsMap mapPending;      //! Entries being written, not modified while fWriting
+    uint256 hashPendingBlock;
+    size_t nPendingUsage;
+    bool fWriting;
+    bool fFailed;
+    CCoinsFlushStats stats;
+
+    void ThreadWrite();
+    bool WaitLocked(boost::unique_lock<boost::mutex>& lock) const;
+
+public:
+    CCoinsViewWriteBehind(CCoinsView* viewIn);
+    ~CCoinsViewWriteBehind();
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool GetStats(CCoinsStats &stats) const;
+    CCoinsViewCursor *Cursor() const;
+
+    //! Wait until the pending write completed, returns false if it failed
+    bool Wait();
+
+    //! Whether a write is in progress
+    bool IsWriting() const;
+
+    //! Memory usage of the entries being written
+    size_t DynamicMemoryUsage() const;
+
+    CCoinsFlushStats GetFlushStats() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -70,12 +167,14 @@ public:
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CAddressUnspentKey *pkeyAfter = NULL, size_t nMaxEntries = 0);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0,
+                          const CAddressIndexKey *pkeyAfter = NULL, size_t nMaxEntries = 0);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
     bool WriteFlag(const std::string &name, bool fValue);
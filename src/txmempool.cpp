@@ -422,48 +422,80 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
+CMempoolAddressKeyHasher::CMempoolAddressKeyHasher() : salt(GetRandHash()) {}
+
+struct CompareAddressDeltaKey
+{
+    bool operator()(const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& a,
+                    const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& b) const
+    {
+        return CMempoolAddressDeltaKeyCompare()(a.first, b.first);
+    }
+};
+
+/** Address index type and hash of a P2SH or P2PKH script, read in place */
+static bool ExtractIndexAddress(const CScript& script, int& type, uint160& hash)
+{
+    if (script.IsPayToScriptHash()) {
+        memcpy(hash.begin(), &script[2], 20);
+        type = 2;
+        return true;
+    }
+    if (script.IsPayToPublicKeyHash()) {
+        memcpy(hash.begin(), &script[3], 20);
+        type = 1;
+        return true;
+    }
+    return false;
+}
+
+std::vector<CMempoolSpentOutput>& CTxMemPool::addSpentOutputs(const CTransaction& tx, const CCoinsViewCache& view)
+{
+    AssertLockHeld(cs);
+    std::pair<spentOutputsMap::iterator, bool> ret = mapSpentOutputs.insert(make_pair(tx.GetHash(), std::vector<CMempoolSpentOutput>()));
+    std::vector<CMempoolSpentOutput>& vSpent = ret.first->second;
+    if (!ret.second)
+        return vSpent;
+
+    vSpent.resize(tx.vin.size());
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
+        vSpent[j].nValue = prevout.nValue;
+        if (!ExtractIndexAddress(prevout.scriptPubKey, vSpent[j].addressType, vSpent[j].addressHash))
+            vSpent[j].addressType = 0;
+    }
+    cachedIndexUsage += memusage::DynamicUsage(vSpent);
+    return vSpent;
+}
+
 void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
+    txiter it = mapTx.find(tx.GetHash());
+    assert(it != mapTx.end());
+    const CTxMemPoolEntry* pentry = &*it;
+    const std::vector<CMempoolSpentOutput>& vSpent = addSpentOutputs(tx, view);
 
-    uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
-        const CTxOut &prevout = view.GetOutputFor(input);
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        }
+        if (vSpent[j].addressType == 0)
+            continue;
+        addressRefs& refs = mapAddress.insert(make_pair(CMempoolAddressKey(vSpent[j].addressType, vSpent[j].addressHash), addressRefs())).first->second;
+        cachedIndexUsage -= memusage::DynamicUsage(refs);
+        refs.push_back(CMempoolAddressRef(pentry, j, true));
+        cachedIndexUsage += memusage::DynamicUsage(refs);
     }
 
+    int type;
+    uint160 addressHash;
     for (unsigned int k = 0; k < tx.vout.size(); k++) {
-        const CTxOut &out = tx.vout[k];
-        if (out.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        }
+        if (!ExtractIndexAddress(tx.vout[k].scriptPubKey, type, addressHash))
+            continue;
+        addressRefs& refs = mapAddress.insert(make_pair(CMempoolAddressKey(type, addressHash), addressRefs())).first->second;
+        cachedIndexUsage -= memusage::DynamicUsage(refs);
+        refs.push_back(CMempoolAddressRef(pentry, k, false));
+        cachedIndexUsage += memusage::DynamicUsage(refs);
     }
-
-    mapAddressInserted.insert(make_pair(txhash, inserted));
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
@@ -471,94 +503,90 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
 {
     LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
-        }
-    }
-    return true;
-}
-
-bool CTxMemPool::removeAddressIndex(const uint256 txhash)
-{
-    LOCK(cs);
-    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
-
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+        addressRefsMap::const_iterator ait = mapAddress.find(CMempoolAddressKey((*it).second, (*it).first));
+        if (ait == mapAddress.end())
+            continue;
+        size_t nBegin = results.size();
+        BOOST_FOREACH(const CMempoolAddressRef& ref, ait->second) {
+            const CTransaction& tx = ref.pentry->GetTx();
+            CMempoolAddressDeltaKey key((*it).second, (*it).first, tx.GetHash(), ref.nIndex, ref.fSpending);
+            if (ref.fSpending) {
+                const COutPoint& prevout = tx.vin[ref.nIndex].prevout;
+                CAmount nValue = mapSpentOutputs.find(tx.GetHash())->second[ref.nIndex].nValue;
+                results.push_back(make_pair(key, CMempoolAddressDelta(ref.pentry->GetTime(), nValue * -1, prevout.hash, prevout.n)));
+            } else {
+                results.push_back(make_pair(key, CMempoolAddressDelta(ref.pentry->GetTime(), tx.vout[ref.nIndex].nValue)));
+            }
         }
-        mapAddressInserted.erase(it);
+        // by transaction, like the ordered map this index used to be
+        std::sort(results.begin() + nBegin, results.end(), CompareAddressDeltaKey());
     }
-
     return true;
 }
 
 void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
-
-    const CTransaction& tx = entry.GetTx();
-    std::vector<CSpentIndexKey> inserted;
-
-    uint256 txhash = tx.GetHash();
-    for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
-        const CTxOut &prevout = view.GetOutputFor(input);
-        uint160 addressHash;
-        int addressType;
-
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-            addressType = 2;
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-            addressType = 1;
-        } else {
-            addressHash.SetNull();
-            addressType = 0;
-        }
-
-        CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
-        CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
-
-        mapSpent.insert(make_pair(key, value));
-        inserted.push_back(key);
-
-    }
-
-    mapSpentInserted.insert(make_pair(txhash, inserted));
+    // the spending inputs themselves are found through mapNextTx
+    addSpentOutputs(entry.GetTx(), view);
 }
 
 bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     LOCK(cs);
-    mapSpentIndex::iterator it;
-
-    it = mapSpent.find(key);
-    if (it != mapSpent.end()) {
-        value = it->second;
-        return true;
-    }
-    return false;
+    std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.find(COutPoint(key.txid, key.outputIndex));
+    if (it == mapNextTx.end())
+        return false;
+    const uint256& txhash = it->second.ptx->GetHash();
+    spentOutputsMap::const_iterator sit = mapSpentOutputs.find(txhash);
+    if (sit == mapSpentOutputs.end())
+        return false;
+    const CMempoolSpentOutput& spent = sit->second[it->second.n];
+    value = CSpentIndexValue(txhash, it->second.n, -1, spent.nValue, spent.addressType, spent.addressHash);
+    return true;
 }
 
-bool CTxMemPool::removeSpentIndex(const uint256 txhash)
+void CTxMemPool::removeIndexes(txiter it)
 {
-    LOCK(cs);
-    mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
+    AssertLockHeld(cs);
+    const CTransaction& tx = it->GetTx();
+    spentOutputsMap::iterator sit = mapSpentOutputs.find(tx.GetHash());
+    if (sit == mapSpentOutputs.end())
+        return;
 
-    if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
+    const CTxMemPoolEntry* pentry = &*it;
+    const std::vector<CMempoolSpentOutput>& vSpent = sit->second;
+    std::vector<std::pair<CMempoolAddressKey, CMempoolAddressRef> > vRefs;
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        if (vSpent[j].addressType != 0)
+            vRefs.push_back(make_pair(CMempoolAddressKey(vSpent[j].addressType, vSpent[j].addressHash), CMempoolAddressRef(pentry, j, true)));
+    }
+    int type;
+    uint160 addressHash;
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        if (ExtractIndexAddress(tx.vout[k].scriptPubKey, type, addressHash))
+            vRefs.push_back(make_pair(CMempoolAddressKey(type, addressHash), CMempoolAddressRef(pentry, k, false)));
+    }
+
+    for (unsigned int i = 0; i < vRefs.size(); i++) {
+        addressRefsMap::iterator ait = mapAddress.find(vRefs[i].first);
+        if (ait == mapAddress.end())
+            continue;
+        addressRefs& refs = ait->second;
+        addressRefs::iterator rit = std::find(refs.begin(), refs.end(), vRefs[i].second);
+        if (rit == refs.end())
+            continue;
+        cachedIndexUsage -= memusage::DynamicUsage(refs);
+        refs.erase(rit);
+        if (refs.empty()) {
+            mapAddress.erase(ait);
+        } else {
+            cachedIndexUsage += memusage::DynamicUsage(refs);
         }
-        mapSpentInserted.erase(it);
     }
 
-    return true;
+    cachedIndexUsage -= memusage::DynamicUsage(sit->second);
+    mapSpentOutputs.erase(sit);
 }
 
 void CTxMemPool::removeUnchecked(txiter it)
@@ -571,11 +599,10 @@ void CTxMemPool::removeUnchecked(txiter it)
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
+    removeIndexes(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(hash);
-    removeAddressIndex(hash);
-    removeSpentIndex(hash);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -733,8 +760,11 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapSpentOutputs.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    cachedIndexUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -999,7 +1029,12 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + cachedInnerUsage + IndexMemoryUsage();
+}
+
+size_t CTxMemPool::IndexMemoryUsage() const {
+    LOCK(cs);
+    return memusage::DynamicUsage(mapAddress) + memusage::DynamicUsage(mapSpentOutputs) + cachedIndexUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage) {
@@ -1109,7 +1144,8 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
-    while (DynamicMemoryUsage() > sizelimit) {
+    // the hash tables of the indexes take some memory even when the pool is empty
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::nth_index<1>::type::iterator it = mapTx.get<1>().begin();
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
@@ -13,6 +13,7 @@
 #include "spentindex.h"
 #include "amount.h"
 #include "coins.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
@@ -204,7 +205,7 @@ struct mempoolentry_txid
 class CompareTxMemPoolEntryByDescendantScore
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         bool fUseADescendants = UseDescendantScore(a);
         bool fUseBDescendants = UseDescendantScore(b);
@@ -226,7 +227,7 @@ public:
     }
 
     // Calculate which score to use for an entry (avoiding division).
-    bool UseDescendantScore(const CTxMemPoolEntry &a)
+    bool UseDescendantScore(const CTxMemPoolEntry &a) const
     {
         double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
         double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
@@ -241,7 +242,7 @@ public:
 class CompareTxMemPoolEntryByScore
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
         double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
@@ -255,7 +256,7 @@ public:
 class CompareTxMemPoolEntryByEntryTime
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         return a.GetTime() < b.GetTime();
     }
@@ -277,6 +278,59 @@ public:
     size_t DynamicMemoryUsage() const { return 0; }
 };
 
+/** Address of the mempool address index, the bucket key of CTxMemPool::mapAddress */
+struct CMempoolAddressKey
+{
+    uint160 addressBytes;
+    int type;
+
+    CMempoolAddressKey(int typeIn, const uint160& addressBytesIn) : addressBytes(addressBytesIn), type(typeIn) {}
+
+    bool operator==(const CMempoolAddressKey& other) const {
+        return type == other.type && addressBytes == other.addressBytes;
+    }
+};
+
+class CMempoolAddressKeyHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CMempoolAddressKeyHasher();
+
+    size_t operator()(const CMempoolAddressKey& key) const {
+        uint256 padded;
+        memcpy(padded.begin(), key.addressBytes.begin(), key.addressBytes.size());
+        *(padded.end() - 1) = (unsigned char)key.type;
+        return padded.GetHash(salt);
+    }
+};
+
+/** An input (fSpending) or output of a mempool transaction paying to or spending from an indexed address */
+struct CMempoolAddressRef
+{
+    const CTxMemPoolEntry* pentry;
+    uint32_t nIndex : 31;
+    uint32_t fSpending : 1;
+
+    CMempoolAddressRef() : pentry(NULL), nIndex(0), fSpending(0) {}
+    CMempoolAddressRef(const CTxMemPoolEntry* pentryIn, uint32_t nIndexIn, bool fSpendingIn) :
+        pentry(pentryIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    bool operator==(const CMempoolAddressRef& other) const {
+        return pentry == other.pentry && nIndex == other.nIndex && fSpending == other.fSpending;
+    }
+};
+
+/** Amount and address of an output spent by a mempool transaction, addressType 0 if the script has none */
+struct CMempoolSpentOutput
+{
+    CAmount nValue;
+    uint160 addressHash;
+    int addressType;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -422,21 +476,27 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
-    addressDeltaMap mapAddress;
-
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-    addressDeltaMapInserted mapAddressInserted;
+    /**
+     * Address index: every indexed address maps to the inputs and outputs of mempool transactions
+     * using it, most addresses have a single one which is stored inline. The spent index needs no
+     * map of its own, mapNextTx finds the spending input and mapSpentOutputs what it spends.
+     */
+    typedef prevector<1, CMempoolAddressRef> addressRefs;
+    typedef boost::unordered_map<CMempoolAddressKey, addressRefs, CMempoolAddressKeyHasher> addressRefsMap;
+    addressRefsMap mapAddress;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
-    mapSpentIndex mapSpent;
+    /** The outputs spent by each indexed transaction, in the order of its inputs */
+    typedef boost::unordered_map<uint256, std::vector<CMempoolSpentOutput>, CCoinsKeyHasher> spentOutputsMap;
+    spentOutputsMap mapSpentOutputs;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
-    mapSpentIndexInserted mapSpentInserted;
+    uint64_t cachedIndexUsage; //! dynamic memory usage of the elements of mapAddress and mapSpentOutputs
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    std::vector<CMempoolSpentOutput>& addSpentOutputs(const CTransaction& tx, const CCoinsViewCache& view);
+    void removeIndexes(txiter it);
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -465,14 +525,13 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
+    /** Index a transaction already added with addUnchecked, view must provide the outputs it spends */
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
-    bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool removeSpentIndex(const uint256 txhash);
 
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -590,6 +649,8 @@ public:
     bool ReadFeeEstimates(CAutoFile& filein);
 
     size_t DynamicMemoryUsage() const;
+    /** Share of DynamicMemoryUsage taken by the address and spent indexes */
+    size_t IndexMemoryUsage() const;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
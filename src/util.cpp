@@ -78,6 +78,7 @@
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
+#include <boost/atomic.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
@@ -209,6 +210,82 @@ static FILE* fileout = NULL;
 static boost::mutex* mutexDebugLog = NULL;
 static list<string> *vMsgsBeforeOpenLog;
 
+/**
+ * Lines a thread logged which the log writer thread did not write out yet. Every
+ * logging thread has a ring of its own that only it pushes to and only the writer
+ * pops from, so handing a line over takes no lock.
+ */
+class CLogRing
+{
+public:
+    static const size_t CAPACITY = 1024;
+
+    struct Line {
+        uint64_t nSequence; // orders the lines of all threads
+        std::string str;
+    };
+
+private:
+    Line vLines[CAPACITY];
+    boost::atomic<size_t> nHead; // next slot the owner thread fills
+    boost::atomic<size_t> nTail; // next slot the writer empties
+
+public:
+    CLogRing() : nHead(0), nTail(0) {}
+
+    /** Owner thread: take over str, returns false if the ring is full */
+    bool Push(uint64_t nSequence, std::string& str, size_t& nUsedRet)
+    {
+        size_t nPos = nHead.load(boost::memory_order_relaxed);
+        nUsedRet = nPos - nTail.load(boost::memory_order_acquire);
+        if (nUsedRet == CAPACITY)
+            return false;
+        Line& line = vLines[nPos % CAPACITY];
+        line.nSequence = nSequence;
+        line.str.swap(str);
+        nHead.store(nPos + 1, boost::memory_order_release);
+        nUsedRet++;
+        return true;
+    }
+
+    /** Writer thread: move all pending lines to vLinesOut */
+    void PopAll(std::vector<Line>& vLinesOut)
+    {
+        size_t nPos = nTail.load(boost::memory_order_relaxed);
+        size_t nEnd = nHead.load(boost::memory_order_acquire);
+        for (; nPos != nEnd; nPos++) {
+            Line& line = vLines[nPos % CAPACITY];
+            vLinesOut.push_back(Line());
+            vLinesOut.back().nSequence = line.nSequence;
+            vLinesOut.back().str.swap(line.str);
+        }
+        nTail.store(nPos, boost::memory_order_release);
+    }
+
+    bool IsEmpty() const
+    {
+        return nTail.load(boost::memory_order_acquire) == nHead.load(boost::memory_order_acquire);
+    }
+};
+
+/**
+ * Rings of the threads logging to debug.log, rings of threads that ended are dropped
+ * by the writer once they are drained. Initialized and leaked like mutexDebugLog.
+ */
+static boost::mutex* mutexLogRings = NULL;
+static std::list<boost::shared_ptr<CLogRing> >* listLogRings = NULL;
+static boost::thread_specific_ptr<boost::shared_ptr<CLogRing> >* ptrLogRing = NULL;
+static boost::condition_variable* condLogWriter = NULL;
+static boost::thread* threadLogWriter = NULL;
+
+static boost::atomic<bool> fLogWriterRunning(false);
+static boost::atomic<uint64_t> nLogSequence(0);
+static boost::atomic<uint64_t> nLogLinesDropped(0);
+static uint64_t nLogLinesDroppedReported = 0; // guarded by mutexDebugLog
+
+//! How often the writer thread wakes up to write out the queued lines
+static const int LOG_WRITER_INTERVAL_MILLIS = 100;
+
 static int FileWriteStr(const std::string &str, FILE *fp)
 {
     return fwrite(str.data(), 1, str.size(), fp);
@@ -219,73 +296,187 @@ static void DebugPrintInit()
     assert(mutexDebugLog == NULL);
     mutexDebugLog = new boost::mutex();
     vMsgsBeforeOpenLog = new list<string>;
+    mutexLogRings = new boost::mutex();
+    listLogRings = new std::list<boost::shared_ptr<CLogRing> >();
+    ptrLogRing = new boost::thread_specific_ptr<boost::shared_ptr<CLogRing> >();
+    condLogWriter = new boost::condition_variable();
 }
 
-void OpenDebugLog()
+/** The ring of the calling thread, registered with the writer on first use */
+static CLogRing& GetLogRing()
 {
-    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    boost::shared_ptr<CLogRing>* pring = ptrLogRing->get();
+    if (pring == NULL) {
+        pring = new boost::shared_ptr<CLogRing>(new CLogRing());
+        ptrLogRing->reset(pring);
+        boost::mutex::scoped_lock scoped_lock(*mutexLogRings);
+        listLogRings->push_back(*pring);
+    }
+    return **pring;
+}
+
+/** Write the queued lines of all threads to debug.log, in the order they were logged */
+static void WriteQueuedLogLines(std::vector<CLogRing::Line>& vLines)
+{
+    {
+        boost::mutex::scoped_lock scoped_lock(*mutexLogRings);
+        std::list<boost::shared_ptr<CLogRing> >::iterator it = listLogRings->begin();
+        while (it != listLogRings->end()) {
+            (*it)->PopAll(vLines);
+            // the thread of a ring only we still refer to has ended
+            if (it->unique() && (*it)->IsEmpty())
+                it = listLogRings->erase(it);
+            else
+                ++it;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, size_t> > vOrder;
+    vOrder.reserve(vLines.size());
+    for (size_t i = 0; i < vLines.size(); i++)
+        vOrder.push_back(std::make_pair(vLines[i].nSequence, i));
+    std::sort(vOrder.begin(), vOrder.end());
+
     boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
 
-    assert(fileout == NULL);
-    assert(vMsgsBeforeOpenLog);
-    boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-    fileout = fopen(pathDebug.string().c_str(), "a");
-    if (fileout) setbuf(fileout, NULL); // unbuffered
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(),"a",fileout) == NULL) {
+            vLines.clear();
+            return;
+        }
+    }
 
-    // dump buffered messages from before we opened the log
-    while (!vMsgsBeforeOpenLog->empty()) {
-        FileWriteStr(vMsgsBeforeOpenLog->front(), fileout);
-        vMsgsBeforeOpenLog->pop_front();
+    uint64_t nDropped = nLogLinesDropped.load();
+    if (nDropped != nLogLinesDroppedReported) {
+        FileWriteStr(strprintf("*** %u log lines dropped, logging is falling behind\n", nDropped - nLogLinesDroppedReported), fileout);
+        nLogLinesDroppedReported = nDropped;
     }
+    for (size_t i = 0; i < vOrder.size(); i++)
+        FileWriteStr(vLines[vOrder[i].second].str, fileout);
+    if (!vLines.empty())
+        fflush(fileout);
+    vLines.clear();
+}
 
-    delete vMsgsBeforeOpenLog;
-    vMsgsBeforeOpenLog = NULL;
+static void ThreadLogWriter()
+{
+    std::vector<CLogRing::Line> vLines;
+    while (fLogWriterRunning.load()) {
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexLogRings);
+            condLogWriter->timed_wait(scoped_lock, boost::posix_time::milliseconds(LOG_WRITER_INTERVAL_MILLIS));
+        }
+        WriteQueuedLogLines(vLines);
+    }
 }
 
-bool LogAcceptCategory(const char* category)
+void OpenDebugLog()
 {
-    if (category != NULL)
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
     {
-        // Give each thread quick access to -debug settings.
-        // This helps prevent issues debugging global destructors,
-        // where mapMultiArgs might be deleted before another
-        // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
-
-        if (!fDebug) {
-            if (ptrCategory.get() != NULL) {
-                LogPrintf("debug turned off: thread %s\n", GetThreadName());
-                ptrCategory.release();
-            }
-            return false;
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+
+        assert(fileout == NULL);
+        assert(vMsgsBeforeOpenLog);
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        fileout = fopen(pathDebug.string().c_str(), "a");
+
+        // dump buffered messages from before we opened the log
+        while (!vMsgsBeforeOpenLog->empty()) {
+            if (fileout) FileWriteStr(vMsgsBeforeOpenLog->front(), fileout);
+            vMsgsBeforeOpenLog->pop_front();
         }
+        if (fileout) fflush(fileout);
 
-        if (ptrCategory.get() == NULL)
-        {
-            std::string strThreadName = GetThreadName();
-            LogPrintf("debug turned on:\n");
-            for (int i = 0; i < (int)mapMultiArgs["-debug"].size(); ++i)
-                LogPrintf("  thread %s category %s\n", strThreadName, mapMultiArgs["-debug"][i]);
-            const vector<string>& categories = mapMultiArgs["-debug"];
-            ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
-            // thread_specific_ptr automatically deletes the set when the thread ends.
+        delete vMsgsBeforeOpenLog;
+        vMsgsBeforeOpenLog = NULL;
+    }
+
+    // from now on lines are queued and written out by the log writer thread
+    if (fileout) {
+        fLogWriterRunning.store(true);
+        threadLogWriter = new boost::thread(&ThreadLogWriter);
+    }
+}
+
+void StopDebugLogWriter()
+{
+    if (!fLogWriterRunning.exchange(false))
+        return;
+    condLogWriter->notify_one();
+    threadLogWriter->join();
+    delete threadLogWriter;
+    threadLogWriter = NULL;
+
+    // lines queued in the meantime
+    std::vector<CLogRing::Line> vLines;
+    WriteQueuedLogLines(vLines);
+}
+
+uint64_t GetLogLinesDropped()
+{
+    return nLogLinesDropped.load();
+}
+
+/**
+ * Categories known to LogPrint, each gets a bit in nLogCategories. Categories
+ * missing here are only logged with -debug=1.
+ */
+static const char* const LOG_CATEGORIES[] = {
+    "addrman", "alert", "bench", "cmpctblock", "coindb", "db", "estimatefee", "http", "libevent",
+    "lock", "mempool", "mempoolrej", "net", "partitioncheck", "proxy", "prune", "qt",
+    "rand", "reindex", "rpc", "selectcoins", "tor", "zmq",
+    // Dash categories
+    "gobject", "instantsend", "keepass", "masternode", "mnpayments", "privatesend", "spork",
+};
+static const size_t LOG_CATEGORIES_COUNT = sizeof(LOG_CATEGORIES) / sizeof(LOG_CATEGORIES[0]);
+static const uint32_t LOG_ALL = 0xffffffff;
+
+//! Bits of the categories enabled by -debug, LOG_ALL with -debug=1
+static boost::atomic<uint32_t> nLogCategories(0);
+
+static uint32_t LogCategoryBit(const char* category)
+{
+    for (size_t i = 0; i < LOG_CATEGORIES_COUNT; i++) {
+        if (strcmp(category, LOG_CATEGORIES[i]) == 0)
+            return (uint32_t)1 << i;
+    }
+    // unknown categories are only in LOG_ALL
+    return (uint32_t)1 << 31;
+}
+
+void UpdateLogCategories()
+{
+    uint32_t nCategories = 0;
+    BOOST_FOREACH(const std::string& strCategory, mapMultiArgs["-debug"]) {
+        if (strCategory == "" || strCategory == "1") {
+            nCategories = LOG_ALL;
+        } else if (strCategory == "dash") {
             // "dash" is a composite category enabling all Dash-related debug output
-            if(ptrCategory->count(string("dash"))) {
-                ptrCategory->insert(string("privatesend"));
-                ptrCategory->insert(string("instantsend"));
-                ptrCategory->insert(string("masternode"));
-                ptrCategory->insert(string("spork"));
-                ptrCategory->insert(string("keepass"));
-                ptrCategory->insert(string("mnpayments"));
-                ptrCategory->insert(string("gobject"));
-            }
+            const char* const vDashCategories[] = {"privatesend", "instantsend", "masternode", "spork", "keepass", "mnpayments", "gobject"};
+            for (size_t i = 0; i < sizeof(vDashCategories) / sizeof(vDashCategories[0]); i++)
+                nCategories |= LogCategoryBit(vDashCategories[i]);
+        } else if (strCategory != "0") {
+            uint32_t nBit = LogCategoryBit(strCategory.c_str());
+            if (nBit != ((uint32_t)1 << 31))
+                nCategories |= nBit;
         }
-        const set<string>& setCategories = *ptrCategory.get();
+    }
+    nLogCategories.store(nCategories);
+}
+
+bool LogAcceptCategory(const char* category)
+{
+    if (category != NULL)
+    {
+        if (!fDebug)
+            return false;
 
         // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string("1")) == 0 &&
-            setCategories.count(string(category)) == 0)
+        uint32_t nCategories = nLogCategories.load(boost::memory_order_relaxed);
+        if (nCategories != LOG_ALL && (nCategories & LogCategoryBit(category)) == 0)
             return false;
     }
     return true;
@@ -356,6 +547,16 @@ int LogPrintStr(const std::string &str)
         ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
         fflush(stdout);
     }
+    else if (fPrintToDebugLog && fLogWriterRunning.load(boost::memory_order_acquire))
+    {
+        // queue the line for the log writer thread
+        ret = strTimestamped.length();
+        size_t nUsed = 0;
+        if (!GetLogRing().Push(nLogSequence++, strTimestamped, nUsed))
+            nLogLinesDropped++;
+        else if (nUsed == CLogRing::CAPACITY / 2)
+            condLogWriter->notify_one();
+    }
     else if (fPrintToDebugLog)
     {
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
@@ -373,11 +574,12 @@ int LogPrintStr(const std::string &str)
             if (fReopenDebugLog) {
                 fReopenDebugLog = false;
                 boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-                if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
-                    setbuf(fileout, NULL); // unbuffered
+                if (freopen(pathDebug.string().c_str(),"a",fileout) == NULL)
+                    return ret;
             }
 
             ret = FileWriteStr(strTimestamped, fileout);
+            fflush(fileout);
         }
     }
     return ret;
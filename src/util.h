@@ -92,6 +92,10 @@ bool SetupNetworking();
 
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
+/** Apply the categories in -debug to LogAcceptCategory */
+void UpdateLogCategories();
+/** Number of log lines dropped because the log writer thread fell behind */
+uint64_t GetLogLinesDropped();
 /** Send a string to the log output */
 int LogPrintStr(const std::string &str);
 
@@ -158,6 +162,8 @@ boost::filesystem::path GetSpecialFolderPath(int nFolder, bool fCreate = true);
 #endif
 boost::filesystem::path GetTempPath();
 void OpenDebugLog();
+/** Write out the queued log lines and go back to writing debug.log synchronously */
+void StopDebugLogWriter();
 void ShrinkDebugFile();
 void runCommand(const std::string& strCommand);
 
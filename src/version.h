@@ -10,7 +10,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70206;
+static const int PROTOCOL_VERSION = 70207;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -41,4 +41,7 @@ static const int NO_BLOOM_VERSION = 70201;
 //! "sendheaders" command and announcing blocks with headers starts with this version
 static const int SENDHEADERS_VERSION = 70201;
 
+//! "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn" (compact block relay, as in BIP152) start with this version
+static const int COMPACT_BLOCKS_VERSION = 70207;
+
 #endif // BITCOIN_VERSION_H
@@ -4,6 +4,8 @@
 
 #include "wallet/wallet.h"
 
+#include "darksend.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -11,6 +13,7 @@
 
 #include "test/test_dash.h"
 
+#include <boost/assign/list_of.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -361,4 +364,58 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 101);
 }
 
+static uint256 add_mixing_tx(CWallet& wallet, const std::vector<COutPoint>& vecPrevouts, const std::vector<CAmount>& vecAmounts, const CScript& scriptPubKey)
+{
+    static int nextLockTime = 0;
+    CMutableTransaction tx;
+    tx.nLockTime = nextLockTime++;        // so all transactions get different hashes
+    BOOST_FOREACH(const COutPoint& prevout, vecPrevouts)
+        tx.vin.push_back(CTxIn(prevout));
+    BOOST_FOREACH(const CAmount& nAmount, vecAmounts)
+        tx.vout.push_back(CTxOut(nAmount, scriptPubKey));
+    CWalletTx wtx(&wallet, tx);
+    wallet.AddToWallet(wtx, true, NULL);
+    return wtx.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_rounds)
+{
+    darkSendPool.InitDenominations();
+    const CAmount nDenom = vecPrivateSendDenominations.back();
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // unknown outpoint
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(uint256S("1"), 0)), -1);
+
+    // denominated output next to a non-denominated one, collateral output
+    uint256 hashSource = add_mixing_tx(wallet, std::vector<COutPoint>(), boost::assign::list_of(nDenom)(5 * COIN)(PRIVATESEND_COLLATERAL * 2), scriptPubKey);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashSource, 0)), 0);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashSource, 1)), -2);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashSource, 2)), -3);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashSource, 3)), -4);
+
+    // every mixing round adds one, up to MAX_PRIVATESEND_ROUNDS
+    std::vector<uint256> vecChain;
+    COutPoint prevout(hashSource, 0);
+    for (int i = 0; i < MAX_PRIVATESEND_ROUNDS + 10; i++) {
+        vecChain.push_back(add_mixing_tx(wallet, std::vector<COutPoint>(1, prevout), std::vector<CAmount>(2, nDenom), scriptPubKey));
+        prevout = COutPoint(vecChain.back(), 0);
+    }
+    // query the deepest one first so that the whole chain is resolved at once
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(vecChain.back(), 1)), MAX_PRIVATESEND_ROUNDS);
+    for (int i = 0; i < MAX_PRIVATESEND_ROUNDS; i++)
+        BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(vecChain[i], 0)), i + 1);
+
+    // the shortest chain wins
+    uint256 hashMixed = add_mixing_tx(wallet, boost::assign::list_of(COutPoint(vecChain[10], 1))(COutPoint(vecChain[3], 1)), std::vector<CAmount>(2, nDenom), scriptPubKey);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashMixed, 0)), 5);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -681,12 +681,25 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        // IsMine() results might have changed, so have to recalculate all rounds
+        mapOutpointRoundsCache.clear();
     }
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
 }
 
+void CWallet::UpdatePrivateSendRounds(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsDenominatedAmount(wtx.vout[i].nValue) && IsMine(wtx.vout[i]) != ISMINE_NO)
+            GetRealOutpointPrivateSendRounds(COutPoint(hash, i));
+    }
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
 {
     uint256 hash = wtxIn.GetHash();
@@ -766,6 +779,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                              wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            // Transaction arrived after the ones spending it, rounds calculated for them are stale now
+            TxSpends::const_iterator itSpends = mapTxSpends.lower_bound(COutPoint(hash, 0));
+            if (itSpends != mapTxSpends.end() && itSpends->first.hash == hash)
+                mapOutpointRoundsCache.clear();
+            UpdatePrivateSendRounds(wtx);
         }
 
         bool fUpdated = false;
@@ -1043,90 +1061,93 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
     return 0;
 }
 
-// Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input)
-int CWallet::GetRealInputPrivateSendRounds(CTxIn txin, int nRounds) const
+// Determine the rounds of a given outpoint (How deep is the PrivateSend chain for a given outpoint).
+// Ancestors are resolved with an explicit stack instead of recursion and every
+// result is memoized in mapOutpointRoundsCache, so each outpoint is evaluated once.
+int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
-
-    if(nRounds >= 16) return 15; // 16 rounds max
-
-    uint256 hash = txin.prevout.hash;
-    unsigned int nout = txin.prevout.n;
-
-    const CWalletTx* wtx = GetWalletTx(hash);
-    if(wtx != NULL)
-    {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        if (mdwi == mDenomWtxes.end()) {
-            // not known yet, let's add it
-            LogPrint("privatesend", "GetRealInputPrivateSendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        } else if(mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            // found and it's not an initial value, just return it
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
+    LOCK(cs_wallet);
 
-        // bounds check
-        if (nout >= wtx->vout.size()) {
-            // should never actually hit this
-            LogPrint("privatesend", "GetRealInputPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -4);
-            return -4;
-        }
+    std::map<COutPoint, int>::const_iterator it = mapOutpointRoundsCache.find(outpoint);
+    if (it != mapOutpointRoundsCache.end())
+        return it->second;
 
-        if (IsCollateralAmount(wtx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("privatesend", "GetRealInputPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+    // not in wallet (yet), don't cache anything
+    if (GetWalletTx(outpoint.hash) == NULL)
+        return -1;
 
-        //make sure the final output is non-denominate
-        if (!IsDenominatedAmount(wtx->vout[nout].nValue)) { //NOT DENOM
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("privatesend", "GetRealInputPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
-        bool fAllDenoms = true;
-        BOOST_FOREACH(CTxOut out, wtx->vout) {
-            fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
+    std::vector<COutPoint> vecStack(1, outpoint);
+    while (!vecStack.empty()) {
+        const COutPoint current = vecStack.back();
+        if (mapOutpointRoundsCache.count(current)) {
+            vecStack.pop_back();
+            continue;
         }
 
-        // this one is denominated but there is another non-denominated output found in the same tx
-        if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("privatesend", "GetRealInputPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+        // only outpoints of wallet transactions are ever pushed, see IsMine(txin) below
+        const CWalletTx* wtx = GetWalletTx(current.hash);
+        assert(wtx != NULL);
+
+        int nRoundsRet;
+        if (current.n >= wtx->vout.size()) {
+            // bounds check, should never actually hit this
+            nRoundsRet = -4;
+        } else if (IsCollateralAmount(wtx->vout[current.n].nValue)) {
+            nRoundsRet = -3;
+        } else if (!IsDenominatedAmount(wtx->vout[current.n].nValue)) {
+            //make sure the final output is non-denominate
+            nRoundsRet = -2;
+        } else {
+            bool fAllDenoms = true;
+            BOOST_FOREACH(const CTxOut& out, wtx->vout) {
+                fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
+            }
 
-        int nShortest = -10; // an initial value, should be no way to get this by calculations
-        bool fDenomFound = false;
-        // only denoms here so let's look up
-        BOOST_FOREACH(CTxIn txinNext, wtx->vin) {
-            if (IsMine(txinNext)) {
-                int n = GetRealInputPrivateSendRounds(txinNext, nRounds + 1);
-                // denom found, find the shortest chain or initially assign nShortest with the first found value
-                if(n >= 0 && (n < nShortest || nShortest == -10)) {
-                    nShortest = n;
-                    fDenomFound = true;
+            if (!fAllDenoms) {
+                // this one is denominated but there is another non-denominated output found in the same tx
+                nRoundsRet = 0;
+            } else {
+                int nShortest = -10; // an initial value, should be no way to get this by calculations
+                bool fDenomFound = false;
+                bool fPending = false;
+                // only denoms here so let's look up
+                BOOST_FOREACH(const CTxIn& txinNext, wtx->vin) {
+                    if (!IsMine(txinNext)) continue;
+                    std::map<COutPoint, int>::const_iterator itNext = mapOutpointRoundsCache.find(txinNext.prevout);
+                    if (itNext == mapOutpointRoundsCache.end()) {
+                        // resolve the ancestor first and come back to this one later
+                        vecStack.push_back(txinNext.prevout);
+                        fPending = true;
+                        continue;
+                    }
+                    int n = itNext->second;
+                    // denom found, find the shortest chain or initially assign nShortest with the first found value
+                    if (n >= 0 && (n < nShortest || nShortest == -10)) {
+                        nShortest = n;
+                        fDenomFound = true;
+                    }
                 }
+                if (fPending) continue;
+
+                nRoundsRet = fDenomFound
+                        ? std::min(nShortest + 1, MAX_PRIVATESEND_ROUNDS) // good, we a +1 to the shortest one but only 16 rounds max allowed
+                        : 0;            // too bad, we are the fist one in that chain
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
-                ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
-                : 0;            // too bad, we are the fist one in that chain
-        LogPrint("privatesend", "GetRealInputPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+
+        mapOutpointRoundsCache[current] = nRoundsRet;
+        LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", current.hash.ToString(), current.n, nRoundsRet);
+        vecStack.pop_back();
     }
 
-    return nRounds - 1;
+    return mapOutpointRoundsCache[outpoint];
 }
 
 // respect current settings
 int CWallet::GetInputPrivateSendRounds(CTxIn txin) const
 {
     LOCK(cs_wallet);
-    int realPrivateSendRounds = GetRealInputPrivateSendRounds(txin, 0);
+    int realPrivateSendRounds = GetRealOutpointPrivateSendRounds(txin.prevout);
     return realPrivateSendRounds > nPrivateSendRounds ? nPrivateSendRounds : realPrivateSendRounds;
 }
 
@@ -3347,6 +3368,13 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    {
+        // Transactions are loaded in no particular order, so rounds can only be calculated now
+        LOCK(cs_wallet);
+        BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+            UpdatePrivateSendRounds(item.second);
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
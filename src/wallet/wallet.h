@@ -539,6 +539,9 @@ private:
     mutable bool fAnonymizableTallyCachedNonDenom;
     mutable std::vector<CompactTallyItem> vecAnonymizableTallyCachedNonDenom;
 
+    //! PrivateSend rounds per wallet outpoint, filled lazily in ancestry order (see GetRealOutpointPrivateSendRounds)
+    mutable std::map<COutPoint, int> mapOutpointRoundsCache;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -609,6 +612,7 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        mapOutpointRoundsCache.clear();
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -662,8 +666,8 @@ public:
     bool IsCollateralAmount(CAmount nInputAmount) const;
     int  CountInputsWithAmount(CAmount nInputAmount);
 
-    // get the PrivateSend chain depth for a given input
-    int GetRealInputPrivateSendRounds(CTxIn txin, int nRounds) const;
+    // get the PrivateSend chain depth for a given outpoint
+    int GetRealOutpointPrivateSendRounds(const COutPoint& outpoint) const;
     // respect current settings
     int GetInputPrivateSendRounds(CTxIn txin) const;
 
@@ -727,6 +731,7 @@ public:
     int64_t IncOrderPosNext(CWalletDB *pwalletdb = NULL);
 
     void MarkDirty();
+    void UpdatePrivateSendRounds(const CWalletTx& wtx);
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);